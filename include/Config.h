@@ -10,6 +10,12 @@
 #define WIFI_PASSWORD "DefaultPassword"
 #endif
 
+// Key for authenticating firmware images. Empty turns push OTA off and
+// refuses every pulled image.
+#ifndef OTA_SECRET
+#define OTA_SECRET ""
+#endif
+
 const char *ssid = WIFI_SSID;
 const char *password = WIFI_PASSWORD;
 
@@ -19,10 +25,12 @@ const char *password = WIFI_PASSWORD;
 #define STEPPER_EN_PIN 26
 
 // Display Pins and Settings
-#define POT_PIN 34
 #define SCREEN_WIDTH 128
 #define SCREEN_HEIGHT 64
 #define OLED_RESET -1
+// Most SSD1306 modules also run fine at 800 kHz - 1 MHz with short wires,
+// which shortens each transfer proportionally
+#define DISPLAY_I2C_CLOCK 400000
 
 // Button Pins
 #define BUTTON_ENABLE_PIN 25
@@ -30,25 +38,95 @@ const char *password = WIFI_PASSWORD;
 #define BUTTON_SPEED_DOWN_PIN 35
 #define BUTTON_MENU_PIN 14
 
+// Speed Potentiometer, read continuously by the ADC's DMA controller
+#define POT_PIN 36                       // ADC1 only (GPIO 32-39); -1 without a potentiometer
+#define POT_HYSTERESIS 0.01f             // Fraction of the travel the knob must move to change the speed
+#define POT_DEAD_ZONE 0.03f              // Fraction at each end that reads as stop and full speed
+
 // Stepper Settings
-#define MAX_SPEED 100000
-#define ACCELERATION 1000
+#define MAX_SPEED 4000 // steps/sec, keep under the safe maximum from the step self-test
+#define ACCELERATION 8000 // steps/sec^2, full speed in about a second along the S-curve
 
 // Display Timeout (ms)
 #define DISPLAY_TIMEOUT 100000
 
 // EEPROM Address
 #define EEPROM_ADDR 0
+#define TOTALIZER_EEPROM_ADDR 32         // Delivered-volume record (VolumeTotalizer::STORAGE_SIZE bytes)
+#define TOTALIZER_FLUSH_INTERVAL 60000   // ms, also the most volume history lost on power failure
+#define CALIBRATION_TABLE_EEPROM_ADDR 64 // sizeof(CalibrationTable::Stored) bytes
+#define OTA_EEPROM_ADDR 144              // OtaUpdater::STORAGE_SIZE bytes
+#define RUN_STATE_EEPROM_ADDR 160        // Last pump on/off state and speed, 16 bytes
+#define SCHEDULE_EEPROM_ADDR 176         // DoseScheduler::STORAGE_SIZE bytes
 
 // Calibration Settings
 #define CALIBRATE_TIME 60 // in seconds
 #define CALIBRATE_SPEED 20000
+#define CALIBRATION_TABLE_SPEEDS {500, 1000, 2000, 3000, 4000} // steps/sec, one point each
 
 #define ID_PERISTALTIC_STEPPER "pump-1"
 #define PUMP_SETTINGS_API "/api/pump-settings" // API endpoint for pump settings
 #define PUMP_BY_ID_API "/api/pump-settings/getById" // API endpoint for get current settings
 
-#define WIFI_RETRY_INTERVAL 5000         // ms
-#define SYNC_INTERVAL 180000             // ms
+#define WIFI_RETRY_INTERVAL 5000         // ms, doubled after each failed attempt
+#define WIFI_RETRY_MAX_INTERVAL 300000   // ms cap on the reconnect backoff
+#define SYNC_INTERVAL 180000             // ms on a good link, up to 4x longer on a weak one
+#define LINK_SAMPLE_INTERVAL 10000       // ms between RSSI samples while awake
+#define SETTINGS_REVALIDATE_INTERVAL 600000 // ms between conditional settings fetches
+#define HTTP_TIMEOUT 1000                // ms a backend request may take
+#define SETTINGS_CACHE_NAMESPACE "settings" // NVS namespace of the cached settings document
+
+// BLE Settings
+#define BLE_DEVICE_NAME "SmartPump-" ID_PERISTALTIC_STEPPER
+#define BLE_MTU 247                      // Requested ATT MTU
+#define BLE_TELEMETRY_INTERVAL 1000      // ms between telemetry samples
+#define BLE_TELEMETRY_BATCH 4            // Samples per notification (capped by MTU)
+
+// Transport Failover
+#define BT_DEVICE_NAME "SmartPump-" ID_PERISTALTIC_STEPPER "-SPP"
+#define FAILOVER_BUDGET_MS 2000          // Max ms a request spends on all links, or the first link's timeout if longer
+#define LINK_PROBE_INTERVAL 30000        // ms between health probes of an unhealthy link
+
+// Power Management
+#define ACTIVE_CPU_MHZ 240
+#define IDLE_CPU_MHZ 80                  // WiFi needs at least 80 MHz
+#define IDLE_MAX_WAIT_MS 250             // Longest block in idle, bounds BLE/Bluetooth latency
+
+// Dosing
+#define DOSE_DEFAULT_SPEED 2000          // steps/sec when a dose command gives no rate
+#define RUN_STATE_SAVE_DELAY 2000        // ms a pump state must hold before it is persisted
+
+// Dose Schedule
+#define TIMEZONE "UTC0"                  // POSIX TZ string for daily programs, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+#define NTP_SERVER "pool.ntp.org"
+#define NTP_SYNC_INTERVAL 3600000        // ms between SNTP syncs
+#define SCHEDULE_HISTORY_REPORT 8        // Executions reported per sync
+
+// Loop Watchdog
+#define WATCHDOG_TIMEOUT_S 15            // Task watchdog on loop(), restarts the chip
+#define STALL_MS 2000                    // Time without progress that counts as a stall
+#define NETWORK_STALL_MS 8000            // Same for phases that make blocking requests
+#define BOOT_STALL_MS 3000               // Same for the deferred boot stages
+
+// Step Self-Test
+#define SELF_TEST_RATES {1000, 2000, 4000, 8000, 12000, 16000, 24000, 32000, 48000, 64000, 80000, 100000} // steps/sec
+#define SELF_TEST_DURATION_MS 1000       // Per rate and load
+
+// Flow Regulation
+#define FLOW_SENSOR_PIN -1               // Pulse-output flow sensor, e.g. 27; -1 runs open loop
+#define FLOW_PULSES_PER_ML 5.88f         // Sensor K-factor from its datasheet
+#define FLOW_KP 0.1f                     // Trim per unit of relative flow error
+#define FLOW_KI 0.01f                    // Same per second, tune with tools/flow_sim
+#define FLOW_MAX_TRIM 0.2f               // Largest correction, fraction of the step rate
+#define FLOW_WINDOW_MS 5000              // Shortest measurement window
+#define FLOW_MIN_PULSES 50               // Fewest pulses per window, longer windows at low flow
+#define FLOW_RECALIBRATE_ERROR 0.03f     // Tubing drift that rewrites the calibration
+#define FLOW_RECALIBRATE_ML 50.0f        // Volume measured per drift check
+#define FLOW_MAX_RECALIBRATION 0.25f     // Larger drifts point at the sensor and are ignored
+
+// Firmware Updates
+#define FIRMWARE_VERSION "1.1.0"         // Compared with the version the backend offers
+#define OTA_LOCAL_PORT 80                // Serves POST /api/ota for pushed images, when OTA_SECRET is set
+#define OTA_VALIDATION_MS 60000          // Uptime after which a new image counts as good
 
 #endif
\ No newline at end of file
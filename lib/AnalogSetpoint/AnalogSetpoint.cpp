@@ -0,0 +1,174 @@
+#include "AnalogSetpoint.h"
+#include <math.h>
+
+bool AnalogSetpoint::begin(int pin, float hysteresis, float deadZoneFraction)
+{
+  int adcChannel = adc1Channel(pin);
+  if (adcChannel < 0)
+    return false;
+  channel = adcChannel;
+  hysteresisCounts = hysteresis * FULL_SCALE;
+  deadZone = deadZoneFraction;
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = 2 * FRAME_BYTES;
+  init.conv_num_each_intr = FRAME_BYTES;
+  init.adc1_chan_mask = BIT(channel);
+  init.adc2_chan_mask = 0;
+  if (adc_digi_initialize(&init) != ESP_OK)
+    return false;
+
+  adc_digi_pattern_config_t pattern = {};
+  pattern.atten = ADC_ATTEN_DB_11; // Full 0-3.3 V travel
+  pattern.channel = channel;
+  pattern.unit = 0; // ADC1
+  pattern.bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+
+  adc_digi_configuration_t config = {};
+  config.conv_limit_en = 1; // Required on the ESP32
+  config.conv_limit_num = 250;
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = SAMPLE_RATE;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+  if (adc_digi_controller_configure(&config) != ESP_OK || adc_digi_start() != ESP_OK)
+  {
+    adc_digi_deinitialize();
+    return false;
+  }
+
+  started = true;
+  xTaskCreatePinnedToCore(taskEntry, "pot", TASK_STACK, this, TASK_PRIORITY, nullptr, TASK_CORE);
+  return true;
+}
+
+void AnalogSetpoint::taskEntry(void *arg)
+{
+  static_cast<AnalogSetpoint *>(arg)->taskLoop();
+}
+
+void AnalogSetpoint::taskLoop()
+{
+  bool running = true;
+  for (;;)
+  {
+    bool idle = lowPower;
+    if (idle)
+      vTaskDelay(pdMS_TO_TICKS(LOW_POWER_INTERVAL_MS));
+    if (idle || !running)
+    {
+      adc_digi_start();
+      float stale;
+      readFrame(stale); // May have been converted before the last stop
+      running = true;
+    }
+
+    float average;
+    if (readFrame(average))
+      addReading(average, millis());
+
+    if (idle)
+    {
+      adc_digi_stop(); // Releases the APB lock until the next frame
+      running = false;
+    }
+  }
+}
+
+// Averages one DMA frame, 512 conversions at 12 bits, into one reading
+bool AnalogSetpoint::readFrame(float &average)
+{
+  uint32_t length = 0;
+  esp_err_t result = adc_digi_read_bytes(frame, FRAME_BYTES, &length, 100);
+  if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) // INVALID_STATE: older frames dropped, this one is good
+    return false;
+
+  uint32_t sum = 0, count = 0;
+  for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+  {
+    const adc_digi_output_data_t *sample = reinterpret_cast<const adc_digi_output_data_t *>(&frame[i]);
+    if (sample->type1.channel != channel)
+      continue;
+    sum += sample->type1.data;
+    count++;
+  }
+  if (count == 0)
+    return false;
+  average = (float)sum / count;
+  return true;
+}
+
+void AnalogSetpoint::addReading(float reading, uint32_t nowMs)
+{
+  readings[nextReading] = reading;
+  nextReading = (nextReading + 1) % MEDIAN_SIZE;
+  if (readingCount < MEDIAN_SIZE)
+    readingCount++;
+  if (readingCount < MEDIAN_SIZE)
+    return;
+
+  // Insertion sort, there are only MEDIAN_SIZE entries
+  float sorted[MEDIAN_SIZE];
+  for (size_t i = 0; i < MEDIAN_SIZE; i++)
+  {
+    size_t pos = i;
+    while (pos > 0 && sorted[pos - 1] > readings[i])
+    {
+      sorted[pos] = sorted[pos - 1];
+      pos--;
+    }
+    sorted[pos] = readings[i];
+  }
+  float median = sorted[MEDIAN_SIZE / 2];
+
+  // Time-based coefficient, so the low power rate smooths over the same time
+  float value = median;
+  if (primed)
+  {
+    float alpha = 1 - expf(-(float)(nowMs - lastReadingMs) / FILTER_TAU_MS);
+    value = filtered + alpha * (median - filtered);
+  }
+  primed = true;
+  filtered = value;
+  lastReadingMs = nowMs;
+
+  portENTER_CRITICAL(&mux);
+  if (!baselined)
+  {
+    settled = value;
+    baselined = true;
+  }
+  else if (fabsf(value - settled) > hysteresisCounts)
+  {
+    settled = value;
+    changed = true;
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+bool AnalogSetpoint::takeChange(float &newPosition)
+{
+  portENTER_CRITICAL(&mux);
+  bool wasChanged = changed;
+  changed = false;
+  float counts = settled;
+  portEXIT_CRITICAL(&mux);
+  if (wasChanged)
+    newPosition = toPosition(counts);
+  return wasChanged;
+}
+
+float AnalogSetpoint::position() const
+{
+  portENTER_CRITICAL(&mux);
+  float counts = settled;
+  portEXIT_CRITICAL(&mux);
+  return toPosition(counts);
+}
+
+float AnalogSetpoint::toPosition(float counts) const
+{
+  float position = (counts / FULL_SCALE - deadZone) / (1 - 2 * deadZone);
+  return constrain(position, 0.0f, 1.0f);
+}
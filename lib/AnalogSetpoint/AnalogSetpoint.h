@@ -0,0 +1,80 @@
+#ifndef ANALOG_SETPOINT_H
+#define ANALOG_SETPOINT_H
+
+#include <Arduino.h>
+#include <driver/adc.h>
+
+// Potentiometer input sampled by the ADC's DMA controller, so loop() never
+// waits on a conversion. A task averages each DMA frame into one oversampled
+// reading, takes the median of the last few readings to drop spikes (WiFi
+// bursts couple into the ADC), smooths the result with an IIR filter and
+// only reports a new position once it moves past the hysteresis band.
+//
+// Continuous mode holds an APB frequency lock while it runs. In low power
+// the task samples one frame every LOW_POWER_INTERVAL_MS and stops the ADC
+// in between, so the knob still works while the pump is idle.
+//
+// ADC1 only: continuous mode on the ESP32 has no ADC2, and WiFi owns ADC2.
+class AnalogSetpoint
+{
+public:
+  // ADC1 channel of a GPIO, -1 if it has none. For compile-time pin checks.
+  static constexpr int adc1Channel(int pin)
+  {
+    return pin == 36 ? 0 : pin == 37 ? 1 : pin == 38 ? 2 : pin == 39 ? 3
+         : pin >= 32 && pin <= 35 ? pin - 28 : -1;
+  }
+
+  // hysteresis and deadZone are fractions of the travel. The dead zone at
+  // each end absorbs the ADC's flat ends, so the stops read 0 and 1.
+  bool begin(int pin, float hysteresis, float deadZone);
+  void setLowPower(bool enable) { lowPower = enable; }
+  bool isStarted() const { return started; }
+
+  // True once each time the knob settles at a new position, 0 to 1. The
+  // position at boot is taken as the baseline and not reported, so a
+  // restored speed stands until the knob is turned.
+  bool takeChange(float &position);
+  float position() const; // Last settled position
+  uint16_t reading() const { return (uint16_t)filtered; } // Filtered ADC counts
+
+private:
+  static void taskEntry(void *arg);
+  void taskLoop();
+  bool readFrame(float &average);
+  void addReading(float reading, uint32_t nowMs);
+  float toPosition(float counts) const;
+
+  static const uint32_t SAMPLE_RATE = 20000;        // Hz, the ESP32's lowest DMA rate
+  static const uint32_t FRAME_BYTES = 1024;         // 512 conversions, one reading every 25.6 ms
+  static const size_t MEDIAN_SIZE = 5;
+  static constexpr float FILTER_TAU_MS = 100;       // IIR time constant, independent of the reading rate
+  static const uint32_t LOW_POWER_INTERVAL_MS = 250;
+  static const uint32_t TASK_STACK = 2048;
+  static const UBaseType_t TASK_PRIORITY = 1;
+  static const BaseType_t TASK_CORE = 0;
+  static constexpr float FULL_SCALE = 4095;
+
+  uint8_t channel = 0;
+  float hysteresisCounts = 0;
+  float deadZone = 0;
+  bool started = false;
+  volatile bool lowPower = false;
+  uint8_t frame[FRAME_BYTES];
+
+  // Task only
+  float readings[MEDIAN_SIZE] = {};
+  size_t readingCount = 0;
+  size_t nextReading = 0;
+  uint32_t lastReadingMs = 0;
+  bool primed = false;
+  volatile float filtered = 0;
+
+  // Shared with loop()
+  mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  float settled = 0;
+  bool baselined = false;
+  bool changed = false;
+};
+
+#endif
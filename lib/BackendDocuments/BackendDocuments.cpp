@@ -0,0 +1,170 @@
+#include "BackendDocuments.h"
+#include <stdio.h>
+
+namespace BackendDocuments
+{
+  void buildSync(JsonDocument &doc, const SyncReport &report)
+  {
+    doc["pumpId"] = report.pumpId;
+    doc["stepsPerML"] = report.stepsPerML;
+    doc["stepsPerSecond"] = report.stepsPerSecond;
+    doc["currentSpeed"] = report.currentSpeed;
+    doc["actualSpeed"] = report.actualSpeed;
+    doc["rssi"] = report.rssi;
+
+    JsonObject link = doc["link"].to<JsonObject>();
+    link["quality"] = report.link.quality;
+    if (report.link.hasSignal)
+      link["rssi"] = report.link.rssi;
+    link["successRate"] = report.link.successRate;
+    link["latencyMs"] = report.link.latencyMs;
+    link["syncIntervalMs"] = report.link.syncIntervalMs;
+    link["reconnectFailures"] = report.link.reconnectFailures;
+
+    if (report.flow != nullptr)
+    {
+      JsonObject flow = doc["flow"].to<JsonObject>();
+      flow["measuredMlPerMin"] = report.flow->measuredMlPerMin;
+      flow["trim"] = report.flow->trim;
+      flow["sensorFault"] = report.flow->sensorFault;
+      flow["recalibrations"] = report.flow->recalibrations;
+    }
+
+    if (report.calibrationCount > 0)
+    {
+      JsonArray table = doc["calibrationTable"].to<JsonArray>();
+      for (size_t i = 0; i < report.calibrationCount; i++)
+      {
+        JsonObject point = table.add<JsonObject>();
+        point["speed"] = report.calibration[i].speed;
+        point["stepsPerML"] = report.calibration[i].stepsPerML;
+      }
+    }
+
+    JsonObject volume = doc["volume"].to<JsonObject>();
+    volume["lifetimeML"] = report.lifetimeML;
+    volume["sessionML"] = report.sessionML;
+    volume["doseML"] = report.doseML;
+    volume["doseActive"] = report.doseActive;
+    volume["lifetimeSteps"] = report.lifetimeSteps;
+
+    JsonObject power = doc["power"].to<JsonObject>();
+    power["activeMs"] = report.activeMs;
+    power["idleMs"] = report.idleMs;
+    power["sleepMs"] = report.sleepMs;
+
+    if (report.resetReason != nullptr)
+    {
+      JsonObject boot = doc["boot"].to<JsonObject>();
+      boot["resetReason"] = report.resetReason;
+      JsonArray stages = boot["stages"].to<JsonArray>();
+      for (size_t i = 0; i < report.bootStageCount; i++)
+      {
+        JsonObject stage = stages.add<JsonObject>();
+        stage["stage"] = report.bootStages[i].stage;
+        stage["us"] = report.bootStages[i].us;
+      }
+    }
+
+    JsonObject schedule = doc["schedule"].to<JsonObject>();
+    schedule["programs"] = report.programs;
+    schedule["timeSynced"] = report.timeSynced;
+    schedule["driftPpm"] = report.driftPpm;
+    schedule["maxJitterMs"] = report.maxJitterMs;
+    JsonArray history = schedule["history"].to<JsonArray>();
+    for (size_t i = 0; i < report.historyCount; i++)
+    {
+      const Execution &execution = report.history[i];
+      JsonObject entry = history.add<JsonObject>();
+      entry["seq"] = execution.seq;
+      entry["program"] = execution.programId;
+      entry["outcome"] = execution.outcome;
+      if (execution.scheduledUnix != 0)
+        entry["scheduled"] = execution.scheduledUnix;
+      entry["jitterMs"] = execution.jitterMs;
+      entry["requestedML"] = execution.requestedML;
+      entry["deliveredML"] = execution.deliveredML;
+    }
+
+    JsonObject watchdog = doc["watchdog"].to<JsonObject>();
+    watchdog["boot"] = report.watchdogBoot;
+    JsonArray stalls = watchdog["stalls"].to<JsonArray>();
+    for (size_t i = 0; i < report.stallCount; i++)
+    {
+      const Stall &record = report.stalls[i];
+      JsonObject stall = stalls.add<JsonObject>();
+      stall["seq"] = record.seq;
+      stall["boot"] = record.boot;
+      stall["uptimeMs"] = record.uptimeMs;
+      stall["subsystem"] = record.subsystem;
+      stall["loopPhase"] = record.loopPhase;
+      stall["stalledMs"] = record.stalledMs;
+      stall["reset"] = record.reset;
+    }
+
+    if (report.selfTestSafeMax > 0)
+    {
+      JsonObject selfTest = doc["selfTest"].to<JsonObject>();
+      selfTest["safeMax"] = report.selfTestSafeMax;
+      selfTest["maxSpeed"] = report.maxSpeed;
+    }
+
+    JsonObject firmware = doc["firmware"].to<JsonObject>();
+    firmware["version"] = report.firmwareVersion;
+    firmware["ota"] = report.otaState;
+    firmware["progress"] = report.otaProgress;
+    if (report.otaError != nullptr)
+      firmware["error"] = report.otaError;
+  }
+
+  static bool parseProgram(JsonObjectConst entry, Program &program)
+  {
+    program = Program();
+    program.id = entry["id"] | 0;
+    program.ml = entry["ml"] | 0.0f;
+    program.speed = entry["speed"] | 0.0f;
+    program.enabled = entry["enabled"] | true;
+    const char *at = entry["at"];
+    int hours = 0, minutes = 0, seconds = 0;
+    if (at != nullptr && sscanf(at, "%d:%d:%d", &hours, &minutes, &seconds) >= 2 && hours >= 0 && hours < 24 &&
+        minutes >= 0 && minutes < 60 && seconds >= 0 && seconds < 60)
+    {
+      program.daily = true;
+      program.time = hours * 3600 + minutes * 60 + seconds;
+    }
+    else if (entry["everyMinutes"].is<uint32_t>() || entry["everySeconds"].is<uint32_t>())
+    {
+      program.time = entry["everySeconds"] | (entry["everyMinutes"].as<uint32_t>() * 60);
+    }
+    return program.id != 0 && program.ml > 0 && (program.daily || program.time > 0);
+  }
+
+  void parseSettings(const JsonDocument &doc, Settings &settings)
+  {
+    settings.revision[0] = '\0';
+    JsonVariantConst revision = doc["revision"];
+    if (revision.is<const char *>())
+      snprintf(settings.revision, sizeof(settings.revision), "%s", revision.as<const char *>());
+    else if (!revision.isNull())
+      serializeJson(revision, settings.revision, sizeof(settings.revision)); // Numeric revisions
+
+    settings.hasSpeed = doc["currentSpeed"].is<float>();
+    settings.currentSpeed = doc["currentSpeed"] | 0.0f;
+
+    settings.hasPrograms = doc["programs"].is<JsonArrayConst>();
+    settings.programCount = 0;
+    for (JsonObjectConst entry : doc["programs"].as<JsonArrayConst>())
+    {
+      if (settings.programCount == MAX_PROGRAMS)
+        break;
+      if (parseProgram(entry, settings.programs[settings.programCount]))
+        settings.programCount++;
+    }
+
+    JsonObjectConst firmware = doc["firmware"];
+    settings.firmware.version = firmware["version"];
+    settings.firmware.path = firmware["path"];
+    settings.firmware.sha256 = firmware["sha256"];
+    settings.firmware.hmac = firmware["hmac"];
+  }
+}
@@ -0,0 +1,145 @@
+#ifndef BACKEND_DOCUMENTS_H
+#define BACKEND_DOCUMENTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ArduinoJson.h>
+#include <CalibrationTable.h>
+
+// The JSON exchanged with the backend: the document syncData() posts and the
+// settings fetchSettings() receives. main.cpp gathers the pump's state into
+// a SyncReport and applies what parseSettings() reads out, so this needs
+// nothing but ArduinoJson and builds on the host, where tools/bench times
+// the same code the firmware runs.
+namespace BackendDocuments
+{
+  struct LinkReport
+  {
+    uint8_t quality; // Percent
+    bool hasSignal;  // rssi is only sent once measured
+    float rssi;
+    float successRate;
+    float latencyMs;
+    uint32_t syncIntervalMs;
+    uint8_t reconnectFailures;
+  };
+
+  struct FlowReport
+  {
+    float measuredMlPerMin;
+    float trim;
+    bool sensorFault;
+    uint32_t recalibrations;
+  };
+
+  struct BootStage
+  {
+    const char *stage;
+    uint32_t us;
+  };
+
+  struct Execution
+  {
+    uint32_t seq;
+    uint8_t programId;
+    const char *outcome;
+    uint32_t scheduledUnix; // 0 if the clock was not synced, then left out
+    int32_t jitterMs;
+    float requestedML;
+    float deliveredML;
+  };
+
+  struct Stall
+  {
+    uint32_t seq;
+    uint32_t boot;
+    uint32_t uptimeMs;
+    const char *subsystem;
+    const char *loopPhase;
+    uint32_t stalledMs;
+    bool reset;
+  };
+
+  // Arrays are count entries long; optional parts are left out when null
+  struct SyncReport
+  {
+    const char *pumpId;
+    float stepsPerML;
+    int stepsPerSecond;
+    float currentSpeed;
+    float actualSpeed; // Lags currentSpeed while ramping
+    int rssi;
+    LinkReport link;
+    const FlowReport *flow;
+    const CalibrationTable::Point *calibration; // Only with a valid table
+    size_t calibrationCount;
+    double lifetimeML;
+    double sessionML;
+    double doseML;
+    bool doseActive;
+    uint64_t lifetimeSteps;
+    uint64_t activeMs;
+    uint64_t idleMs;
+    uint64_t sleepMs;
+    const char *resetReason; // Null once the boot has been reported
+    const BootStage *bootStages;
+    size_t bootStageCount;
+    size_t programs;
+    bool timeSynced;
+    float driftPpm;
+    int32_t maxJitterMs;
+    const Execution *history;
+    size_t historyCount;
+    uint32_t watchdogBoot;
+    const Stall *stalls;
+    size_t stallCount;
+    uint32_t selfTestSafeMax; // 0 if no self-test ran
+    float maxSpeed;
+    const char *firmwareVersion;
+    const char *otaState;
+    uint8_t otaProgress;
+    const char *otaError; // Null unless the update failed
+  };
+
+  void buildSync(JsonDocument &doc, const SyncReport &report);
+
+  static const size_t MAX_PROGRAMS = 8;
+  static const size_t REVISION_SIZE = 40;
+
+  struct Program
+  {
+    uint8_t id;
+    bool daily;    // time is seconds after local midnight, else the period in seconds
+    uint32_t time;
+    float ml;
+    float speed;   // steps/sec, 0 for the default dose speed
+    bool enabled;
+  };
+
+  // Strings point into the document, null when missing
+  struct Firmware
+  {
+    const char *version;
+    const char *path;
+    const char *sha256;
+    const char *hmac;
+  };
+
+  struct Settings
+  {
+    char revision[REVISION_SIZE]; // Empty without one, numbers as their JSON text
+    bool hasSpeed;
+    float currentSpeed;
+    bool hasPrograms;
+    Program programs[MAX_PROGRAMS];
+    size_t programCount;
+    Firmware firmware;
+  };
+
+  // Reads a settings response. Programs: [{"id", "ml", "speed", "at":
+  // "HH:MM[:SS]" local time, or "everyMinutes"/"everySeconds", "enabled"}];
+  // unparseable entries are dropped.
+  void parseSettings(const JsonDocument &doc, Settings &settings);
+}
+
+#endif
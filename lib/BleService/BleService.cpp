@@ -0,0 +1,216 @@
+#include "BleService.h"
+#include <BLE2902.h>
+#include <Logger.h>
+
+#define PUMP_SERVICE_UUID "7d3f0001-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+#define SPEED_CHAR_UUID "7d3f0002-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+#define DOSE_CHAR_UUID "7d3f0003-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+#define CALIBRATION_CHAR_UUID "7d3f0004-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+#define TELEMETRY_CHAR_UUID "7d3f0005-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+#define CONFIG_CHAR_UUID "7d3f0006-6c1e-4b8a-9f3a-2a5c8e1b4d60"
+
+// ATT notification header takes 3 bytes of the MTU
+#define ATT_HEADER_SIZE 3
+
+class BleService::ServerCallbacks : public BLEServerCallbacks
+{
+public:
+  explicit ServerCallbacks(BleService &service) : service(service) {}
+
+  void onConnect(BLEServer *server) override
+  {
+    service.connectedClients++;
+    // Keep advertising so a gateway and a phone can be connected at the same time
+    BLEDevice::startAdvertising();
+  }
+
+  void onDisconnect(BLEServer *server) override
+  {
+    if (service.connectedClients > 0)
+      service.connectedClients--;
+    BLEDevice::startAdvertising();
+  }
+
+private:
+  BleService &service;
+};
+
+class BleService::WriteCallbacks : public BLECharacteristicCallbacks
+{
+public:
+  explicit WriteCallbacks(BleService &service) : service(service) {}
+
+  void onWrite(BLECharacteristic *characteristic) override
+  {
+    uint8_t *data = characteristic->getData();
+    size_t len = characteristic->getLength();
+    float first = 0, second = 0;
+    if (len >= sizeof(float))
+      memcpy(&first, data, sizeof(float));
+    if (len >= 2 * sizeof(float))
+      memcpy(&second, data + sizeof(float), sizeof(float));
+
+    // Raw floats from the client: NaN and inf pass a plain <= 0 check, so
+    // anything not finite is dropped here. Speed 0 stops, dose speed 0
+    // means the default rate.
+    bool firstValid = isfinite(first) && first >= 0;
+    bool secondValid = isfinite(second) && second >= 0;
+
+    portENTER_CRITICAL(&service.mux);
+    if (characteristic == service.speedChar && len >= sizeof(float) && firstValid)
+    {
+      service.pendingSpeed = first;
+      service.speedPending = true;
+    }
+    else if (characteristic == service.doseChar && len >= sizeof(float) && firstValid && first > 0 && secondValid)
+    {
+      service.pendingDoseML = first;
+      service.pendingDoseSpeed = second;
+      service.dosePending = true;
+    }
+    else if (characteristic == service.calibrationChar && len >= sizeof(float) && firstValid)
+    {
+      service.pendingCalibration = first;
+      service.calibrationPending = true;
+    }
+    else if (characteristic == service.configChar && len >= 2)
+    {
+      uint16_t interval = data[0] | (data[1] << 8);
+      service.telemetryInterval = max<uint16_t>(interval, 50);
+      if (len >= 3)
+        service.maxBatch = constrain(data[2], 1, (int)MAX_BATCH);
+      service.configPending = true;
+    }
+    portEXIT_CRITICAL(&service.mux);
+  }
+
+private:
+  BleService &service;
+};
+
+BleService::BleService(const char *deviceName) : deviceName(deviceName) {}
+
+void BleService::begin(uint16_t mtu, uint16_t telemetryIntervalMs, uint8_t recordsPerNotification)
+{
+  telemetryInterval = telemetryIntervalMs;
+  maxBatch = constrain(recordsPerNotification, 1, (int)MAX_BATCH);
+
+  BLEDevice::init(deviceName);
+  BLEDevice::setMTU(mtu);
+
+  server = BLEDevice::createServer();
+  server->setCallbacks(new ServerCallbacks(*this));
+
+  BLEService *service = server->createService(PUMP_SERVICE_UUID);
+  WriteCallbacks *writeCallbacks = new WriteCallbacks(*this);
+
+  speedChar = service->createCharacteristic(SPEED_CHAR_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+  doseChar = service->createCharacteristic(DOSE_CHAR_UUID, BLECharacteristic::PROPERTY_WRITE);
+  calibrationChar = service->createCharacteristic(CALIBRATION_CHAR_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+  telemetryChar = service->createCharacteristic(TELEMETRY_CHAR_UUID, BLECharacteristic::PROPERTY_NOTIFY);
+  configChar = service->createCharacteristic(CONFIG_CHAR_UUID, BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+
+  speedChar->setCallbacks(writeCallbacks);
+  doseChar->setCallbacks(writeCallbacks);
+  calibrationChar->setCallbacks(writeCallbacks);
+  configChar->setCallbacks(writeCallbacks);
+  telemetryChar->addDescriptor(new BLE2902());
+
+  float zero = 0;
+  speedChar->setValue((uint8_t *)&zero, sizeof(zero));
+  calibrationChar->setValue((uint8_t *)&zero, sizeof(zero));
+  writeConfigValue();
+
+  service->start();
+
+  BLEAdvertising *advertising = BLEDevice::getAdvertising();
+  advertising->addServiceUUID(PUMP_SERVICE_UUID);
+  advertising->setScanResponse(true);
+  BLEDevice::startAdvertising();
+
+  LOG_INFO("BLE service started as %s", deviceName);
+}
+
+void BleService::poll()
+{
+  if (server == nullptr)
+    return;
+
+  // Take the latched writes under the lock, run the handlers outside of it
+  bool applySpeed, applyDose, applyCalibration, applyConfig;
+  float speed, doseML, doseSpeed, calibration;
+  portENTER_CRITICAL(&mux);
+  applySpeed = speedPending;
+  applyDose = dosePending;
+  applyCalibration = calibrationPending;
+  applyConfig = configPending;
+  speed = pendingSpeed;
+  doseML = pendingDoseML;
+  doseSpeed = pendingDoseSpeed;
+  calibration = pendingCalibration;
+  speedPending = dosePending = calibrationPending = configPending = false;
+  portEXIT_CRITICAL(&mux);
+
+  if (applySpeed && speedHandler)
+    speedHandler(speed);
+  if (applyDose && doseHandler)
+    doseHandler(doseML, doseSpeed);
+  if (applyCalibration && calibrationHandler)
+    calibrationHandler(calibration);
+  if (applyConfig)
+    writeConfigValue(); // Report the clamped values back
+
+  if (!stateSource)
+    return;
+
+  unsigned long now = millis();
+  if (now - lastSampleTime < telemetryInterval)
+    return;
+  lastSampleTime = now;
+
+  State state = stateSource();
+  speedChar->setValue((uint8_t *)&state.speed, sizeof(state.speed));
+  calibrationChar->setValue((uint8_t *)&state.stepsPerML, sizeof(state.stepsPerML));
+
+  if (isConnected())
+    sampleTelemetry(state);
+  else
+    batchCount = 0;
+}
+
+void BleService::sampleTelemetry(const State &state)
+{
+  TelemetryRecord &record = batch[batchCount++];
+  record.timestamp = millis();
+  record.mlPerMin = state.mlPerMin;
+  record.steps = state.steps;
+  record.status = (state.enabled ? STATUS_ENABLED : 0) | (state.dosing ? STATUS_DOSING : 0);
+
+  // Batch as many records as the smallest negotiated MTU allows
+  uint16_t mtu = BLEDevice::getMTU();
+  for (auto &peer : server->getPeerDevices(false))
+  {
+    if (peer.second.mtu > 0)
+      mtu = min(mtu, peer.second.mtu);
+  }
+  size_t fit = mtu > ATT_HEADER_SIZE ? (mtu - ATT_HEADER_SIZE) / sizeof(TelemetryRecord) : 1;
+  size_t limit = constrain(min(fit, (size_t)maxBatch), (size_t)1, MAX_BATCH);
+
+  if (batchCount >= limit)
+    flushTelemetry();
+}
+
+void BleService::flushTelemetry()
+{
+  if (batchCount == 0)
+    return;
+  telemetryChar->setValue((uint8_t *)batch, batchCount * sizeof(TelemetryRecord));
+  telemetryChar->notify();
+  batchCount = 0;
+}
+
+void BleService::writeConfigValue()
+{
+  uint8_t config[3] = {(uint8_t)(telemetryInterval & 0xFF), (uint8_t)(telemetryInterval >> 8), maxBatch};
+  configChar->setValue(config, sizeof(config));
+}
@@ -0,0 +1,97 @@
+#ifndef BLE_SERVICE_H
+#define BLE_SERVICE_H
+
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <functional>
+
+// BLE GATT service for local control and telemetry. All values are little endian.
+//
+//   speed        read/write  float32 steps/sec
+//   dose         write       float32 mL [, float32 steps/sec]
+//   calibration  read/write  float32 steps/mL
+//   telemetry    notify      batch of TelemetryRecord, as many as fit in the MTU
+//   config       read/write  uint16 sample interval (ms), uint8 max records per notification
+//
+// Writes arrive on the BLE task; they are latched there and handed to the
+// registered handlers from poll() so the pump is only touched from loop().
+class BleService
+{
+public:
+  struct State
+  {
+    float speed;      // steps/sec
+    float stepsPerML;
+    float mlPerMin;
+    uint32_t steps;   // total steps issued
+    bool enabled;
+    bool dosing;
+  };
+
+  struct __attribute__((packed)) TelemetryRecord
+  {
+    uint32_t timestamp; // ms since boot
+    float mlPerMin;
+    uint32_t steps;
+    uint8_t status;     // STATUS_* bits
+  };
+
+  static const uint8_t STATUS_ENABLED = 0x01;
+  static const uint8_t STATUS_DOSING = 0x02;
+
+  BleService(const char *deviceName);
+  void begin(uint16_t mtu, uint16_t telemetryIntervalMs, uint8_t recordsPerNotification);
+  void poll();
+
+  void onSpeedWrite(std::function<void(float)> handler) { speedHandler = handler; }
+  void onDose(std::function<void(float ml, float speed)> handler) { doseHandler = handler; }
+  void onCalibrationWrite(std::function<void(float)> handler) { calibrationHandler = handler; }
+  void setStateSource(std::function<State()> source) { stateSource = source; }
+
+  bool isConnected() const { return connectedClients > 0; }
+  uint16_t getTelemetryInterval() const { return telemetryInterval; }
+
+private:
+  class ServerCallbacks;
+  class WriteCallbacks;
+
+  static const size_t MAX_BATCH = 32;
+
+  void sampleTelemetry(const State &state);
+  void flushTelemetry();
+  void writeConfigValue();
+
+  const char *deviceName;
+  BLEServer *server = nullptr;
+  BLECharacteristic *speedChar = nullptr;
+  BLECharacteristic *doseChar = nullptr;
+  BLECharacteristic *calibrationChar = nullptr;
+  BLECharacteristic *telemetryChar = nullptr;
+  BLECharacteristic *configChar = nullptr;
+
+  // Latched on the BLE task, consumed in poll()
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  volatile bool speedPending = false;
+  volatile bool dosePending = false;
+  volatile bool calibrationPending = false;
+  volatile bool configPending = false;
+  float pendingSpeed = 0;
+  float pendingDoseML = 0;
+  float pendingDoseSpeed = 0;
+  float pendingCalibration = 0;
+  volatile int connectedClients = 0;
+
+  uint16_t telemetryInterval = 1000;
+  uint8_t maxBatch = 1;
+  unsigned long lastSampleTime = 0;
+  TelemetryRecord batch[MAX_BATCH];
+  size_t batchCount = 0;
+
+  std::function<void(float)> speedHandler;
+  std::function<void(float, float)> doseHandler;
+  std::function<void(float)> calibrationHandler;
+  std::function<State()> stateSource;
+};
+
+#endif
@@ -1,10 +1,17 @@
 #include "BluetoothManager.h"
+#include <Logger.h>
 
-BluetoothManager::BluetoothManager(const char* deviceName) {
+using namespace FrameProtocol;
+
+BluetoothManager::BluetoothManager(const char* deviceName)
+    : _session([this](const uint8_t* data, size_t len) { SerialBT.write(data, len); }) {
   _deviceName = deviceName;
   _connected = false;
+}
+
+void BluetoothManager::begin() {
   SerialBT.begin(_deviceName);  // Initialize Bluetooth with the given name
-  Serial.println("Bluetooth device started, pair with it now.");
+  LOG_INFO("Bluetooth device started, pair with it now");
 }
 
 BluetoothManager::~BluetoothManager() {
@@ -13,22 +20,19 @@ BluetoothManager::~BluetoothManager() {
 
 bool BluetoothManager::connect() {
   // For Bluetooth Classic, "connect" means waiting for a pairing
-  Serial.println("Waiting for Bluetooth pairing...");
+  LOG_INFO("Waiting for Bluetooth pairing...");
   unsigned long startTime = millis();
-  
+
   while (!SerialBT.hasClient() && (millis() - startTime) < TIMEOUT_MS) {
     delay(500);
-    Serial.print(".");
   }
-  
+
   if (SerialBT.hasClient()) {
-    Serial.println("");
-    Serial.println("Bluetooth connected!");
+    LOG_INFO("Bluetooth connected");
     _connected = true;
     return true;
   } else {
-    Serial.println("");
-    Serial.println("Bluetooth connection timed out or failed");
+    LOG_WARN("Bluetooth connection timed out or failed");
     _connected = false;
     return false;
   }
@@ -42,126 +46,93 @@ bool BluetoothManager::isConnected() {
 void BluetoothManager::disconnect() {
   SerialBT.disconnect();
   _connected = false;
-  Serial.println("Bluetooth disconnected");
+  _session.cancelAll();
+  LOG_INFO("Bluetooth disconnected");
 }
 
-bool BluetoothManager::get(const char* path, String& response) {
-  if (!isConnected()) {
-    Serial.println("Cannot perform GET: Not connected to Bluetooth");
-    return false;
+void BluetoothManager::poll() {
+  uint8_t buffer[64];
+  int available;
+  while ((available = SerialBT.available()) > 0) {
+    size_t len = SerialBT.readBytes(buffer, min((size_t)available, sizeof(buffer)));
+    _session.feed(buffer, len);
   }
+  _session.expire(millis());
+}
 
-  Serial.print("GET ");
-  Serial.println(path);
-  SerialBT.print("GET ");
-  SerialBT.println(path);
-
-  unsigned long startTime = millis();
-  response = "";
-  while ((millis() - startTime) < TIMEOUT_MS) {
-    if (SerialBT.available()) {
-      response = SerialBT.readStringUntil('\n');
-      Serial.print("Response: ");
-      Serial.println(response);
-      return true;
-    }
-    delay(10);
+uint8_t BluetoothManager::request(uint8_t method, const char* path, const char* contentType, const char* body, ResponseHandler handler) {
+  if (!isConnected()) {
+    return 0;
   }
-  
-  Serial.println("GET timed out");
-  return false;
+  return _session.request(method, path, contentType, body, millis(), TIMEOUT_MS, handler);
 }
 
-bool BluetoothManager::post(const char* path, const char* contentType, const char* body, String& response) {
+bool BluetoothManager::sendTelemetry(const char* json) {
   if (!isConnected()) {
-    Serial.println("Cannot perform POST: Not connected to Bluetooth");
     return false;
   }
-
-  Serial.print("POST ");
-  Serial.println(path);
-  SerialBT.print("POST ");
-  SerialBT.print(path);
-  SerialBT.print(" ");
-  SerialBT.print(contentType);
-  SerialBT.print(" ");
-  SerialBT.println(body);
-
-  unsigned long startTime = millis();
-  response = "";
-  while ((millis() - startTime) < TIMEOUT_MS) {
-    if (SerialBT.available()) {
-      response = SerialBT.readStringUntil('\n');
-      Serial.print("Response: ");
-      Serial.println(response);
-      return true;
-    }
-    delay(10);
-  }
-  
-  Serial.println("POST timed out");
-  return false;
+  return _session.notify((const uint8_t*)json, strlen(json));
 }
 
-bool BluetoothManager::put(const char* path, const char* contentType, const char* body, String& response) {
+// Issues one request and polls until its response arrives. Other in-flight
+// requests and notifications keep being serviced while we wait.
+bool BluetoothManager::transact(uint8_t method, const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) {
+  static const char* const methodNames[] = {"", "GET", "POST", "PUT", "DELETE"};
+  const char* methodName = methodNames[method];
+
   if (!isConnected()) {
-    Serial.println("Cannot perform PUT: Not connected to Bluetooth");
+    LOG_WARN("Cannot perform %s: not connected to Bluetooth", methodName);
     return false;
   }
 
-  Serial.print("PUT ");
-  Serial.println(path);
-  SerialBT.print("PUT ");
-  SerialBT.print(path);
-  SerialBT.print(" ");
-  SerialBT.print(contentType);
-  SerialBT.print(" ");
-  SerialBT.println(body);
+  LOG_DEBUG("%s %s", methodName, path);
 
-  unsigned long startTime = millis();
+  bool done = false;
+  bool success = false;
   response = "";
-  while ((millis() - startTime) < TIMEOUT_MS) {
-    if (SerialBT.available()) {
-      response = SerialBT.readStringUntil('\n');
-      Serial.print("Response: ");
-      Serial.println(response);
-      return true;
+  uint8_t id = _session.request(method, path, contentType, body, millis(), min((unsigned long)TIMEOUT_MS, limitMs),
+                                [&](bool ok, uint16_t status, const char* responseBody, size_t) {
+                                  done = true;
+                                  success = ok && status > 0 && status < 400;
+                                  response = responseBody;
+                                });
+  if (id == 0) {
+    LOG_WARN("%s %s failed: no free request slot", methodName, path);
+    return false;
+  }
+
+  while (!done) {
+    poll();
+    if (!done) {
+      delay(1);
     }
-    delay(10);
   }
-  
-  Serial.println("PUT timed out");
-  return false;
-}
 
-bool BluetoothManager::del(const char* path, String& response) {
-  if (!isConnected()) {
-    Serial.println("Cannot perform DELETE: Not connected to Bluetooth");
-    return false;
+  if (success) {
+    LOG_DEBUG("%s %s: %s", methodName, path, response.c_str());
+  } else {
+    LOG_WARN("%s %s failed or timed out", methodName, path);
   }
+  return success;
+}
 
-  Serial.print("DELETE ");
-  Serial.println(path);
-  SerialBT.print("DELETE ");
-  SerialBT.println(path);
+bool BluetoothManager::get(const char* path, String& response, unsigned long limitMs) {
+  return transact(REQ_GET, path, "", "", response, limitMs);
+}
 
-  unsigned long startTime = millis();
-  response = "";
-  while ((millis() - startTime) < TIMEOUT_MS) {
-    if (SerialBT.available()) {
-      response = SerialBT.readStringUntil('\n');
-      Serial.print("Response: ");
-      Serial.println(response);
-      return true;
-    }
-    delay(10);
-  }
-  
-  Serial.println("DELETE timed out");
-  return false;
+bool BluetoothManager::post(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) {
+  return transact(REQ_POST, path, contentType, body, response, limitMs);
+}
+
+bool BluetoothManager::put(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) {
+  return transact(REQ_PUT, path, contentType, body, response, limitMs);
+}
+
+bool BluetoothManager::del(const char* path, String& response, unsigned long limitMs) {
+  return transact(REQ_DELETE, path, "", "", response, limitMs);
 }
 
 bool BluetoothManager::checkApiHealth() {
   String response;
-  return get("/api/health", response);
-}
\ No newline at end of file
+  return get("/api/health", response, NO_LIMIT);
+}
@@ -2,29 +2,47 @@
 #define BLUETOOTHMANAGER_H
 
 #include <BluetoothSerial.h>
+#include <FrameProtocol.h>
+#include <Transport.h>
+
+class BluetoothManager : public Transport {
+public:
+  typedef FrameProtocol::FrameSession::ResponseHandler ResponseHandler;
+  typedef FrameProtocol::FrameSession::NotificationHandler NotificationHandler;
 
-class BluetoothManager {
 private:
   BluetoothSerial SerialBT;
   const char* _deviceName;  // Name for the ESP32 Bluetooth device
   bool _connected;
   const int TIMEOUT_MS = 5000;  // 5 seconds timeout for responses
+  FrameProtocol::FrameSession _session;
+
+  bool transact(uint8_t method, const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs);
 
 public:
   BluetoothManager(const char* deviceName = "ESP32_BT");
   ~BluetoothManager();
-  bool connect();
-  bool isConnected();
-  void disconnect();
-  
-  // HTTP-like methods adapted for Bluetooth
-  bool get(const char* path, String& response);
-  bool post(const char* path, const char* contentType, const char* body, String& response);
-  bool put(const char* path, const char* contentType, const char* body, String& response);
-  bool del(const char* path, String& response);
-  
+  void begin();
+  const char* name() const override { return "Bluetooth"; }
+  bool connect() override;
+  bool isConnected() override;
+  void disconnect() override;
+
+  // Non-blocking API: call poll() from loop(), handlers run from inside poll()
+  void poll();
+  uint8_t request(uint8_t method, const char* path, const char* contentType, const char* body, ResponseHandler handler);
+  bool sendTelemetry(const char* json);
+  void onNotification(NotificationHandler handler) { _session.onNotification(handler); }
+  size_t pendingRequests() const { return _session.pendingCount(); }
+
+  // HTTP-like methods adapted for Bluetooth, blocking until the response arrives
+  bool get(const char* path, String& response, unsigned long limitMs) override;
+  bool post(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) override;
+  bool put(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) override;
+  bool del(const char* path, String& response, unsigned long limitMs) override;
+
   // Legacy method
-  bool checkApiHealth();
+  bool checkApiHealth() override;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,62 @@
+#include "BootTimeline.h"
+#include <esp_timer.h>
+#include <esp_system.h>
+
+void BootTimeline::mark(const char *stage)
+{
+  if (stageCount >= MAX_STAGES)
+    return;
+  stages[stageCount].name = stage;
+  stages[stageCount].timeUs = (uint32_t)esp_timer_get_time();
+  stageCount++;
+}
+
+uint32_t BootTimeline::stageTimeUs(const char *stage) const
+{
+  for (size_t i = 0; i < stageCount; i++)
+  {
+    if (strcmp(stages[i].name, stage) == 0)
+      return stages[i].timeUs;
+  }
+  return 0;
+}
+
+void BootTimeline::print(Print &out) const
+{
+  out.print("Boot timeline (reset: ");
+  out.print(resetReason());
+  out.println(")");
+  uint32_t previous = 0;
+  for (size_t i = 0; i < stageCount; i++)
+  {
+    out.printf("  %8.1f ms  +%7.1f ms  %s\n", stages[i].timeUs / 1000.0f, (stages[i].timeUs - previous) / 1000.0f, stages[i].name);
+    previous = stages[i].timeUs;
+  }
+}
+
+const char *BootTimeline::resetReason()
+{
+  switch (esp_reset_reason())
+  {
+  case ESP_RST_POWERON:
+    return "power on";
+  case ESP_RST_EXT:
+    return "external";
+  case ESP_RST_SW:
+    return "software";
+  case ESP_RST_PANIC:
+    return "panic";
+  case ESP_RST_INT_WDT:
+  case ESP_RST_TASK_WDT:
+  case ESP_RST_WDT:
+    return "watchdog";
+  case ESP_RST_DEEPSLEEP:
+    return "deep sleep";
+  case ESP_RST_BROWNOUT:
+    return "brownout";
+  case ESP_RST_SDIO:
+    return "sdio";
+  default:
+    return "unknown";
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+// Timestamps of the boot stages, in microseconds since the app started
+// (esp_timer, so the ROM and second-stage bootloader are not included).
+// Kept after boot so it can be printed or synced to the backend.
+class BootTimeline
+{
+public:
+  static const size_t MAX_STAGES = 16;
+
+  void mark(const char *stage); // stage must outlive the timeline, use literals
+  void markOnce(const char *stage) { if (stageTimeUs(stage) == 0) mark(stage); }
+  size_t count() const { return stageCount; }
+  const char *stage(size_t i) const { return stages[i].name; }
+  uint32_t timeUs(size_t i) const { return stages[i].timeUs; }
+  uint32_t stageTimeUs(const char *stage) const; // 0 if not reached yet
+
+  void print(Print &out) const;
+  static const char *resetReason(); // Why this boot happened, e.g. "brownout"
+
+private:
+  struct Stage
+  {
+    const char *name;
+    uint32_t timeUs;
+  };
+
+  Stage stages[MAX_STAGES];
+  size_t stageCount = 0;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef BUTTON_REPEAT_H
+#define BUTTON_REPEAT_H
+
+// Auto-repeat for a held button: fires once on press, then every
+// SLOW_INTERVAL ms, speeding up to every FAST_INTERVAL ms once the button
+// has been held for FAST_AFTER ms. Pure timing logic, fed with the button
+// state and millis(), so it also runs on the host.
+class ButtonRepeat
+{
+public:
+  static const unsigned long SLOW_INTERVAL = 500;
+  static const unsigned long FAST_INTERVAL = 100;
+  static const unsigned long FAST_AFTER = 2000;
+
+  // Returns true when the button should act on this call
+  bool update(bool pressed, unsigned long now)
+  {
+    if (!pressed)
+    {
+      held = false;
+      return false;
+    }
+    if (!held)
+    {
+      held = true;
+      holdStart = now;
+      lastAction = now;
+      return true;
+    }
+    unsigned long interval = now - holdStart > FAST_AFTER ? FAST_INTERVAL : SLOW_INTERVAL;
+    if (now - lastAction < interval)
+      return false;
+    lastAction = now;
+    return true;
+  }
+
+private:
+  bool held = false;
+  unsigned long holdStart = 0;
+  unsigned long lastAction = 0;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "CalibrationTable.h"
+#include <math.h>
+#include <string.h>
+#include <Fnv1a.h>
+
+#define CALIBRATION_TABLE_MAGIC 0x43414C32 // "CAL2"
+
+void CalibrationTable::clear()
+{
+  count = 0;
+  built = false;
+}
+
+bool CalibrationTable::addPoint(float speed, float stepsPerML)
+{
+  if (!(speed > 0) || !(stepsPerML > 0))
+    return false;
+
+  // Keep the points sorted by speed
+  size_t pos = 0;
+  while (pos < count && points[pos].speed < speed)
+    pos++;
+  if (pos < count && points[pos].speed == speed)
+  {
+    points[pos].stepsPerML = stepsPerML;
+  }
+  else
+  {
+    if (count >= MAX_POINTS)
+      return false;
+    memmove(&points[pos + 1], &points[pos], (count - pos) * sizeof(Point));
+    points[pos].speed = speed;
+    points[pos].stepsPerML = stepsPerML;
+    count++;
+  }
+  built = false;
+  return true;
+}
+
+float CalibrationTable::interpolatePoints(float speed) const
+{
+  if (speed <= points[0].speed)
+    return points[0].stepsPerML;
+  for (size_t i = 1; i < count; i++)
+  {
+    if (speed <= points[i].speed)
+    {
+      float t = (speed - points[i - 1].speed) / (points[i].speed - points[i - 1].speed);
+      return points[i - 1].stepsPerML + t * (points[i].stepsPerML - points[i - 1].stepsPerML);
+    }
+  }
+  return points[count - 1].stepsPerML;
+}
+
+bool CalibrationTable::build(float maxSpeed)
+{
+  built = false;
+  if (count == 0 || !(maxSpeed > 0))
+    return false;
+
+  const float maxValue = (float)(UINT32_MAX >> VALUE_FRACTION_BITS);
+  for (size_t i = 0; i < LUT_SIZE; i++)
+  {
+    float speed = maxSpeed * i / (LUT_SIZE - 1);
+    float value = interpolatePoints(speed);
+    if (value > maxValue)
+      return false;
+    lut[i] = (uint32_t)lroundf(value * (1 << VALUE_FRACTION_BITS));
+  }
+
+  tableMaxSpeed = maxSpeed;
+  positionScale = (uint64_t)llround((LUT_SIZE - 1) * 4294967296.0 / maxSpeed);
+  built = true;
+  return true;
+}
+
+uint32_t CalibrationTable::lookupFixed(uint32_t speed) const
+{
+  uint64_t position = (uint64_t)speed * positionScale;
+  uint64_t index = position >> POSITION_FRACTION_BITS;
+  if (index >= LUT_SIZE - 1)
+    return lut[LUT_SIZE - 1];
+  // Top bits of the fraction are plenty for the interpolation weight
+  int32_t fraction = (int32_t)((uint32_t)position >> (POSITION_FRACTION_BITS - INTERPOLATION_BITS));
+  int32_t delta = (int32_t)(lut[index + 1] - lut[index]);
+  return lut[index] + (int32_t)(((int64_t)delta * fraction) >> INTERPOLATION_BITS);
+}
+
+float CalibrationTable::lookup(float speed) const
+{
+  if (!built)
+    return 0;
+  if (speed <= 0)
+    return lut[0] / (float)(1 << VALUE_FRACTION_BITS);
+  uint32_t speedInt = speed >= tableMaxSpeed ? (uint32_t)tableMaxSpeed : (uint32_t)lroundf(speed);
+  return lookupFixed(speedInt) / (float)(1 << VALUE_FRACTION_BITS);
+}
+
+uint32_t CalibrationTable::checksum(const Stored &stored)
+{
+  // Everything but the checksum itself
+  return fnv1a(&stored, offsetof(Stored, check));
+}
+
+void CalibrationTable::store(Stored &out) const
+{
+  memset(&out, 0, sizeof(out));
+  out.magic = CALIBRATION_TABLE_MAGIC;
+  out.count = count;
+  memcpy(out.points, points, count * sizeof(Point));
+  out.check = checksum(out);
+}
+
+bool CalibrationTable::load(const Stored &in, float maxSpeed)
+{
+  clear();
+  if (in.magic != CALIBRATION_TABLE_MAGIC || in.count > MAX_POINTS || in.check != checksum(in))
+    return false;
+  for (size_t i = 0; i < in.count; i++)
+    addPoint(in.points[i].speed, in.points[i].stepsPerML);
+  return build(maxSpeed);
+}
@@ -0,0 +1,61 @@
+#ifndef CALIBRATION_TABLE_H
+#define CALIBRATION_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Speed-dependent calibration. Measured (speed, stepsPerML) points are joined
+// piecewise-linearly and resampled onto a uniform fixed-point LUT, so a lookup
+// is one multiply, a shift and one interpolation regardless of how many points
+// were measured. Speeds outside the measured range use the nearest point.
+class CalibrationTable
+{
+public:
+  static const size_t MAX_POINTS = 8;
+  static const size_t LUT_SIZE = 33;        // 32 segments
+  static const int VALUE_FRACTION_BITS = 12; // Q20.12 steps/mL
+  static const int POSITION_FRACTION_BITS = 32;
+  static const int INTERPOLATION_BITS = 16;
+
+  struct Point
+  {
+    float speed;      // steps/sec
+    float stepsPerML;
+  };
+
+  // Layout written to EEPROM
+  struct Stored
+  {
+    uint32_t magic;
+    uint32_t count;
+    Point points[MAX_POINTS];
+    uint32_t check;
+  };
+
+  void clear();
+  bool addPoint(float speed, float stepsPerML); // Replaces a point at the same speed
+  bool build(float maxSpeed);                   // Resamples the points into the LUT
+
+  bool isValid() const { return built; }
+  size_t pointCount() const { return count; }
+  const Point &point(size_t i) const { return points[i]; }
+
+  uint32_t lookupFixed(uint32_t speed) const; // Q20.12 steps/mL for an integer speed
+  float lookup(float speed) const;
+
+  void store(Stored &out) const;
+  bool load(const Stored &in, float maxSpeed);
+
+private:
+  float interpolatePoints(float speed) const;
+  static uint32_t checksum(const Stored &stored);
+
+  Point points[MAX_POINTS];
+  size_t count = 0;
+  bool built = false;
+  float tableMaxSpeed = 0;
+  uint64_t positionScale = 0; // LUT positions per step/sec, Q32.32
+  uint32_t lut[LUT_SIZE];
+};
+
+#endif
@@ -1,7 +1,19 @@
 #include "DisplayManager.h"
+#include <driver/i2c.h>
+#include <esp_timer.h>
+#include <TraceRecorder.h>
+
+#define CONTROL_COMMANDS 0x00
+#define CONTROL_DATA 0x40
+// Wire is bus 0; its HAL sits on the IDF driver, which serialises transfers
+#define DISPLAY_I2C_PORT I2C_NUM_0
+#define TRANSFER_TIMEOUT_MS 100
+#define FLUSH_TASK_STACK 3072
+#define FLUSH_TASK_PRIORITY 1
+#define FLUSH_TASK_CORE 0
 
 DisplayManager::DisplayManager()
-    : display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET) {}
+    : display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET, I2C_CLOCK, I2C_CLOCK) {}
 
 DisplayManager &DisplayManager::getInstance()
 {
@@ -9,176 +21,316 @@ DisplayManager &DisplayManager::getInstance()
   return instance;
 }
 
-void DisplayManager::begin()
+void DisplayManager::begin(uint32_t i2cClock)
 {
-  display.begin(SSD1306_SWITCHCAPVCC, 0x3C);
+  display.begin(SSD1306_SWITCHCAPVCC, I2C_ADDRESS);
+  Wire.setClock(i2cClock); // Adafruit only uses its clock for its own transfers
+  frameLock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(flushTaskEntry, "display", FLUSH_TASK_STACK, this, FLUSH_TASK_PRIORITY, &flushTaskHandle, FLUSH_TASK_CORE);
+
+  FrameLock guard(frameLock);
   display.clearDisplay();
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 0);
   display.println(F("Hello OLED!"));
   displaySignalStrength();
-  display.display();
+  markDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  flush();
 }
 
-void DisplayManager::setSignalStrength(int strength)
+void DisplayManager::setSignalBars(int bars)
 {
-  rssi = strength;
+  signalBars = bars;
 }
 
 void DisplayManager::updateStatus(bool pumpEnabled, float mlPerMin)
 {
   if (displaySleeping)
     return;
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println(pumpEnabled ? "Pump Enabled" : "Pump Disabled");
-  display.print("mL/min: ");
-  display.println(mlPerMin, 2);
+  FrameLock guard(frameLock);
+  char text[DisplayScreens::FIELD_TEXT_SIZE];
+  beginTemplate(SCREEN_STATUS, DisplayScreens::drawStatusBackground);
+  DisplayScreens::formatStatusState(text, pumpEnabled);
+  updateField(0, DisplayScreens::STATUS_STATE, text);
+  DisplayScreens::formatStatusRate(text, mlPerMin);
+  updateField(1, DisplayScreens::STATUS_RATE, text);
   displaySignalStrength();
-  display.display();
+  flush();
 }
 
+// Redrawn on every loop() pass while the menu is open, so only a moved
+// cursor costs a frame
 void DisplayManager::showMenu(int menuIndex, const char *menuItems[], int itemCount)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Menu:");
-  for (int i = 0; i < itemCount; i++)
+  FrameLock guard(frameLock);
+  if (shown == SCREEN_MENU && menuIndex == shownMenuIndex)
   {
-    display.print(menuIndex == i ? "> " : "  ");
-    display.println(menuItems[i]);
+    displaySignalStrength();
+    flush();
+    return;
   }
+  beginFullScreen();
+  DisplayScreens::drawMenu(display, menuIndex, menuItems, itemCount);
   displaySignalStrength(); // Will be updated by caller if needed
-  display.display();
+  flush();
+  shown = SCREEN_MENU;
+  shownMenuIndex = menuIndex;
 }
 
+// Stays up until the caller draws something else
 void DisplayManager::showSettingsInfo(int currentSpeed, float stepsPerML, int speedStep)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Settings Info:");
-  display.print("Speed: ");
-  display.println(currentSpeed);
-  display.print("Steps/mL: ");
-  display.println(stepsPerML, 2);
-  display.print("Step Adj: ");
-  display.println(speedStep);
+  FrameLock guard(frameLock);
+  beginFullScreen();
+  DisplayScreens::drawSettingsInfo(display, currentSpeed, stepsPerML, speedStep);
   displaySignalStrength();
-  display.display();
-  delay(5000);
+  flush();
 }
 
 void DisplayManager::showCalibrationStart(int timeLeft)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Calibrating...");
-  display.print("Time left: ");
-  display.print(timeLeft);
-  display.println("s");
+  FrameLock guard(frameLock);
+  char text[DisplayScreens::FIELD_TEXT_SIZE];
+  beginTemplate(SCREEN_CALIBRATION_START, DisplayScreens::drawCalibrationStartBackground);
+  DisplayScreens::formatCalibrationTime(text, timeLeft);
+  updateField(0, DisplayScreens::CALIBRATION_TIME, text);
   displaySignalStrength();
-  display.display();
+  flush();
 }
 
 void DisplayManager::showCalibrationInput(float ml)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Enter mL result:");
-  display.setCursor(0, 20);
-  display.print("mL: ");
-  display.print(ml);
-  display.print("   ");
+  FrameLock guard(frameLock);
+  char text[DisplayScreens::FIELD_TEXT_SIZE];
+  beginTemplate(SCREEN_CALIBRATION_INPUT, DisplayScreens::drawCalibrationInputBackground);
+  DisplayScreens::formatCalibrationMl(text, ml);
+  updateField(0, DisplayScreens::CALIBRATION_ML, text);
   displaySignalStrength();
-  display.display();
+  flush();
 }
 
+// Stays up until the caller draws something else
 void DisplayManager::showCalibrationResult(float stepsPerML, int speedStep)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println("Calibration Done");
-  display.print("Steps/mL: ");
-  display.println(stepsPerML, 2);
-  display.print("Step Adj: ");
-  display.println(speedStep);
+  FrameLock guard(frameLock);
+  beginFullScreen();
+  DisplayScreens::drawCalibrationResult(display, stepsPerML, speedStep);
   displaySignalStrength();
-  display.display();
-  delay(3000);
+  flush();
 }
 
 void DisplayManager::showText(const char *text)
 {
-  display.clearDisplay();
-  display.setCursor(0, 0);
-  display.println(text);
-  displaySignalStrength(); // Caller can update RSSI
-  display.display();
+  FrameLock guard(frameLock);
+  beginFullScreen();
+  DisplayScreens::drawText(display, text);
+  displaySignalStrength(); // Caller can update the bars
+  flush();
 }
 
 void DisplayManager::showText(const std::vector<String> &textArray)
 {
-  display.clearDisplay();
+  FrameLock guard(frameLock);
+  beginFullScreen();
   display.setCursor(0, 0);
   for (size_t i = 0; i < textArray.size(); i++)
   {
     display.println(textArray[i]);
   }
   displaySignalStrength();
-  display.display();
+  flush();
 }
 
+// Sent directly rather than through ssd1306_command(), which resets the
+// bus clock to Adafruit's
 void DisplayManager::sleepDisplay()
 {
-  display.ssd1306_command(SSD1306_DISPLAYOFF);
+  sendCommand(SSD1306_DISPLAYOFF);
   displaySleeping = true;
 }
 
 void DisplayManager::wakeDisplay()
 {
-  display.ssd1306_command(SSD1306_DISPLAYON);
+  sendCommand(SSD1306_DISPLAYON);
   displaySleeping = false;
 }
 
-void DisplayManager::displaySignalStrength()
+void DisplayManager::beginFullScreen()
 {
-  display.setCursor(0, SCREEN_HEIGHT - 8);
-  if (rssi < -50)
-  {
-    drawWiFiSignal(4);
-  }
-  else if (rssi < -60)
-  {
-    drawWiFiSignal(3);
-  }
-  else if (rssi < -70)
-  {
-    drawWiFiSignal(2);
-  }
-  else if (rssi < -80)
+  display.clearDisplay();
+  markDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  shown = SCREEN_OTHER;
+  shownSignalBars = -1;
+}
+
+// Puts the screen's background in the framebuffer, unless it is already
+// there. The background is drawn once, then copied.
+void DisplayManager::beginTemplate(Screen screen, void (*drawBackground)(Adafruit_GFX &))
+{
+  if (shown == screen)
+    return;
+  uint8_t *buffer = display.getBuffer();
+  if (templates[screen] == nullptr)
   {
-    drawWiFiSignal(1);
+    display.clearDisplay();
+    drawBackground(display);
+    templates[screen] = (uint8_t *)malloc(BUFFER_SIZE);
+    if (templates[screen] != nullptr)
+      memcpy(templates[screen], buffer, BUFFER_SIZE);
   }
   else
   {
-    drawWiFiSignal(0);
+    memcpy(buffer, templates[screen], BUFFER_SIZE);
   }
+  markDirty(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  for (size_t i = 0; i < MAX_FIELDS; i++)
+    fieldText[i][0] = '\0'; // Field texts are never empty, so every field redraws
+  shown = screen;
+  shownSignalBars = -1;
 }
 
-void DisplayManager::drawWiFiSignal(int strength)
+void DisplayManager::updateField(size_t slot, const DisplayScreens::Field &field, const char *text)
 {
-  // strength: 0 to 4
-  for (int i = 0; i < 4; i++)
+  if (strcmp(fieldText[slot], text) == 0)
+    return;
+  strlcpy(fieldText[slot], text, sizeof(fieldText[slot]));
+  DisplayScreens::drawField(display, field, text);
+  markDirty(field.x, field.y, field.w, field.h);
+}
+
+void DisplayManager::markDirty(int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  dirtyX0 = min(dirtyX0, x);
+  dirtyY0 = min(dirtyY0, y);
+  dirtyX1 = max(dirtyX1, (int16_t)(x + w - 1));
+  dirtyY1 = max(dirtyY1, (int16_t)(y + h - 1));
+}
+
+// Called with frameLock held. Never waits for the bus.
+void DisplayManager::flush()
+{
+  if (dirtyX0 > dirtyX1 || flushTaskHandle == nullptr)
+    return;
+  xTaskNotifyGive(flushTaskHandle);
+}
+
+DisplayManager::FlushStats DisplayManager::flushStats() const
+{
+  portENTER_CRITICAL(&statsMux);
+  FlushStats copy = stats;
+  portEXIT_CRITICAL(&statsMux);
+  return copy;
+}
+
+void DisplayManager::flushTaskEntry(void *arg)
+{
+  static_cast<DisplayManager *>(arg)->flushTask();
+}
+
+// Each round copies the dirty pages out under the lock, which takes a few
+// microseconds, then sends the copy with the lock released so drawing can
+// go on during the transfer. Notifications that arrive meanwhile coalesce.
+void DisplayManager::flushTask()
+{
+  for (;;)
   {
-    int barHeight = 2;
-    if (i < strength)
-    {
-      display.fillRect(0 + i * 4, SCREEN_HEIGHT - barHeight, 3, barHeight, WHITE);
-    }
-    else
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (;;)
     {
-      display.drawRect(0 + i * 4, SCREEN_HEIGHT - barHeight, 3, barHeight, WHITE);
+      uint8_t firstColumn, lastColumn, firstPage, lastPage;
+      {
+        FrameLock guard(frameLock);
+        if (dirtyX0 > dirtyX1)
+          break;
+        firstColumn = dirtyX0;
+        lastColumn = dirtyX1;
+        firstPage = dirtyY0 / 8;
+        lastPage = dirtyY1 / 8;
+        dirtyX0 = SCREEN_WIDTH;
+        dirtyX1 = -1;
+        dirtyY0 = SCREEN_HEIGHT;
+        dirtyY1 = -1;
+
+        const uint8_t *buffer = display.getBuffer();
+        size_t width = lastColumn - firstColumn + 1;
+        uint8_t *out = transferBuffer;
+        for (uint8_t page = firstPage; page <= lastPage; page++)
+        {
+          memcpy(out, buffer + page * SCREEN_WIDTH + firstColumn, width);
+          out += width;
+        }
+        transferring = true;
+      }
+
+      TRACE_SCOPE(TRACE_DISPLAY_FLUSH);
+      int64_t start = esp_timer_get_time();
+      bool ok = sendWindow(transferBuffer, firstColumn, lastColumn, firstPage, lastPage);
+      uint32_t elapsed = esp_timer_get_time() - start;
+      transferring = false;
+
+      portENTER_CRITICAL(&statsMux);
+      stats.transfers++;
+      stats.bytes += (lastColumn - firstColumn + 1) * (lastPage - firstPage + 1);
+      stats.lastUs = elapsed;
+      if (elapsed > stats.maxUs)
+        stats.maxUs = elapsed;
+      if (!ok)
+        stats.errors++;
+      portEXIT_CRITICAL(&statsMux);
     }
   }
-}
\ No newline at end of file
+}
+
+// Sets the panel's address window and streams the packed pages inside it,
+// as one command link so the driver moves the whole frame without waking
+// this task per chunk. The SSD1306 is in horizontal addressing mode, so the
+// window wraps from one page to the next by itself.
+bool DisplayManager::sendWindow(const uint8_t *pages, uint8_t firstColumn, uint8_t lastColumn, uint8_t firstPage, uint8_t lastPage)
+{
+  const uint8_t window[] = {
+      CONTROL_COMMANDS,
+      SSD1306_PAGEADDR, firstPage, lastPage,
+      SSD1306_COLUMNADDR, firstColumn, lastColumn,
+  };
+  size_t length = (lastColumn - firstColumn + 1) * (lastPage - firstPage + 1);
+
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_write(cmd, window, sizeof(window), true);
+  i2c_master_stop(cmd);
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_write_byte(cmd, CONTROL_DATA, true);
+  i2c_master_write(cmd, pages, length, true);
+  i2c_master_stop(cmd);
+  esp_err_t err = i2c_master_cmd_begin(DISPLAY_I2C_PORT, cmd, pdMS_TO_TICKS(TRANSFER_TIMEOUT_MS));
+  i2c_cmd_link_delete(cmd);
+  return err == ESP_OK;
+}
+
+bool DisplayManager::sendCommand(uint8_t command)
+{
+  const uint8_t bytes[] = {CONTROL_COMMANDS, command};
+  i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+  i2c_master_start(cmd);
+  i2c_master_write_byte(cmd, (I2C_ADDRESS << 1) | I2C_MASTER_WRITE, true);
+  i2c_master_write(cmd, bytes, sizeof(bytes), true);
+  i2c_master_stop(cmd);
+  esp_err_t err = i2c_master_cmd_begin(DISPLAY_I2C_PORT, cmd, pdMS_TO_TICKS(TRANSFER_TIMEOUT_MS));
+  i2c_cmd_link_delete(cmd);
+  return err == ESP_OK;
+}
+
+// Only redrawn when the bar count changes
+void DisplayManager::displaySignalStrength()
+{
+  int bars = signalBars;
+  if (bars == shownSignalBars)
+    return;
+  shownSignalBars = bars;
+  DisplayScreens::drawSignalStrength(display, bars);
+  const DisplayScreens::Field &field = DisplayScreens::SIGNAL;
+  markDirty(field.x, field.y, field.w, field.h);
+}
@@ -4,13 +4,32 @@
 #include <Adafruit_SSD1306.h>
 #include <Wire.h>
 #include <vector>
+#include "DisplayScreens.h"
 
+// Owns the OLED. Screens that update in place (status, calibration countdown
+// and volume entry) start from a background rendered once into a template
+// and copied into the framebuffer, then redraw only the fields whose text
+// changed. Only the pages and columns that changed are sent to the panel.
+//
+// Transfers run on a task on core 0, through the ESP-IDF I2C driver's
+// command link, so drawing returns as soon as the framebuffer is updated.
+// The task copies the changed pages into its own buffer under a short lock
+// and sends that copy; changes drawn meanwhile go out in the next transfer.
 class DisplayManager
 {
 public:
+    struct FlushStats
+    {
+        uint32_t transfers;
+        uint32_t bytes;  // Framebuffer bytes sent
+        uint32_t lastUs; // Duration of the last transfer
+        uint32_t maxUs;
+        uint32_t errors; // Transfers the panel did not acknowledge
+    };
+
     static DisplayManager &getInstance();
-    void begin();
-    void setSignalStrength(int strength);
+    void begin(uint32_t i2cClock = I2C_CLOCK);
+    void setSignalBars(int bars); // Link quality, 0 to 4
     void updateStatus(bool pumpEnabled, float mlPerMin);
     void sleepDisplay();
     void wakeDisplay();
@@ -23,23 +42,85 @@ public:
     void showText(const std::vector<String> &textArray);
 
     bool isSleeping() const { return displaySleeping; }
+    bool isFlushing() const { return transferring; } // A transfer is running
+    FlushStats flushStats() const;
 
     // Display Pins and Settings
     static const int SCREEN_WIDTH = 128;
     static const int SCREEN_HEIGHT = 64;
     static const int OLED_RESET = -1;
+    static const uint8_t I2C_ADDRESS = 0x3C;
+    static const uint32_t I2C_CLOCK = 400000;
 
 private:
+    enum Screen
+    {
+        SCREEN_OTHER, // Drawn whole every time
+        SCREEN_STATUS,
+        SCREEN_CALIBRATION_START,
+        SCREEN_CALIBRATION_INPUT,
+        SCREEN_MENU,
+        SCREEN_COUNT,
+    };
+
+    static const size_t BUFFER_SIZE = SCREEN_WIDTH * SCREEN_HEIGHT / 8;
+    static const size_t MAX_FIELDS = 3;
+
     DisplayManager();
     DisplayManager(const DisplayManager &) = delete;            // Prevent copying
     DisplayManager &operator=(const DisplayManager &) = delete; // Prevent assignment
 
+    void beginFullScreen(); // Before drawing a screen that has no template
+    void beginTemplate(Screen screen, void (*drawBackground)(Adafruit_GFX &));
+    void updateField(size_t slot, const DisplayScreens::Field &field, const char *text);
+    void markDirty(int16_t x, int16_t y, int16_t w, int16_t h);
+    bool sendWindow(const uint8_t *pages, uint8_t firstColumn, uint8_t lastColumn, uint8_t firstPage, uint8_t lastPage);
+    bool sendCommand(uint8_t command);
+    static void flushTaskEntry(void *arg);
+    void flushTask();
+
+    // Held while the framebuffer is drawn into or copied
+    class FrameLock
+    {
+    public:
+        explicit FrameLock(SemaphoreHandle_t lock) : lock(lock)
+        {
+            if (lock != nullptr)
+                xSemaphoreTake(lock, portMAX_DELAY);
+        }
+        ~FrameLock()
+        {
+            if (lock != nullptr)
+                xSemaphoreGive(lock);
+        }
+
+    private:
+        SemaphoreHandle_t lock;
+    };
+
     Adafruit_SSD1306 display;
 
     bool displaySleeping = false;
-    int rssi = 0; 
+    volatile int signalBars = 0;
     void displaySignalStrength();
-    void drawWiFiSignal(int strength);
+    void flush(); // Has the flush task send the changed part of the framebuffer
+
+    Screen shown = SCREEN_OTHER;
+    uint8_t *templates[SCREEN_COUNT] = {}; // Rendered backgrounds, allocated on first use
+    char fieldText[MAX_FIELDS][DisplayScreens::FIELD_TEXT_SIZE]; // What each field of the shown screen says
+    int shownSignalBars = -1;
+    int shownMenuIndex = -1;
+
+    // Changed area not yet sent, in pixels; empty when dirtyX0 > dirtyX1.
+    // Guarded by frameLock.
+    int16_t dirtyX0 = SCREEN_WIDTH, dirtyX1 = -1, dirtyY0 = SCREEN_HEIGHT, dirtyY1 = -1;
+
+    SemaphoreHandle_t frameLock = nullptr;
+    TaskHandle_t flushTaskHandle = nullptr;
+    uint8_t transferBuffer[BUFFER_SIZE]; // The flush task's copy of the changed pages, packed
+    volatile bool transferring = false;
+    mutable portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+    FlushStats stats = {};
 };
 
-#endif
\ No newline at end of file
+#endif
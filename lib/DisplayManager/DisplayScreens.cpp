@@ -0,0 +1,141 @@
+#include "DisplayScreens.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace DisplayScreens
+{
+  static const uint16_t INK = 1; // SSD1306_WHITE
+
+  void drawStatusBackground(Adafruit_GFX &gfx)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Pump ");
+    gfx.print("mL/min: ");
+  }
+
+  void formatStatusState(char *out, bool pumpEnabled)
+  {
+    strcpy(out, pumpEnabled ? "Enabled" : "Disabled");
+  }
+
+  void formatStatusRate(char *out, float mlPerMin)
+  {
+    snprintf(out, FIELD_TEXT_SIZE, "%.2f", mlPerMin);
+  }
+
+  void drawStatus(Adafruit_GFX &gfx, bool pumpEnabled, float mlPerMin)
+  {
+    char text[FIELD_TEXT_SIZE];
+    drawStatusBackground(gfx);
+    formatStatusState(text, pumpEnabled);
+    drawField(gfx, STATUS_STATE, text);
+    formatStatusRate(text, mlPerMin);
+    drawField(gfx, STATUS_RATE, text);
+  }
+
+  void drawMenu(Adafruit_GFX &gfx, int menuIndex, const char *menuItems[], int itemCount)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Menu:");
+    for (int i = 0; i < itemCount; i++)
+    {
+      gfx.print(menuIndex == i ? "> " : "  ");
+      gfx.println(menuItems[i]);
+    }
+  }
+
+  void drawSettingsInfo(Adafruit_GFX &gfx, int currentSpeed, float stepsPerML, int speedStep)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Settings Info:");
+    gfx.print("Speed: ");
+    gfx.println(currentSpeed);
+    gfx.print("Steps/mL: ");
+    gfx.println(stepsPerML, 2);
+    gfx.print("Step Adj: ");
+    gfx.println(speedStep);
+  }
+
+  void drawCalibrationStartBackground(Adafruit_GFX &gfx)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Calibrating...");
+    gfx.print("Time left: ");
+  }
+
+  void formatCalibrationTime(char *out, int timeLeft)
+  {
+    snprintf(out, FIELD_TEXT_SIZE, "%ds", timeLeft);
+  }
+
+  void drawCalibrationStart(Adafruit_GFX &gfx, int timeLeft)
+  {
+    char text[FIELD_TEXT_SIZE];
+    drawCalibrationStartBackground(gfx);
+    formatCalibrationTime(text, timeLeft);
+    drawField(gfx, CALIBRATION_TIME, text);
+  }
+
+  void drawCalibrationInputBackground(Adafruit_GFX &gfx)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Enter mL result:");
+    gfx.setCursor(0, 20);
+    gfx.print("mL: ");
+  }
+
+  void formatCalibrationMl(char *out, float ml)
+  {
+    snprintf(out, FIELD_TEXT_SIZE, "%.2f", ml);
+  }
+
+  void drawCalibrationInput(Adafruit_GFX &gfx, float ml)
+  {
+    char text[FIELD_TEXT_SIZE];
+    drawCalibrationInputBackground(gfx);
+    formatCalibrationMl(text, ml);
+    drawField(gfx, CALIBRATION_ML, text);
+  }
+
+  void drawCalibrationResult(Adafruit_GFX &gfx, float stepsPerML, int speedStep)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println("Calibration Done");
+    gfx.print("Steps/mL: ");
+    gfx.println(stepsPerML, 2);
+    gfx.print("Step Adj: ");
+    gfx.println(speedStep);
+  }
+
+  void drawText(Adafruit_GFX &gfx, const char *text)
+  {
+    gfx.setCursor(0, 0);
+    gfx.println(text);
+  }
+
+  void drawField(Adafruit_GFX &gfx, const Field &field, const char *text)
+  {
+    gfx.fillRect(field.x, field.y, field.w, field.h, 0);
+    gfx.setCursor(field.x, field.y);
+    gfx.print(text);
+  }
+
+  static void drawWiFiSignal(Adafruit_GFX &gfx, int strength)
+  {
+    // strength: 0 to 4
+    const int barHeight = 2;
+    for (int i = 0; i < 4; i++)
+    {
+      if (i < strength)
+        gfx.fillRect(0 + i * 4, gfx.height() - barHeight, 3, barHeight, INK);
+      else
+        gfx.drawRect(0 + i * 4, gfx.height() - barHeight, 3, barHeight, INK);
+    }
+  }
+
+  void drawSignalStrength(Adafruit_GFX &gfx, int bars)
+  {
+    gfx.fillRect(SIGNAL.x, SIGNAL.y, SIGNAL.w, SIGNAL.h, 0);
+    drawWiFiSignal(gfx, bars);
+  }
+}
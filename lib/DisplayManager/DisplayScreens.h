@@ -0,0 +1,49 @@
+#ifndef DISPLAY_SCREENS_H
+#define DISPLAY_SCREENS_H
+
+#include <Adafruit_GFX.h>
+
+// Screen layouts, drawn into any Adafruit_GFX target. DisplayManager draws
+// them into the SSD1306 framebuffer; the host benchmarks into a GFXcanvas1.
+// The caller clears the target first.
+//
+// Screens that update in place are split into a static background and
+// fields. Each field has a fixed rectangle that drawField() clears and
+// prints into, so one value can change without touching the rest.
+namespace DisplayScreens
+{
+  struct Field
+  {
+    int16_t x, y, w, h;
+  };
+
+  // Text size 1: 6 x 8 pixels per character
+  static const Field STATUS_STATE = {30, 0, 48, 8};   // After "Pump "
+  static const Field STATUS_RATE = {48, 8, 80, 8};    // After "mL/min: "
+  static const Field CALIBRATION_TIME = {66, 8, 62, 8}; // After "Time left: "
+  static const Field CALIBRATION_ML = {24, 20, 104, 8}; // After "mL: "
+  static const Field SIGNAL = {0, 56, 16, 8};
+
+  void drawStatusBackground(Adafruit_GFX &gfx);
+  void drawCalibrationStartBackground(Adafruit_GFX &gfx);
+  void drawCalibrationInputBackground(Adafruit_GFX &gfx);
+  void drawField(Adafruit_GFX &gfx, const Field &field, const char *text);
+  // Field texts, out needs FIELD_TEXT_SIZE bytes
+  static const size_t FIELD_TEXT_SIZE = 24;
+  void formatStatusState(char *out, bool pumpEnabled);
+  void formatStatusRate(char *out, float mlPerMin);
+  void formatCalibrationTime(char *out, int timeLeft);
+  void formatCalibrationMl(char *out, float ml);
+
+  // Whole screens
+  void drawStatus(Adafruit_GFX &gfx, bool pumpEnabled, float mlPerMin);
+  void drawMenu(Adafruit_GFX &gfx, int menuIndex, const char *menuItems[], int itemCount);
+  void drawSettingsInfo(Adafruit_GFX &gfx, int currentSpeed, float stepsPerML, int speedStep);
+  void drawCalibrationStart(Adafruit_GFX &gfx, int timeLeft);
+  void drawCalibrationInput(Adafruit_GFX &gfx, float ml);
+  void drawCalibrationResult(Adafruit_GFX &gfx, float stepsPerML, int speedStep);
+  void drawText(Adafruit_GFX &gfx, const char *text);
+  void drawSignalStrength(Adafruit_GFX &gfx, int bars); // Clears and draws the SIGNAL field, bars 0 to 4
+}
+
+#endif
@@ -0,0 +1,312 @@
+#include "DoseScheduler.h"
+#include <EEPROM.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <time.h>
+#include <Fnv1a.h>
+#include <TraceRecorder.h>
+
+#define SCHEDULE_MAGIC 0x53434831 // "SCH1"
+#define SCHEDULER_TASK_STACK 4096
+#define SCHEDULER_TASK_PRIORITY 2 // Above loopTask (1)
+#define SCHEDULER_TASK_CORE 1
+
+static const int64_t TICK_US = DoseScheduler::TICK_MS * 1000LL;
+
+DoseScheduler *DoseScheduler::instance = nullptr;
+
+uint32_t DoseScheduler::checksum(const Stored &stored)
+{
+  return fnv1aRecord(stored);
+}
+
+// Deadlines round up and the current time rounds down, so nothing fires early
+uint32_t DoseScheduler::toTick(int64_t monoUs)
+{
+  return (uint32_t)((monoUs + TICK_US - 1) / TICK_US);
+}
+
+const char *DoseScheduler::outcomeName(Outcome outcome)
+{
+  switch (outcome)
+  {
+  case RUNNING:
+    return "running";
+  case DELIVERED:
+    return "delivered";
+  case STOPPED_EARLY:
+    return "stopped early";
+  case SKIPPED_BUSY:
+    return "skipped, pump busy";
+  case FAILED:
+    return "failed";
+  }
+  return "unknown";
+}
+
+void DoseScheduler::begin(PumpController &pumpController, int eepromAddress, float defaultSpeed)
+{
+  static_assert(sizeof(Stored) == STORAGE_SIZE, "STORAGE_SIZE out of date");
+
+  pump = &pumpController;
+  address = eepromAddress;
+  defaultDoseSpeed = defaultSpeed;
+  instance = this;
+  lock = xSemaphoreCreateMutex();
+
+  Stored stored;
+  EEPROM.get(address, stored);
+  if (stored.magic == SCHEDULE_MAGIC && stored.check == checksum(stored))
+    memcpy(programs, stored.programs, sizeof(programs));
+  for (size_t i = 0; i < MAX_PROGRAMS; i++)
+    timers[i].id = i;
+
+  rearmAll(); // Interval programs start now, daily ones wait for the clock
+  xTaskCreatePinnedToCore(taskEntry, "scheduler", SCHEDULER_TASK_STACK, this, SCHEDULER_TASK_PRIORITY, nullptr, SCHEDULER_TASK_CORE);
+}
+
+void DoseScheduler::startTimeSync(const char *timezone, const char *ntpServer, uint32_t intervalMs)
+{
+  static bool started = false;
+  if (started)
+    return;
+  started = true;
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  sntp_set_sync_interval(intervalMs);
+  configTzTime(timezone, ntpServer);
+}
+
+void DoseScheduler::onTimeSync(struct timeval *tv)
+{
+  int64_t monoUs = esp_timer_get_time();
+  DoseScheduler *self = instance;
+  portENTER_CRITICAL(&self->clockMux);
+  self->clock.sync((int64_t)tv->tv_sec * 1000000 + tv->tv_usec, monoUs);
+  portEXIT_CRITICAL(&self->clockMux);
+  self->resyncPending = true; // Deadlines are re-derived from the new clock on the next tick
+}
+
+WallClock DoseScheduler::clockSnapshot() const
+{
+  portENTER_CRITICAL(&clockMux);
+  WallClock copy = clock;
+  portEXIT_CRITICAL(&clockMux);
+  return copy;
+}
+
+bool DoseScheduler::isTimeSynced() const
+{
+  return clockSnapshot().isSynced();
+}
+
+float DoseScheduler::driftPpm() const
+{
+  return clockSnapshot().driftPpm();
+}
+
+bool DoseScheduler::setPrograms(const Program *list, size_t count)
+{
+  Program next[MAX_PROGRAMS] = {};
+  memcpy(next, list, (count < MAX_PROGRAMS ? count : MAX_PROGRAMS) * sizeof(Program));
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  bool changed = memcmp(next, programs, sizeof(programs)) != 0;
+  if (changed)
+  {
+    memcpy(programs, next, sizeof(programs));
+    rearmAll();
+  }
+  xSemaphoreGive(lock);
+
+  if (changed)
+  {
+    Stored stored;
+    stored.magic = SCHEDULE_MAGIC;
+    memcpy(stored.programs, programs, sizeof(programs));
+    stored.check = checksum(stored);
+    EEPROM.put(address, stored);
+    EEPROM.commit();
+  }
+  return changed;
+}
+
+size_t DoseScheduler::programCount() const
+{
+  size_t count = 0;
+  for (size_t i = 0; i < MAX_PROGRAMS; i++)
+  {
+    if (programs[i].id != 0 && programs[i].enabled)
+      count++;
+  }
+  return count;
+}
+
+void DoseScheduler::rearmAll()
+{
+  int64_t now = esp_timer_get_time();
+  for (size_t i = 0; i < MAX_PROGRAMS; i++)
+    arm(i, now);
+}
+
+// Next local occurrence of secondOfDay strictly after now, DST aware
+static time_t nextDaily(uint32_t secondOfDay, time_t now)
+{
+  struct tm local;
+  localtime_r(&now, &local);
+  for (int day = 0; day < 2; day++)
+  {
+    local.tm_hour = secondOfDay / 3600;
+    local.tm_min = (secondOfDay / 60) % 60;
+    local.tm_sec = secondOfDay % 60;
+    local.tm_isdst = -1;
+    time_t candidate = mktime(&local);
+    if (candidate > now)
+      return candidate;
+    local.tm_mday++;
+  }
+  return now + 86400;
+}
+
+void DoseScheduler::arm(size_t index, int64_t nowMono)
+{
+  Program &program = programs[index];
+  wheel.cancel(timers[index]);
+  scheduledUnix[index] = 0;
+  if (program.id == 0 || !program.enabled || (program.kind == INTERVAL && program.time == 0))
+    return;
+
+  WallClock wall = clockSnapshot();
+  int64_t deadline;
+  if (program.kind == DAILY)
+  {
+    if (!wall.isSynced())
+      return; // Needs the time of day, armed on the first sync
+    time_t next = nextDaily(program.time, (time_t)(wall.unixUs(nowMono) / 1000000));
+    scheduledUnix[index] = next;
+    deadline = wall.monoUs((int64_t)next * 1000000);
+  }
+  else if (program.kind == INTERVAL)
+  {
+    int64_t period = (int64_t)program.time * 1000000;
+    if (wall.isSynced())
+    {
+      int64_t next = (wall.unixUs(nowMono) / period + 1) * period;
+      scheduledUnix[index] = next / 1000000;
+      deadline = wall.monoUs(next);
+    }
+    else
+    {
+      deadline = nowMono + period;
+    }
+  }
+  else
+  {
+    return;
+  }
+  deadlines[index] = deadline;
+  wheel.schedule(timers[index], toTick(deadline));
+}
+
+void DoseScheduler::taskEntry(void *arg)
+{
+  static_cast<DoseScheduler *>(arg)->taskLoop();
+}
+
+void DoseScheduler::taskLoop()
+{
+  TickType_t wake = xTaskGetTickCount();
+  for (;;)
+  {
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(TICK_MS));
+    TRACE_BEGIN(TRACE_SCHEDULER_TICK);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (resyncPending)
+    {
+      resyncPending = false;
+      rearmAll();
+    }
+    wheel.advance((uint32_t)(esp_timer_get_time() / TICK_US), onTimer, this);
+    checkRunningDose();
+    xSemaphoreGive(lock);
+    if (tickHandler)
+      tickHandler();
+    TRACE_END(TRACE_SCHEDULER_TICK);
+  }
+}
+
+void DoseScheduler::onTimer(TimerWheel::Timer &timer, void *context)
+{
+  static_cast<DoseScheduler *>(context)->fire(timer.id);
+}
+
+void DoseScheduler::fire(size_t index)
+{
+  int64_t now = esp_timer_get_time();
+  if (now < deadlines[index])
+  {
+    // Beyond the wheel's range when it was armed, go round again
+    wheel.schedule(timers[index], toTick(deadlines[index]));
+    return;
+  }
+
+  const Program &program = programs[index];
+  uint32_t startSteps = pump->getStepCount();
+  bool started = pump->doseIfIdle(program.ml, program.speed > 0 ? program.speed : defaultDoseSpeed);
+  Outcome outcome = started ? RUNNING : pump->isEnabled() ? SKIPPED_BUSY : FAILED;
+  Execution &execution = record(program.id, outcome, deadlines[index], now, program.ml);
+  execution.scheduledUnix = scheduledUnix[index];
+  if (started)
+  {
+    runningExecution = &execution - executions;
+    runningStartSteps = startSteps;
+    runningStepsPerML = pump->getStepsPerML();
+    if (doseStarted)
+      doseStarted();
+  }
+
+  arm(index, now);
+}
+
+DoseScheduler::Execution &DoseScheduler::record(uint8_t programId, Outcome outcome, int64_t deadlineMono, int64_t nowMono, float ml)
+{
+  size_t slot = nextSeq % HISTORY_SIZE;
+  if ((int)slot == runningExecution)
+    runningExecution = -1; // Overwritten before it finished, stop tracking it
+  Execution &execution = executions[slot];
+  execution.seq = nextSeq++;
+  execution.programId = programId;
+  execution.outcome = outcome;
+  execution.jitterMs = (int32_t)((nowMono - deadlineMono) / 1000);
+  execution.requestedML = ml;
+  execution.deliveredML = 0;
+  if (execution.jitterMs > maxJitter)
+    maxJitter = execution.jitterMs;
+  return execution;
+}
+
+void DoseScheduler::checkRunningDose()
+{
+  if (runningExecution < 0 || pump->isDosing())
+    return;
+  Execution &execution = executions[runningExecution];
+  uint32_t steps = pump->getStepCount() - runningStartSteps;
+  execution.deliveredML = runningStepsPerML > 0 ? steps / runningStepsPerML : 0;
+  execution.outcome = execution.deliveredML >= execution.requestedML * 0.99f ? DELIVERED : STOPPED_EARLY;
+  runningExecution = -1;
+}
+
+size_t DoseScheduler::history(uint32_t afterSeq, Execution *out, size_t maxCount) const
+{
+  size_t count = 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  uint32_t oldest = nextSeq > HISTORY_SIZE ? nextSeq - HISTORY_SIZE : 1;
+  for (uint32_t seq = max(afterSeq + 1, oldest); seq < nextSeq && count < maxCount; seq++)
+  {
+    const Execution &execution = executions[seq % HISTORY_SIZE];
+    if (execution.outcome == RUNNING)
+      break; // Reported once it has finished
+    out[count++] = execution;
+  }
+  xSemaphoreGive(lock);
+  return count;
+}
@@ -0,0 +1,138 @@
+#ifndef DOSE_SCHEDULER_H
+#define DOSE_SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <PumpController.h>
+#include <TimerWheel.h>
+#include <WallClock.h>
+
+// Runs recurring dose programs on the device, so timed doses keep happening
+// when the backend or WiFi is gone. Programs fire either at a local time of
+// day or every N seconds, and live in EEPROM.
+//
+// Deadlines sit in a TimerWheel ticked from a dedicated task that outranks
+// loop(); doses start through PumpController's lock, so a loop() stuck in a
+// network call does not delay them. Fire-time error is bounded by TICK_MS
+// plus however long loop() holds the pump lock (microseconds, or a few ms
+// for a driver UART write). Wall-clock deadlines are converted through a
+// WallClock that is disciplined by SNTP and corrects for crystal drift;
+// every sync re-arms them.
+class DoseScheduler
+{
+public:
+  static const size_t MAX_PROGRAMS = 8;
+  static const size_t HISTORY_SIZE = 16;
+  static const uint32_t TICK_MS = 100;
+
+  enum Kind : uint8_t
+  {
+    DAILY = 1,    // time = seconds after local midnight
+    INTERVAL = 2, // time = period in seconds, aligned to Unix time once synced
+  };
+
+  struct Program
+  {
+    uint8_t id; // 0 marks an unused slot
+    uint8_t kind;
+    uint8_t enabled;
+    uint8_t reserved;
+    uint32_t time;
+    float ml;
+    float speed; // steps/sec, 0 for the default dose speed
+  };
+
+  enum Outcome : uint8_t
+  {
+    RUNNING,
+    DELIVERED,
+    STOPPED_EARLY, // The dose was interrupted, see deliveredML
+    SKIPPED_BUSY,  // The pump was already running
+    FAILED,        // The pump refused the dose, e.g. not calibrated
+  };
+
+  struct Execution
+  {
+    uint32_t seq;
+    uint8_t programId;
+    Outcome outcome;
+    uint32_t scheduledUnix; // 0 if the clock was not synced yet
+    int32_t jitterMs;       // Actual start minus deadline
+    float requestedML;
+    float deliveredML;
+  };
+
+  static const size_t STORAGE_SIZE = 8 + MAX_PROGRAMS * sizeof(Program);
+
+  // Loads the stored programs and starts the scheduler task
+  void begin(PumpController &pump, int eepromAddress, float defaultSpeed);
+  // Starts SNTP, call once the network is up. timezone is a POSIX TZ string.
+  void startTimeSync(const char *timezone, const char *ntpServer, uint32_t intervalMs);
+
+  // Replaces the program list. Persists and re-arms only if it changed.
+  bool setPrograms(const Program *list, size_t count);
+  size_t programCount() const;
+
+  // Called from the scheduler task when a dose starts
+  void onDoseStarted(std::function<void()> handler) { doseStarted = handler; }
+  // Called from the scheduler task after every tick, e.g. as a heartbeat
+  void onTick(std::function<void()> handler) { tickHandler = handler; }
+
+  // Copies executions newer than afterSeq, oldest first. Returns how many.
+  size_t history(uint32_t afterSeq, Execution *out, size_t maxCount) const;
+  static const char *outcomeName(Outcome outcome);
+
+  bool isTimeSynced() const;
+  float driftPpm() const;
+  int32_t maxJitterMs() const { return maxJitter; }
+
+private:
+  struct Stored
+  {
+    uint32_t magic;
+    uint32_t check;
+    Program programs[MAX_PROGRAMS];
+  };
+
+  static void taskEntry(void *arg);
+  static void onTimer(TimerWheel::Timer &timer, void *context);
+  static void onTimeSync(struct timeval *tv);
+  void taskLoop();
+  void fire(size_t index);
+  void arm(size_t index, int64_t nowMono);
+  void rearmAll();
+  void checkRunningDose();
+  Execution &record(uint8_t programId, Outcome outcome, int64_t deadlineMono, int64_t nowMono, float ml);
+  WallClock clockSnapshot() const;
+  static uint32_t checksum(const Stored &stored);
+  static uint32_t toTick(int64_t monoUs);
+
+  PumpController *pump = nullptr;
+  int address = 0;
+  float defaultDoseSpeed = 2000;
+  std::function<void()> doseStarted;
+  std::function<void()> tickHandler;
+
+  // Guarded by lock: programs, wheel, history, running dose
+  SemaphoreHandle_t lock = nullptr;
+  Program programs[MAX_PROGRAMS] = {};
+  TimerWheel::Timer timers[MAX_PROGRAMS];
+  int64_t deadlines[MAX_PROGRAMS] = {}; // Monotonic us each armed program is due at
+  uint32_t scheduledUnix[MAX_PROGRAMS] = {};
+  TimerWheel wheel;
+  Execution executions[HISTORY_SIZE] = {};
+  uint32_t nextSeq = 1;
+  int runningExecution = -1; // Index into executions of the dose in progress
+  uint32_t runningStartSteps = 0;
+  float runningStepsPerML = 0;
+  volatile int32_t maxJitter = 0;
+
+  // Written from the SNTP callback (tcpip task)
+  mutable portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+  WallClock clock;
+  volatile bool resyncPending = false;
+
+  static DoseScheduler *instance; // For the SNTP callback
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "FlowRegulator.h"
+#include <math.h>
+
+static float clampAbs(float value, float limit)
+{
+  return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+void FlowRegulator::configure(const Config &newConfig)
+{
+  config = newConfig;
+  integral = 0;
+  currentTrim = 1;
+  driftSteps = 0;
+  driftPulses = 0;
+  pendingFactor = 0;
+  reset();
+}
+
+void FlowRegulator::reset()
+{
+  started = false;
+  settling = true;
+}
+
+float FlowRegulator::update(uint32_t nowMs, float targetMlPerMin, float stepsPerML, uint32_t steps, uint32_t pulses)
+{
+  if (!(targetMlPerMin > 0) || !(stepsPerML > 0) || !(config.pulsesPerML > 0))
+    return currentTrim;
+  if (!started)
+  {
+    started = true;
+    windowStart = nowMs;
+    windowSteps = steps;
+    windowPulses = pulses;
+    return currentTrim;
+  }
+  uint32_t elapsed = nowMs - windowStart;
+  if (elapsed < config.windowMs)
+    return currentTrim;
+
+  uint32_t stepDelta = steps - windowSteps;
+  uint32_t pulseDelta = pulses - windowPulses;
+
+  // Steps went out but next to nothing flowed past the sensor
+  float expectedPulses = stepDelta / stepsPerML * config.pulsesPerML;
+  fault = pulseDelta < config.minPulses && expectedPulses > FAULT_FACTOR * config.minPulses;
+  if (fault)
+  {
+    integral = 0;
+    currentTrim = 1;
+    measured = 0;
+    driftSteps = 0;
+    driftPulses = 0;
+    started = false;
+    return currentTrim;
+  }
+  if (pulseDelta < config.minPulses && !settling)
+    return currentTrim; // Slow flow, keep counting
+
+  windowStart = nowMs;
+  windowSteps = steps;
+  windowPulses = pulses;
+  if (settling)
+  {
+    settling = false;
+    return currentTrim;
+  }
+
+  float ml = pulseDelta / config.pulsesPerML;
+  measured = ml * 60000.0f / elapsed;
+
+  // PI on the relative error, so the gains hold at any flow rate. The
+  // integral stops at the trim limit instead of winding up past it, and
+  // integrates at most one nominal window per update: slow flows stretch the
+  // windows, and a step of ki * dt past 1 would overshoot every time.
+  float dt = (elapsed < config.windowMs ? elapsed : config.windowMs) / 1000.0f;
+  float error = (targetMlPerMin - measured) / targetMlPerMin;
+  integral = clampAbs(integral + config.ki * error * dt, config.maxTrim);
+  currentTrim = 1 + clampAbs(config.kp * error + integral, config.maxTrim);
+
+  // Drift: steps actually needed per mL against the calibration in use
+  if (stepsPerML != driftStepsPerML)
+  {
+    driftSteps = 0;
+    driftPulses = 0;
+    driftStepsPerML = stepsPerML;
+  }
+  driftSteps += stepDelta;
+  driftPulses += pulseDelta;
+  float driftML = driftPulses / config.pulsesPerML;
+  if (driftML >= config.recalibrateML)
+  {
+    float factor = (driftSteps / driftML) / stepsPerML;
+    float drift = fabsf(factor - 1);
+    if (drift > config.recalibrateError && drift <= config.maxRecalibration)
+      pendingFactor = factor;
+    driftSteps = 0;
+    driftPulses = 0;
+  }
+  return currentTrim;
+}
+
+bool FlowRegulator::takeRecalibration(float &factor)
+{
+  if (pendingFactor == 0)
+    return false;
+  factor = pendingFactor;
+  pendingFactor = 0;
+  recalibrations++;
+
+  // The open-loop rate grows by factor, so the trim that held the flow shrinks by it
+  integral = clampAbs((1 + integral) / factor - 1, config.maxTrim);
+  currentTrim = 1 + integral;
+  reset();
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef FLOW_REGULATOR_H
+#define FLOW_REGULATOR_H
+
+#include <stdint.h>
+
+// Closes the loop around the open-loop speed x stepsPerML flow estimate. Flow
+// is measured from a pulse-output sensor over windows of at least windowMs
+// and minPulses pulses, so slow flows get the same resolution; once per window
+// a PI controller on the relative flow error updates a trim factor that
+// scales the step rate. Over a longer run the same pulses give the tubing's
+// true steps/mL, and a drift beyond a threshold is offered as a
+// recalibration so the open-loop estimate (doses, totalizer) follows the
+// tubing too.
+//
+// Steps worth FAULT_FACTOR windows of pulses without one window's worth
+// arriving is a sensor fault: the trim goes back to 1 rather than winding up
+// against a dead sensor. Drifts beyond
+// maxRecalibration are never applied, a wrong K-factor or failing sensor is
+// likelier than that much wear.
+//
+// Kept free of Arduino headers so it builds on the host.
+class FlowRegulator
+{
+public:
+  struct Config
+  {
+    float pulsesPerML;       // Sensor K-factor
+    float kp;                // Trim per unit of relative flow error
+    float ki;                // Trim per second per unit of relative flow error
+    float maxTrim;           // Largest correction, as a fraction of the rate
+    uint32_t windowMs;       // Shortest measurement window
+    uint32_t minPulses;      // Fewest pulses per window, for resolution at low flow
+    float recalibrateError;  // Relative steps/mL drift that triggers a recalibration
+    float recalibrateML;     // Volume measured for each recalibration check
+    float maxRecalibration;  // Larger drifts are ignored
+  };
+
+  static constexpr float FAULT_FACTOR = 4;
+
+  void configure(const Config &config);
+
+  // Call whenever the setpoint changes or the pump starts or stops. The next
+  // window is discarded while the speed ramp settles. The trim is kept.
+  void reset();
+
+  // Call from loop() while the pump runs, with running counters (both may
+  // wrap). Returns the trim to apply to the step rate, updated once per window.
+  float update(uint32_t nowMs, float targetMlPerMin, float stepsPerML, uint32_t steps, uint32_t pulses);
+
+  float trim() const { return currentTrim; }
+  float measuredMlPerMin() const { return measured; }
+  bool sensorFault() const { return fault; }
+  uint32_t recalibrationCount() const { return recalibrations; }
+
+  // True once per detected drift, with the factor to multiply the
+  // calibration by. The caller must apply it; the trim is rescaled to match.
+  bool takeRecalibration(float &factor);
+
+private:
+  Config config = {};
+  bool started = false;
+  bool settling = true;
+  uint32_t windowStart = 0;
+  uint32_t windowSteps = 0;
+  uint32_t windowPulses = 0;
+  float integral = 0;
+  float currentTrim = 1;
+  float measured = 0;
+  bool fault = false;
+
+  // Recalibration accumulators, across windows
+  uint32_t driftSteps = 0;
+  uint32_t driftPulses = 0;
+  float driftStepsPerML = 0; // Calibration the accumulators were gathered under
+  float pendingFactor = 0;
+  uint32_t recalibrations = 0;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "FlowSensor.h"
+
+#define FLOW_PCNT_UNIT PCNT_UNIT_1
+
+void IRAM_ATTR FlowSensor::onLimit(void *arg)
+{
+  static_cast<FlowSensor *>(arg)->overflows++; // The counter restarts from 0 by itself
+}
+
+bool FlowSensor::begin(int pin)
+{
+  pcnt_config_t counter = {};
+  counter.pulse_gpio_num = pin;
+  counter.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  counter.channel = PCNT_CHANNEL_0;
+  counter.unit = FLOW_PCNT_UNIT;
+  counter.pos_mode = PCNT_COUNT_INC;
+  counter.neg_mode = PCNT_COUNT_DIS;
+  counter.lctrl_mode = PCNT_MODE_KEEP;
+  counter.hctrl_mode = PCNT_MODE_KEEP;
+  counter.counter_h_lim = PCNT_LIMIT;
+  counter.counter_l_lim = -1;
+  if (pcnt_unit_config(&counter) != ESP_OK)
+    return false;
+  pcnt_set_filter_value(FLOW_PCNT_UNIT, FILTER_TICKS);
+  pcnt_filter_enable(FLOW_PCNT_UNIT);
+  pcnt_event_enable(FLOW_PCNT_UNIT, PCNT_EVT_H_LIM);
+  pcnt_isr_service_install(0); // Already installed is fine
+  pcnt_isr_handler_add(FLOW_PCNT_UNIT, onLimit, this);
+  pcnt_counter_pause(FLOW_PCNT_UNIT);
+  pcnt_counter_clear(FLOW_PCNT_UNIT);
+  pcnt_counter_resume(FLOW_PCNT_UNIT);
+  started = true;
+  return true;
+}
+
+// The counter can wrap to 0 just before its interrupt runs; a total that
+// went backwards is that window, and the last good total stands in for it
+uint32_t FlowSensor::pulses()
+{
+  if (!started)
+    return 0;
+  uint32_t before, after;
+  int16_t value = 0;
+  do
+  {
+    before = overflows;
+    pcnt_get_counter_value(FLOW_PCNT_UNIT, &value);
+    after = overflows;
+  } while (before != after);
+  uint32_t count = before * PCNT_LIMIT + value;
+  if ((int32_t)(count - lastCount) < 0)
+    return lastCount;
+  lastCount = count;
+  return count;
+}
@@ -0,0 +1,30 @@
+#ifndef FLOW_SENSOR_H
+#define FLOW_SENSOR_H
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+
+// Pulse-output flow sensor counted by a PCNT unit, so pulses cost no CPU
+// time. The 16-bit hardware counter is extended in software by an interrupt
+// every PCNT_LIMIT pulses; reading the count is a register read.
+//
+// Uses PCNT unit 1; StepSelfTest has unit 0.
+class FlowSensor
+{
+public:
+  bool begin(int pin);
+  uint32_t pulses(); // Since begin(), wraps
+  bool isStarted() const { return started; }
+
+private:
+  static void onLimit(void *arg);
+
+  static const int16_t PCNT_LIMIT = 30000;
+  static const uint16_t FILTER_TICKS = 1023; // APB cycles, ~12.8 us: rejects contact bounce and EMI
+
+  volatile uint32_t overflows = 0;
+  uint32_t lastCount = 0;
+  bool started = false;
+};
+
+#endif
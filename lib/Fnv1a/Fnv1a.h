@@ -0,0 +1,34 @@
+#ifndef FNV1A_H
+#define FNV1A_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// FNV-1a, the checksum on the records kept in EEPROM and RTC memory. Pass
+// the previous result as hash to carry on over more bytes.
+//
+// Kept free of Arduino headers so it builds on the host.
+static const uint32_t FNV1A_OFFSET_BASIS = 2166136261u;
+
+inline uint32_t fnv1a(const void *data, size_t length, uint32_t hash = FNV1A_OFFSET_BASIS)
+{
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+// Checksum of a record with its check field hashed as zeros, so the record
+// is neither copied nor modified
+template <typename Record>
+uint32_t fnv1aRecord(const Record &record)
+{
+  static const uint8_t zero[sizeof(Record::check)] = {};
+  const uint8_t *bytes = (const uint8_t *)&record;
+  size_t at = (const uint8_t *)&record.check - bytes;
+  uint32_t hash = fnv1a(bytes, at);
+  hash = fnv1a(zero, sizeof(zero), hash);
+  return fnv1a(bytes + at + sizeof(zero), sizeof(Record) - at - sizeof(zero), hash);
+}
+
+#endif
@@ -0,0 +1,300 @@
+#include "FrameProtocol.h"
+#include <string.h>
+
+namespace FrameProtocol
+{
+  uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      crc ^= (uint16_t)data[i] << 8;
+      for (int bit = 0; bit < 8; bit++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+  }
+
+  // FrameWriter
+
+  void FrameWriter::begin(uint8_t type, uint8_t id)
+  {
+    buffer[0] = SYNC_0;
+    buffer[1] = SYNC_1;
+    buffer[2] = type;
+    buffer[3] = id;
+    length = HEADER_SIZE;
+    overflow = false;
+  }
+
+  bool FrameWriter::append(const void *data, size_t len)
+  {
+    if (length + len > HEADER_SIZE + MAX_PAYLOAD)
+    {
+      overflow = true;
+      return false;
+    }
+    memcpy(buffer + length, data, len);
+    length += len;
+    return true;
+  }
+
+  bool FrameWriter::appendString(const char *str, bool terminate)
+  {
+    if (str == nullptr)
+      str = "";
+    return append(str, strlen(str) + (terminate ? 1 : 0));
+  }
+
+  size_t FrameWriter::finish()
+  {
+    if (overflow)
+      return 0;
+    uint16_t payloadLen = length - HEADER_SIZE;
+    buffer[4] = payloadLen & 0xFF;
+    buffer[5] = payloadLen >> 8;
+    uint16_t crc = crc16(buffer + 2, length - 2);
+    buffer[length++] = crc & 0xFF;
+    buffer[length++] = crc >> 8;
+    return length;
+  }
+
+  // FrameDecoder
+
+  bool FrameDecoder::feed(uint8_t byte)
+  {
+    switch (state)
+    {
+    case WAIT_SYNC_0:
+      if (byte == SYNC_0)
+        state = WAIT_SYNC_1;
+      return false;
+
+    case WAIT_SYNC_1:
+      if (byte == SYNC_1)
+      {
+        state = READ_HEADER;
+        pos = 0;
+      }
+      else if (byte != SYNC_0)
+      {
+        state = WAIT_SYNC_0;
+      }
+      return false;
+
+    case READ_HEADER:
+      buffer[pos++] = byte;
+      if (pos == 4)
+      {
+        payloadLen = buffer[2] | (buffer[3] << 8);
+        if (payloadLen > MAX_PAYLOAD)
+        {
+          oversizeCount++;
+          state = WAIT_SYNC_0;
+          return false;
+        }
+        crcPos = 0;
+        state = payloadLen > 0 ? READ_PAYLOAD : READ_CRC;
+      }
+      return false;
+
+    case READ_PAYLOAD:
+      buffer[pos++] = byte;
+      if (pos == 4 + (size_t)payloadLen)
+        state = READ_CRC;
+      return false;
+
+    case READ_CRC:
+      crcBytes[crcPos++] = byte;
+      if (crcPos < CRC_SIZE)
+        return false;
+      state = WAIT_SYNC_0;
+      if (crc16(buffer, 4 + payloadLen) != (uint16_t)(crcBytes[0] | (crcBytes[1] << 8)))
+      {
+        crcErrorCount++;
+        return false;
+      }
+      buffer[4 + payloadLen] = '\0';
+      return true;
+    }
+    return false;
+  }
+
+  // FrameSession
+
+  uint8_t FrameSession::nextId()
+  {
+    for (int attempt = 0; attempt < 255; attempt++)
+    {
+      lastId = lastId == 255 ? 1 : lastId + 1;
+      bool inUse = false;
+      for (size_t i = 0; i < MAX_PENDING; i++)
+      {
+        if (pending[i].id == lastId)
+        {
+          inUse = true;
+          break;
+        }
+      }
+      if (!inUse)
+        return lastId;
+    }
+    return 0;
+  }
+
+  uint8_t FrameSession::request(uint8_t method, const char *path, const char *contentType, const char *body,
+                                uint32_t nowMs, uint32_t timeoutMs, ResponseHandler handler)
+  {
+    Pending *slot = nullptr;
+    for (size_t i = 0; i < MAX_PENDING; i++)
+    {
+      if (pending[i].id == 0)
+      {
+        slot = &pending[i];
+        break;
+      }
+    }
+    if (slot == nullptr)
+      return 0;
+
+    uint8_t id = nextId();
+    if (id == 0)
+      return 0;
+
+    // Payload: path \0 contentType \0 body
+    tx.begin(method, id);
+    tx.appendString(path, true);
+    tx.appendString(contentType, true);
+    tx.appendString(body, false);
+    size_t len = tx.finish();
+    if (len == 0)
+      return 0;
+
+    slot->id = id;
+    slot->deadline = nowMs + timeoutMs;
+    slot->handler = handler;
+    writer(tx.data(), len);
+    return id;
+  }
+
+  bool FrameSession::respond(uint8_t id, uint16_t status, const char *body, size_t len)
+  {
+    uint8_t statusBytes[2] = {(uint8_t)(status & 0xFF), (uint8_t)(status >> 8)};
+    tx.begin(RESPONSE, id);
+    tx.append(statusBytes, sizeof(statusBytes));
+    tx.append(body, len);
+    size_t frameLen = tx.finish();
+    if (frameLen == 0)
+      return false;
+    writer(tx.data(), frameLen);
+    return true;
+  }
+
+  bool FrameSession::notify(const uint8_t *payload, size_t len)
+  {
+    tx.begin(NOTIFY, 0);
+    tx.append(payload, len);
+    size_t frameLen = tx.finish();
+    if (frameLen == 0)
+      return false;
+    writer(tx.data(), frameLen);
+    return true;
+  }
+
+  void FrameSession::feed(const uint8_t *data, size_t len)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (rx.feed(data[i]))
+        dispatch();
+    }
+  }
+
+  void FrameSession::dispatch()
+  {
+    const uint8_t *payload = rx.payload();
+    size_t len = rx.payloadLength();
+
+    switch (rx.type())
+    {
+    case RESPONSE:
+    {
+      for (size_t i = 0; i < MAX_PENDING; i++)
+      {
+        if (pending[i].id != rx.id())
+          continue;
+        // Free the slot before calling out so the handler may issue a new request
+        ResponseHandler handler = pending[i].handler;
+        pending[i].id = 0;
+        pending[i].handler = nullptr;
+        uint16_t status = len >= 2 ? payload[0] | (payload[1] << 8) : 0;
+        if (handler)
+          handler(true, status, len >= 2 ? (const char *)payload + 2 : "", len >= 2 ? len - 2 : 0);
+        return;
+      }
+      unmatchedCount++;
+      return;
+    }
+
+    case NOTIFY:
+      if (notificationHandler)
+        notificationHandler(payload, len);
+      return;
+
+    case REQ_GET:
+    case REQ_POST:
+    case REQ_PUT:
+    case REQ_DELETE:
+    {
+      if (!requestHandler)
+        return;
+      const char *path = (const char *)payload;
+      size_t pathLen = strnlen(path, len);
+      const char *contentType = pathLen < len ? path + pathLen + 1 : "";
+      size_t typeLen = pathLen < len ? strnlen(contentType, len - pathLen - 1) : 0;
+      const char *body = pathLen + typeLen + 2 <= len ? contentType + typeLen + 1 : "";
+      requestHandler(rx.id(), rx.type(), path, contentType, body);
+      return;
+    }
+    }
+  }
+
+  void FrameSession::expire(uint32_t nowMs)
+  {
+    for (size_t i = 0; i < MAX_PENDING; i++)
+    {
+      if (pending[i].id == 0 || (int32_t)(nowMs - pending[i].deadline) < 0)
+        continue;
+      ResponseHandler handler = pending[i].handler;
+      pending[i].id = 0;
+      pending[i].handler = nullptr;
+      timeoutCount++;
+      if (handler)
+        handler(false, 0, "", 0);
+    }
+  }
+
+  void FrameSession::cancelAll()
+  {
+    for (size_t i = 0; i < MAX_PENDING; i++)
+    {
+      if (pending[i].id == 0)
+        continue;
+      ResponseHandler handler = pending[i].handler;
+      pending[i].id = 0;
+      pending[i].handler = nullptr;
+      if (handler)
+        handler(false, 0, "", 0);
+    }
+  }
+
+  size_t FrameSession::pendingCount() const
+  {
+    size_t count = 0;
+    for (size_t i = 0; i < MAX_PENDING; i++)
+    {
+      if (pending[i].id != 0)
+        count++;
+    }
+    return count;
+  }
+}
@@ -0,0 +1,143 @@
+#ifndef FRAME_PROTOCOL_H
+#define FRAME_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// Binary framing used on the Bluetooth link. Kept free of Arduino headers so the
+// same code runs on the host test peer (tools/frame_peer).
+//
+// Frame layout (little endian):
+//   0xA5 0x5A | type | id | len (2) | payload (len) | crc16 (2)
+// The CRC is CRC-16/CCITT-FALSE over type, id, len and payload.
+namespace FrameProtocol
+{
+  const uint8_t SYNC_0 = 0xA5;
+  const uint8_t SYNC_1 = 0x5A;
+  const size_t HEADER_SIZE = 6;
+  const size_t CRC_SIZE = 2;
+  const size_t MAX_PAYLOAD = 512;
+  const size_t MAX_FRAME = HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE;
+
+  enum FrameType : uint8_t
+  {
+    REQ_GET = 0x01,
+    REQ_POST = 0x02,
+    REQ_PUT = 0x03,
+    REQ_DELETE = 0x04,
+    RESPONSE = 0x10,
+    NOTIFY = 0x20,
+  };
+
+  uint16_t crc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+  // Builds a single frame in an internal buffer.
+  class FrameWriter
+  {
+  public:
+    void begin(uint8_t type, uint8_t id);
+    bool append(const void *data, size_t len);
+    bool appendString(const char *str, bool terminate);
+    size_t finish(); // Returns total frame size, 0 on overflow
+    const uint8_t *data() const { return buffer; }
+
+  private:
+    uint8_t buffer[MAX_FRAME];
+    size_t length = 0;
+    bool overflow = false;
+  };
+
+  // Incremental decoder, fed one byte at a time from the link.
+  class FrameDecoder
+  {
+  public:
+    bool feed(uint8_t byte); // Returns true once a valid frame is complete
+    void reset() { state = WAIT_SYNC_0; }
+
+    uint8_t type() const { return buffer[0]; }
+    uint8_t id() const { return buffer[1]; }
+    uint16_t payloadLength() const { return payloadLen; }
+    const uint8_t *payload() const { return buffer + 4; } // NUL terminated
+
+    uint32_t crcErrors() const { return crcErrorCount; }
+    uint32_t oversizeErrors() const { return oversizeCount; }
+
+  private:
+    enum State
+    {
+      WAIT_SYNC_0,
+      WAIT_SYNC_1,
+      READ_HEADER,
+      READ_PAYLOAD,
+      READ_CRC,
+    };
+
+    State state = WAIT_SYNC_0;
+    uint8_t buffer[4 + MAX_PAYLOAD + 1]; // type, id, len, payload, NUL
+    size_t pos = 0;
+    uint16_t payloadLen = 0;
+    uint8_t crcBytes[CRC_SIZE];
+    size_t crcPos = 0;
+    uint32_t crcErrorCount = 0;
+    uint32_t oversizeCount = 0;
+  };
+
+  // Request/response bookkeeping on top of the codec. Several requests can be
+  // in flight at once; responses are matched by id in whatever order they come.
+  class FrameSession
+  {
+  public:
+    static const size_t MAX_PENDING = 8;
+
+    typedef std::function<void(const uint8_t *data, size_t len)> Writer;
+    // ok is false on timeout; status is the peer's HTTP-style status code
+    typedef std::function<void(bool ok, uint16_t status, const char *body, size_t len)> ResponseHandler;
+    typedef std::function<void(const uint8_t *payload, size_t len)> NotificationHandler;
+    // Peer side: called for incoming requests, answer with respond()
+    typedef std::function<void(uint8_t id, uint8_t method, const char *path, const char *contentType, const char *body)> RequestHandler;
+
+    explicit FrameSession(Writer writer) : writer(writer) {}
+
+    // Returns the request id, or 0 if all slots are busy or the frame is too big
+    uint8_t request(uint8_t method, const char *path, const char *contentType, const char *body,
+                    uint32_t nowMs, uint32_t timeoutMs, ResponseHandler handler);
+    bool respond(uint8_t id, uint16_t status, const char *body, size_t len);
+    bool notify(const uint8_t *payload, size_t len);
+
+    void feed(const uint8_t *data, size_t len);
+    void expire(uint32_t nowMs);
+    void cancelAll();
+
+    void onNotification(NotificationHandler handler) { notificationHandler = handler; }
+    void onRequest(RequestHandler handler) { requestHandler = handler; }
+
+    size_t pendingCount() const;
+    uint32_t timeouts() const { return timeoutCount; }
+    uint32_t unmatchedResponses() const { return unmatchedCount; }
+    const FrameDecoder &decoder() const { return rx; }
+
+  private:
+    struct Pending
+    {
+      uint8_t id = 0; // 0 = free slot
+      uint32_t deadline = 0;
+      ResponseHandler handler;
+    };
+
+    void dispatch();
+    uint8_t nextId();
+
+    Writer writer;
+    FrameWriter tx;
+    FrameDecoder rx;
+    Pending pending[MAX_PENDING];
+    uint8_t lastId = 0;
+    uint32_t timeoutCount = 0;
+    uint32_t unmatchedCount = 0;
+    NotificationHandler notificationHandler;
+    RequestHandler requestHandler;
+  };
+}
+
+#endif
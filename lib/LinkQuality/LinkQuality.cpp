@@ -0,0 +1,100 @@
+#include "LinkQuality.h"
+
+// RSSI that maps to a signal score of 0 and 1
+#define RSSI_UNUSABLE -90.0f
+#define RSSI_EXCELLENT -55.0f
+// Request latency that maps to a latency score of 1 and 0
+#define LATENCY_GOOD_MS 200.0f
+#define LATENCY_POOR_MS 2000.0f
+#define SIGNAL_WEIGHT 0.6f // Latency gets the rest
+#define RSSI_SMOOTHING 0.2f
+#define SUCCESS_SMOOTHING 0.2f
+#define LATENCY_SMOOTHING 0.25f
+#define MAX_BACKOFF_SHIFT 6
+
+static float clamp01(float value)
+{
+  return value < 0 ? 0 : (value > 1 ? 1 : value);
+}
+
+void LinkQuality::addSignal(int rssi)
+{
+  smoothedRssi = signalSamples == 0 ? rssi : smoothedRssi + RSSI_SMOOTHING * (rssi - smoothedRssi);
+  signalSamples++;
+}
+
+void LinkQuality::addRequest(bool ok, unsigned long latencyMs)
+{
+  smoothedSuccess += SUCCESS_SMOOTHING * ((ok ? 1.0f : 0.0f) - smoothedSuccess);
+  // A failed request's latency is mostly the timeout, which says nothing new
+  if (ok)
+    smoothedLatency = requestSamples == 0 ? latencyMs : smoothedLatency + LATENCY_SMOOTHING * (latencyMs - smoothedLatency);
+  requestSamples++;
+}
+
+void LinkQuality::connectFailed()
+{
+  if (failures < 255)
+    failures++;
+}
+
+void LinkQuality::connected()
+{
+  failures = 0;
+}
+
+// Success rate scales the whole score: a link that drops every request is
+// useless however strong the signal
+float LinkQuality::score() const
+{
+  float signal = clamp01((smoothedRssi - RSSI_UNUSABLE) / (RSSI_EXCELLENT - RSSI_UNUSABLE));
+  float latency = clamp01((LATENCY_POOR_MS - smoothedLatency) / (LATENCY_POOR_MS - LATENCY_GOOD_MS));
+  float health;
+  if (signalSamples > 0 && requestSamples > 0)
+    health = SIGNAL_WEIGHT * signal + (1 - SIGNAL_WEIGHT) * latency;
+  else if (signalSamples > 0)
+    health = signal;
+  else if (requestSamples > 0)
+    health = latency;
+  else
+    health = 1;
+  return smoothedSuccess * health;
+}
+
+uint8_t LinkQuality::percent() const
+{
+  return (uint8_t)(score() * 100 + 0.5f);
+}
+
+uint8_t LinkQuality::bars() const
+{
+  uint8_t p = percent();
+  if (p >= 80)
+    return 4;
+  if (p >= 55)
+    return 3;
+  if (p >= 30)
+    return 2;
+  if (p >= 10)
+    return 1;
+  return 0;
+}
+
+unsigned long LinkQuality::syncInterval(unsigned long baseMs) const
+{
+  return baseMs + (unsigned long)(baseMs * (SLOWDOWN - 1) * (1 - score()));
+}
+
+size_t LinkQuality::batchSize(size_t maxBatch) const
+{
+  if (maxBatch <= 1)
+    return maxBatch;
+  return 1 + (size_t)((maxBatch - 1) * score() + 0.5f);
+}
+
+unsigned long LinkQuality::reconnectDelay(unsigned long baseMs, unsigned long maxMs) const
+{
+  uint8_t shift = failures < MAX_BACKOFF_SHIFT ? failures : MAX_BACKOFF_SHIFT;
+  float delayMs = (float)(baseMs << shift) * (2 - score());
+  return delayMs < maxMs ? (unsigned long)delayMs : maxMs;
+}
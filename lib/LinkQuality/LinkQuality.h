@@ -0,0 +1,48 @@
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+#include <Arduino.h>
+
+// Estimates how usable a network link is from smoothed RSSI, request success
+// rate and request latency, and derives how hard the firmware should push
+// it: how often to sync, how much to send per request and how long to wait
+// before reconnecting. A weak link gets fewer, smaller requests and a longer
+// reconnect backoff instead of a steady stream of timeouts.
+class LinkQuality
+{
+public:
+  void addSignal(int rssi); // dBm
+  void addRequest(bool ok, unsigned long latencyMs);
+  void connectFailed(); // A connection attempt timed out
+  void connected();
+
+  uint8_t percent() const; // 0 (unusable) to 100, 100 until measured
+  uint8_t bars() const;    // 0 to 4, for the display
+
+  bool hasSignal() const { return signalSamples > 0; }
+  float rssi() const { return smoothedRssi; }
+  float successRate() const { return smoothedSuccess; } // 0 to 1
+  float latencyMs() const { return smoothedLatency; }
+  uint8_t connectFailures() const { return failures; }
+
+  // baseMs on a perfect link, up to SLOWDOWN times that on an unusable one
+  unsigned long syncInterval(unsigned long baseMs) const;
+  // Between 1 and maxBatch items per request
+  size_t batchSize(size_t maxBatch) const;
+  // Doubles with each failed attempt, longer still when the link was weak
+  unsigned long reconnectDelay(unsigned long baseMs, unsigned long maxMs) const;
+
+  static const uint8_t SLOWDOWN = 4;
+
+private:
+  float score() const; // 0 to 1
+
+  float smoothedRssi = 0;
+  float smoothedSuccess = 1;
+  float smoothedLatency = 0;
+  uint32_t signalSamples = 0;
+  uint32_t requestSamples = 0;
+  uint8_t failures = 0;
+};
+
+#endif
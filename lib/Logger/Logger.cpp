@@ -0,0 +1,113 @@
+#include "Logger.h"
+#include <stdarg.h>
+
+#define DRAIN_TASK_STACK 3072
+#define DRAIN_TASK_PRIORITY 1 // With loopTask, but on the other core
+#define DRAIN_TASK_CORE 0
+#define DRAIN_IDLE_MS 100
+
+// Bounded multi-producer queue (Vyukov). A slot whose sequence equals the
+// enqueue position is free for that position; the producer that wins the
+// compare-and-swap on enqueuePos fills it and publishes it by setting
+// sequence to position + 1. The drain task empties it and hands it to the
+// next lap with position + SLOTS. Sequences are stored minus the slot index,
+// so the zero-initialized array is already valid before any constructor runs.
+Logger::Slot Logger::slots[SLOTS];
+uint32_t Logger::enqueuePos = 0;
+uint32_t Logger::dequeuePos = 0;
+uint32_t Logger::droppedCount = 0;
+Print *Logger::output = nullptr;
+TaskHandle_t Logger::task = nullptr;
+
+static_assert((Logger::SLOTS & (Logger::SLOTS - 1)) == 0, "Logger::SLOTS must be a power of two");
+
+static const char LEVEL_LETTERS[] = {'-', 'E', 'W', 'I', 'D'};
+
+void Logger::begin(Print &out)
+{
+  output = &out;
+  if (task == nullptr)
+    xTaskCreatePinnedToCore(taskEntry, "log", DRAIN_TASK_STACK, nullptr, DRAIN_TASK_PRIORITY, &task, DRAIN_TASK_CORE);
+}
+
+void Logger::write(uint8_t level, const char *format, ...)
+{
+  uint32_t pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+  Slot *slot;
+  for (;;)
+  {
+    slot = &slots[pos & (SLOTS - 1)];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) + (pos & (SLOTS - 1));
+    int32_t diff = (int32_t)(sequence - pos);
+    if (diff == 0)
+    {
+      if (__atomic_compare_exchange_n(&enqueuePos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    }
+    else if (diff < 0)
+    {
+      __atomic_fetch_add(&droppedCount, 1, __ATOMIC_RELAXED); // Full
+      return;
+    }
+    else
+    {
+      pos = __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED);
+    }
+  }
+
+  slot->timeMs = millis();
+  slot->level = level;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(slot->text, MESSAGE_SIZE, format, args);
+  va_end(args);
+  __atomic_store_n(&slot->sequence, pos + 1 - (pos & (SLOTS - 1)), __ATOMIC_RELEASE);
+
+  if (task != nullptr)
+    xTaskNotifyGive(task);
+}
+
+bool Logger::drainOne(Print &out)
+{
+  uint32_t index = dequeuePos & (SLOTS - 1);
+  Slot &slot = slots[index];
+  if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) + index != dequeuePos + 1)
+    return false;
+  out.printf("[%8lu] %c ", (unsigned long)slot.timeMs, LEVEL_LETTERS[slot.level < sizeof(LEVEL_LETTERS) ? slot.level : 0]);
+  out.println(slot.text);
+  __atomic_store_n(&slot.sequence, dequeuePos + SLOTS - index, __ATOMIC_RELEASE);
+  dequeuePos++;
+  return true;
+}
+
+void Logger::taskEntry(void *)
+{
+  uint32_t reportedDrops = 0;
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(DRAIN_IDLE_MS));
+    while (drainOne(*output))
+    {
+    }
+    uint32_t drops = dropped();
+    if (drops != reportedDrops)
+    {
+      output->printf("[log] %lu messages dropped\n", (unsigned long)(drops - reportedDrops));
+      reportedDrops = drops;
+    }
+  }
+}
+
+void Logger::flush(uint32_t timeoutMs)
+{
+  uint32_t start = millis();
+  while (millis() - start < timeoutMs && __atomic_load_n(&dequeuePos, __ATOMIC_RELAXED) != __atomic_load_n(&enqueuePos, __ATOMIC_RELAXED))
+    delay(1);
+  if (output != nullptr)
+    output->flush();
+}
+
+uint32_t Logger::dropped()
+{
+  return __atomic_load_n(&droppedCount, __ATOMIC_RELAXED);
+}
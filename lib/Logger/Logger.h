@@ -0,0 +1,82 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+
+// Leveled logging that never waits on the UART. At 115200 baud every
+// character costs ~87 us, so printing a response body straight to Serial
+// stalls loop() for tens of ms.
+//
+// LOG_* formats the message into a slot of a bounded lock-free queue and
+// returns; a low-priority task on core 0 writes the queue out. Any task may
+// log, interrupts may not. A message that finds the queue full is dropped and
+// counted, and the drain task reports the count once there is room again.
+// Messages longer than a slot are cut short.
+//
+// Levels above LOG_LEVEL (a build flag, INFO by default) compile to nothing,
+// arguments included.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+class Logger
+{
+public:
+  static const size_t SLOTS = 32; // Power of two
+  static const size_t MESSAGE_SIZE = 120;
+
+  // Starts the drain task. Messages logged before this wait in the queue.
+  static void begin(Print &out);
+  static void write(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+  // Waits up to timeoutMs for the queue to empty, e.g. before a restart
+  static void flush(uint32_t timeoutMs);
+  static uint32_t dropped(); // Messages lost to a full queue since boot
+
+private:
+  struct Slot
+  {
+    uint32_t sequence; // Whose turn the slot is, see Logger.cpp
+    uint32_t timeMs;
+    uint8_t level;
+    char text[MESSAGE_SIZE];
+  };
+
+  static void taskEntry(void *arg);
+  static bool drainOne(Print &out);
+
+  static Slot slots[SLOTS];
+  static uint32_t enqueuePos;
+  static uint32_t dequeuePos;
+  static uint32_t droppedCount;
+  static Print *output;
+  static TaskHandle_t task;
+};
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Logger::write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) Logger::write(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logger::write(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#endif
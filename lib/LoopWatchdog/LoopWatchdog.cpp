@@ -0,0 +1,200 @@
+#include "LoopWatchdog.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+#include <Fnv1a.h>
+
+#define STORE_MAGIC 0x53544C31 // "STL1"
+
+// Survives everything but a power cycle, validated by magic and checksum
+struct StallStore
+{
+  uint32_t magic;
+  uint32_t check;
+  uint32_t boot;
+  uint32_t nextSeq;
+  uint32_t ackedSeq;
+  LoopWatchdog::Record records[LoopWatchdog::MAX_RECORDS];
+};
+
+RTC_NOINIT_ATTR static StallStore store;
+
+static uint32_t storeCheck()
+{
+  return fnv1aRecord(store);
+}
+
+static void seal()
+{
+  store.check = storeCheck();
+}
+
+static void copyName(char *out, const char *name)
+{
+  strncpy(out, name, LoopWatchdog::NAME_LENGTH - 1);
+  out[LoopWatchdog::NAME_LENGTH - 1] = '\0';
+}
+
+void LoopWatchdog::begin(uint32_t taskTimeoutS)
+{
+  portENTER_CRITICAL(&mux);
+  if (store.magic != STORE_MAGIC || store.check != storeCheck())
+  {
+    memset(&store, 0, sizeof(store));
+    store.magic = STORE_MAGIC;
+    store.nextSeq = 1;
+  }
+  store.boot++;
+  for (size_t i = 0; i < MAX_RECORDS; i++)
+  {
+    if (store.records[i].active)
+    {
+      store.records[i].active = 0;
+      store.records[i].resetFollowed = 1;
+    }
+  }
+  seal();
+  portEXIT_CRITICAL(&mux);
+
+  esp_task_wdt_init(taskTimeoutS, true); // Reconfigures the one the core started
+  esp_task_wdt_add(xTaskGetCurrentTaskHandle());
+
+  esp_timer_create_args_t args = {};
+  args.callback = onMonitor;
+  args.arg = this;
+  args.name = "watchdog";
+  esp_timer_create(&args, &monitor);
+  esp_timer_start_periodic(monitor, MONITOR_PERIOD_MS * 1000);
+}
+
+uint8_t LoopWatchdog::add(const char *name, uint32_t stallMs)
+{
+  if (subsystemCount >= MAX_SUBSYSTEMS)
+    return MAX_SUBSYSTEMS - 1; // Shares the last slot rather than failing
+  subsystems[subsystemCount].name = name;
+  subsystems[subsystemCount].stallMs = stallMs;
+  subsystems[subsystemCount].lastBeatUs = 0;
+  return subsystemCount++;
+}
+
+void LoopWatchdog::enter(uint8_t next)
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&mux);
+  phase = next;
+  phaseSinceUs = now;
+  portEXIT_CRITICAL(&mux);
+  esp_task_wdt_reset();
+}
+
+void LoopWatchdog::feed()
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&mux);
+  phaseSinceUs = now;
+  portEXIT_CRITICAL(&mux);
+  esp_task_wdt_reset();
+}
+
+void LoopWatchdog::feed(uint8_t heartbeat)
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&mux);
+  subsystems[heartbeat].lastBeatUs = now;
+  portEXIT_CRITICAL(&mux);
+}
+
+void LoopWatchdog::onMonitor(void *arg)
+{
+  static_cast<LoopWatchdog *>(arg)->check(esp_timer_get_time());
+}
+
+void LoopWatchdog::check(int64_t nowUs)
+{
+  for (size_t id = 0; id < subsystemCount; id++)
+  {
+    portENTER_CRITICAL(&mux);
+    int64_t since = id == phase ? phaseSinceUs : subsystems[id].lastBeatUs;
+    portEXIT_CRITICAL(&mux);
+
+    if (since != 0 && nowUs - since > (int64_t)subsystems[id].stallMs * 1000)
+      stalled(id, since, nowUs);
+    else if (openSeq[id] != 0)
+      recovered(id);
+  }
+}
+
+void LoopWatchdog::stalled(uint8_t id, int64_t sinceUs, int64_t nowUs)
+{
+  if (openSeq[id] != 0 && openSinceUs[id] != sinceUs)
+    recovered(id); // Progress was made in between, this is a new stall
+
+  portENTER_CRITICAL(&mux);
+  Record *record = nullptr;
+  if (openSeq[id] != 0 && store.records[openSeq[id] % MAX_RECORDS].seq == openSeq[id])
+    record = &store.records[openSeq[id] % MAX_RECORDS];
+  if (record == nullptr)
+  {
+    uint32_t seq = store.nextSeq++;
+    record = &store.records[seq % MAX_RECORDS];
+    memset(record, 0, sizeof(*record));
+    record->seq = seq;
+    record->boot = store.boot;
+    record->uptimeMs = (uint32_t)(nowUs / 1000);
+    copyName(record->subsystem, subsystems[id].name);
+    copyName(record->loopPhase, phase < subsystemCount ? subsystems[phase].name : "");
+    record->active = 1;
+    openSeq[id] = seq;
+    openSinceUs[id] = sinceUs;
+  }
+  record->stalledMs = (uint32_t)((nowUs - sinceUs) / 1000);
+  seal();
+  portEXIT_CRITICAL(&mux);
+}
+
+void LoopWatchdog::recovered(uint8_t id)
+{
+  portENTER_CRITICAL(&mux);
+  Record &record = store.records[openSeq[id] % MAX_RECORDS];
+  if (record.seq == openSeq[id])
+  {
+    record.active = 0;
+    seal();
+  }
+  portEXIT_CRITICAL(&mux);
+  openSeq[id] = 0;
+}
+
+size_t LoopWatchdog::records(Record *out, size_t maxCount) const
+{
+  size_t count = 0;
+  portENTER_CRITICAL(&mux);
+  uint32_t first = store.ackedSeq + 1;
+  if (store.nextSeq > MAX_RECORDS && first < store.nextSeq - MAX_RECORDS)
+    first = store.nextSeq - MAX_RECORDS; // Older ones were overwritten
+  for (uint32_t seq = first; seq < store.nextSeq && count < maxCount; seq++)
+  {
+    const Record &record = store.records[seq % MAX_RECORDS];
+    if (record.active)
+      break; // Reported once it is over
+    out[count++] = record;
+  }
+  portEXIT_CRITICAL(&mux);
+  return count;
+}
+
+void LoopWatchdog::acknowledge(uint32_t seq)
+{
+  portENTER_CRITICAL(&mux);
+  if (seq > store.ackedSeq && seq < store.nextSeq)
+  {
+    store.ackedSeq = seq;
+    seal();
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+uint32_t LoopWatchdog::bootCount() const
+{
+  return store.boot;
+}
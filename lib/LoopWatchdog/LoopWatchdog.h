@@ -0,0 +1,78 @@
+#ifndef LOOP_WATCHDOG_H
+#define LOOP_WATCHDOG_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+// Notices when loop() or another task stops making progress, and says where.
+//
+// Subsystems are either loop() phases, which loop() enters in turn, or
+// heartbeats fed periodically from their own task. A monitor on the
+// esp_timer task checks every MONITOR_PERIOD_MS: a phase that has run, or a
+// heartbeat that has been silent, for longer than its threshold is a stall.
+// Each stall is recorded with the subsystem, what loop() was doing and how
+// long it has lasted, updated until it ends. Records live in RTC memory, so
+// a stall that ends in a task watchdog reset is still there after the reboot.
+//
+// The loop task is also subscribed to the ESP32 task watchdog, which enter()
+// and feed() reset, so a loop() that never comes back restarts the chip.
+class LoopWatchdog
+{
+public:
+  static const size_t MAX_SUBSYSTEMS = 12;
+  static const size_t MAX_RECORDS = 8;
+  static const size_t NAME_LENGTH = 12;
+  static const uint32_t MONITOR_PERIOD_MS = 100;
+
+  struct Record
+  {
+    uint32_t seq;
+    uint32_t boot;      // Boot the stall happened in, see bootCount()
+    uint32_t uptimeMs;  // When the threshold was hit
+    uint32_t stalledMs; // How long without progress, so far
+    char subsystem[NAME_LENGTH];
+    char loopPhase[NAME_LENGTH]; // What loop() was doing at the time
+    uint8_t active;              // Still stalled
+    uint8_t resetFollowed;       // The chip reset while it was still stalled
+    uint8_t reserved[2];
+  };
+
+  // Call from the loop task. The task watchdog panics after taskTimeoutS.
+  void begin(uint32_t taskTimeoutS);
+
+  // Registers a subsystem, name must be a literal. Returns its id.
+  uint8_t add(const char *name, uint32_t stallMs);
+
+  void enter(uint8_t phase); // loop() starts a phase
+  void feed();               // Progress inside a long phase, e.g. a modal menu
+  void feed(uint8_t heartbeat); // From a subsystem's own task
+
+  // Copies unacknowledged records, oldest first. Returns how many.
+  size_t records(Record *out, size_t maxCount) const;
+  void acknowledge(uint32_t seq); // Drops records up to seq once reported
+  uint32_t bootCount() const;
+
+private:
+  struct Subsystem
+  {
+    const char *name;
+    uint32_t stallMs;
+    volatile int64_t lastBeatUs; // 0 until fed, for heartbeats
+  };
+
+  static void onMonitor(void *arg);
+  void check(int64_t nowUs);
+  void stalled(uint8_t id, int64_t sinceUs, int64_t nowUs);
+  void recovered(uint8_t id);
+
+  Subsystem subsystems[MAX_SUBSYSTEMS];
+  size_t subsystemCount = 0;
+  volatile uint8_t phase = 0xFF; // Current loop() phase, 0xFF before the first
+  volatile int64_t phaseSinceUs = 0;
+  uint32_t openSeq[MAX_SUBSYSTEMS] = {};    // Record of a stall still in progress, 0 if none
+  int64_t openSinceUs[MAX_SUBSYSTEMS] = {}; // Start of the stall it covers
+  esp_timer_handle_t monitor = nullptr;
+  mutable portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+#endif
@@ -0,0 +1,627 @@
+#include "OtaUpdater.h"
+#include <EEPROM.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <ArduinoHttpClient.h>
+#include <ArduinoJson.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/md.h>
+#include <Fnv1a.h>
+#include <Logger.h>
+
+#define OTA_MAGIC 0x4F544131 // "OTA1"
+#define OTA_TASK_STACK 8192
+#define OTA_TASK_CORE 0      // The WiFi/network core, loop() runs on core 1
+#define OTA_HTTP_TIMEOUT_MS 10000
+
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+uint32_t OtaUpdater::checksum(const Record &record)
+{
+  return fnv1aRecord(record);
+}
+
+void OtaUpdater::saveRecord()
+{
+  record.magic = OTA_MAGIC;
+  record.check = checksum(record);
+  EEPROM.put(address, record);
+  EEPROM.commit();
+}
+
+const char *OtaUpdater::stateName(State s)
+{
+  switch (s)
+  {
+  case IDLE:
+    return "idle";
+  case RECEIVING:
+    return "receiving";
+  case READY:
+    return "ready";
+  case FAILED:
+    return "failed";
+  }
+  return "unknown";
+}
+
+void OtaUpdater::begin(int eepromAddress, uint16_t localPort, const char *otaSecret)
+{
+  static_assert(sizeof(Record) == STORAGE_SIZE, "STORAGE_SIZE out of date");
+
+  address = eepromAddress;
+  port = localPort;
+  secret = otaSecret != nullptr ? otaSecret : "";
+
+  EEPROM.get(address, record);
+  if (record.magic != OTA_MAGIC || record.check != checksum(record))
+    record = {};
+
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  if (record.probation && running->address == record.previousAddress)
+  {
+    // Already back on the old image (flashed over USB, or the bootloader rolled back)
+    record.probation = 0;
+    saveRecord();
+  }
+  else if (record.probation)
+  {
+    record.bootAttempts++;
+    if (record.bootAttempts > MAX_BOOT_ATTEMPTS)
+    {
+      const esp_partition_t *previous = nullptr;
+      esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, nullptr);
+      for (; it != nullptr; it = esp_partition_next(it))
+      {
+        const esp_partition_t *partition = esp_partition_get(it);
+        if (partition->address == record.previousAddress)
+          previous = partition;
+      }
+      esp_partition_iterator_release(it);
+
+      record.probation = 0;
+      saveRecord();
+      if (previous != nullptr && esp_ota_set_boot_partition(previous) == ESP_OK)
+      {
+        LOG_ERROR("New firmware never came up healthy, rolling back");
+        Logger::flush(100);
+        ESP.restart();
+      }
+      LOG_ERROR("Rollback partition missing, keeping the new firmware");
+    }
+    else
+    {
+      saveRecord();
+      probation = true;
+      LOG_WARN("Firmware on probation, boot attempt %u", record.bootAttempts);
+    }
+  }
+
+  xTaskCreatePinnedToCore(taskEntry, "ota", OTA_TASK_STACK, this, 1, &task, OTA_TASK_CORE);
+}
+
+void OtaUpdater::markValid()
+{
+  if (!probation)
+    return;
+  probation = false;
+  record.probation = 0;
+  record.bootAttempts = 0;
+  saveRecord();
+  esp_ota_mark_app_valid_cancel_rollback(); // For bootloaders built with rollback support
+  LOG_INFO("Firmware marked valid");
+}
+
+bool OtaUpdater::pull(const String &host, uint16_t hostPort, const String &path, const String &sha256Hex,
+                      const String &hmacHex)
+{
+  if (pullRequested || currentState == RECEIVING || currentState == READY)
+    return false;
+  pullHost = host;
+  pullPort = hostPort;
+  pullPath = path;
+  pullSha = sha256Hex;
+  pullHmac = hmacHex;
+  pullRequested = true; // Hands the strings over to the task
+  return true;
+}
+
+uint8_t OtaUpdater::progress() const
+{
+  if (currentState == READY)
+    return 100;
+  if (currentState != RECEIVING || compressedTotal == 0)
+    return 0;
+  return min(compressedDone * 100 / compressedTotal, (size_t)99);
+}
+
+void OtaUpdater::restart()
+{
+  if (currentState != READY)
+    return;
+  record.probation = 1;
+  record.bootAttempts = 0;
+  record.previousAddress = previousAddress;
+  saveRecord();
+  LOG_INFO("Restarting into new firmware");
+  Logger::flush(100);
+  ESP.restart();
+}
+
+void OtaUpdater::taskEntry(void *arg)
+{
+  static_cast<OtaUpdater *>(arg)->taskLoop();
+}
+
+void OtaUpdater::taskLoop()
+{
+  for (;;)
+  {
+    if (server == nullptr && secret[0] != '\0' && WiFi.status() == WL_CONNECTED)
+      startServer();
+    if (pullRequested)
+    {
+      runPull();
+      pullRequested = false;
+    }
+    if (server != nullptr)
+      server->handleClient();
+    vTaskDelay(pdMS_TO_TICKS(server != nullptr ? 5 : 500));
+  }
+}
+
+void OtaUpdater::startServer()
+{
+  newNonce();
+  server = new WebServer(port);
+  server->on("/api/ota", HTTP_GET, [this]() { handleStatus(); });
+  server->on("/api/ota", HTTP_POST, [this]() { handleUploadDone(); }, [this]() { handleUploadChunk(); });
+  server->begin();
+  LOG_INFO("OTA push endpoint: http://%s:%u/api/ota", WiFi.localIP().toString().c_str(), port);
+}
+
+void OtaUpdater::handleStatus()
+{
+  JsonDocument doc;
+  doc["state"] = stateName(currentState);
+  doc["progress"] = progress();
+  doc["error"] = error;
+  doc["probation"] = probation;
+  doc["nonce"] = nonce;
+  String body;
+  serializeJson(doc, body);
+  server->send(200, "application/json", body);
+}
+
+void OtaUpdater::handleUploadDone()
+{
+  if (pushRejected)
+  {
+    pushRejected = false;
+    server->send(403, "text/plain", "bad hmac");
+    return;
+  }
+  handleStatus();
+}
+
+void OtaUpdater::newNonce()
+{
+  uint8_t bytes[NONCE_BYTES];
+  esp_fill_random(bytes, sizeof(bytes));
+  for (size_t i = 0; i < NONCE_BYTES; i++)
+    sprintf(nonce + 2 * i, "%02x", bytes[i]);
+}
+
+// hmac = HMAC-SHA256(secret, nonce + sha256), both in lowercase hex. Every
+// attempt uses up the nonce, whatever the outcome.
+bool OtaUpdater::authorizePush(const String &sha256Hex, const String &hmacHex)
+{
+  String message = String(nonce) + sha256Hex;
+  newNonce();
+  return hmacMatches(message, hmacHex);
+}
+
+bool OtaUpdater::hmacMatches(const String &message, const String &hmacHex) const
+{
+  uint8_t expected[32];
+  if (secret[0] == '\0' || hmacHex.length() != 2 * sizeof(expected) ||
+      mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)secret, strlen(secret),
+                      (const uint8_t *)message.c_str(), message.length(), expected) != 0)
+    return false;
+
+  // Constant time, so the comparison does not leak how many bytes matched
+  uint8_t difference = 0;
+  for (size_t i = 0; i < sizeof(expected); i++)
+  {
+    char hex[3];
+    sprintf(hex, "%02x", expected[i]);
+    difference |= (hex[0] ^ tolower(hmacHex[2 * i])) | (hex[1] ^ tolower(hmacHex[2 * i + 1]));
+  }
+  return difference == 0;
+}
+
+// POST /api/ota?sha256=<hex>&hmac=<hex>[&size=<bytes>] with the image as a
+// multipart file
+void OtaUpdater::handleUploadChunk()
+{
+  HTTPUpload &upload = server->upload();
+  switch (upload.status)
+  {
+  case UPLOAD_FILE_START:
+    pushRejected = !authorizePush(server->arg("sha256"), server->arg("hmac"));
+    if (pushRejected)
+    {
+      LOG_WARN("OTA push from %s rejected, bad hmac", server->client().remoteIP().toString().c_str());
+      pushActive = false;
+      break;
+    }
+    pushActive = beginImage(server->arg("sha256"), server->arg("size").toInt());
+    break;
+  case UPLOAD_FILE_WRITE:
+    if (pushActive && !writeImage(upload.buf, upload.currentSize))
+      pushActive = false;
+    vTaskDelay(1); // One slice per tick
+    break;
+  case UPLOAD_FILE_END:
+    if (pushActive)
+      finishImage();
+    pushActive = false;
+    break;
+  case UPLOAD_FILE_ABORTED:
+    if (pushActive)
+      abortImage("upload aborted");
+    pushActive = false;
+    break;
+  }
+}
+
+void OtaUpdater::runPull()
+{
+  // The settings response is plain HTTP, the sha256 alone only catches corruption
+  if (!hmacMatches(pullSha, pullHmac))
+  {
+    LOG_WARN("Offered firmware %s rejected, bad hmac", pullPath.c_str());
+    currentState = FAILED;
+    error = "bad hmac";
+    return;
+  }
+  LOG_INFO("Downloading firmware from %s", pullPath.c_str());
+
+  WiFiClient client;
+  HttpClient http(client, pullHost, pullPort);
+  http.setHttpResponseTimeout(OTA_HTTP_TIMEOUT_MS);
+  if (http.get(pullPath) != 0)
+  {
+    currentState = FAILED;
+    error = "connection failed";
+    return;
+  }
+  int status = http.responseStatusCode();
+  if (status != 200)
+  {
+    http.stop();
+    currentState = FAILED;
+    error = "download refused";
+    return;
+  }
+  http.skipResponseHeaders();
+  int length = http.contentLength();
+  if (!beginImage(pullSha, length > 0 ? length : 0))
+  {
+    http.stop();
+    return;
+  }
+
+  uint8_t buffer[SLICE_BYTES];
+  unsigned long lastData = millis();
+  while (!http.endOfBodyReached() && (http.connected() || http.available()))
+  {
+    int n = http.read(buffer, sizeof(buffer));
+    if (n > 0)
+    {
+      lastData = millis();
+      if (!writeImage(buffer, n))
+      {
+        http.stop();
+        return;
+      }
+    }
+    else if (millis() - lastData > OTA_HTTP_TIMEOUT_MS)
+    {
+      http.stop();
+      abortImage("download stalled");
+      return;
+    }
+    vTaskDelay(1); // One slice per tick, the rest of the core stays with WiFi
+  }
+  http.stop();
+  finishImage();
+}
+
+static int hexValue(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool OtaUpdater::beginImage(const String &sha256Hex, size_t compressedSize)
+{
+  if (currentState == RECEIVING || currentState == READY)
+    return false;
+
+  if (sha256Hex.length() != 64)
+  {
+    currentState = FAILED;
+    error = "missing sha256";
+    return false;
+  }
+  for (size_t i = 0; i < 32; i++)
+  {
+    int high = hexValue(sha256Hex[2 * i]);
+    int low = hexValue(sha256Hex[2 * i + 1]);
+    if (high < 0 || low < 0)
+    {
+      currentState = FAILED;
+      error = "malformed sha256";
+      return false;
+    }
+    expectedSha[i] = (high << 4) | low;
+  }
+
+  if (!Update.begin(UPDATE_SIZE_UNKNOWN))
+  {
+    currentState = FAILED;
+    error = Update.errorString();
+    return false;
+  }
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  format = FORMAT_UNKNOWN;
+  compressedTotal = compressedSize;
+  compressedDone = 0;
+  imageBytes = 0;
+  error = "";
+  currentState = RECEIVING;
+  return true;
+}
+
+bool OtaUpdater::writeImage(const uint8_t *data, size_t len)
+{
+  if (currentState != RECEIVING)
+    return false;
+  compressedDone += len;
+
+  if (format == FORMAT_UNKNOWN && len > 0)
+  {
+    // App images start with 0xE9, gzip with 1F 8B
+    if (data[0] != 0x1F)
+    {
+      format = RAW;
+    }
+    else
+    {
+      inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+      dictionary = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+      if (inflator == nullptr || dictionary == nullptr)
+      {
+        abortImage("out of memory for inflate");
+        return false;
+      }
+      format = GZIP_HEADER;
+      fieldRemaining = 10;
+      dictionaryOffset = 0;
+    }
+  }
+
+  if (format == RAW)
+    return emit(data, len);
+  return inflate(data, len);
+}
+
+// Walks the gzip member: header fields byte by byte, then the deflate stream
+// through tinfl into the 32 KB window, then the 8-byte trailer
+bool OtaUpdater::inflate(const uint8_t *data, size_t len)
+{
+  size_t i = 0;
+  while (i < len)
+  {
+    uint8_t b = data[i];
+    switch (format)
+    {
+    case GZIP_HEADER:
+    {
+      size_t position = 10 - fieldRemaining;
+      if ((position == 1 && b != 0x8B) || (position == 2 && b != 8))
+      {
+        abortImage("not a gzip or firmware image");
+        return false;
+      }
+      if (position == 3)
+        gzipFlags = b;
+      i++;
+      if (--fieldRemaining == 0)
+        nextGzipField();
+      break;
+    }
+    case GZIP_EXTRA_LENGTH:
+      extraLength |= (uint16_t)b << (fieldRemaining == 2 ? 0 : 8);
+      i++;
+      if (--fieldRemaining == 0)
+      {
+        format = GZIP_EXTRA;
+        fieldRemaining = extraLength;
+        if (fieldRemaining == 0)
+          nextGzipField();
+      }
+      break;
+    case GZIP_EXTRA:
+    case GZIP_HEADER_CRC:
+      i++;
+      if (--fieldRemaining == 0)
+        nextGzipField();
+      break;
+    case GZIP_NAME:
+    case GZIP_COMMENT:
+      i++;
+      if (b == 0)
+        nextGzipField();
+      break;
+    case GZIP_DEFLATE:
+    {
+      size_t inBytes = len - i;
+      size_t outBytes = TINFL_LZ_DICT_SIZE - dictionaryOffset;
+      tinfl_status status = tinfl_decompress(inflator, data + i, &inBytes, dictionary, dictionary + dictionaryOffset,
+                                             &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+      i += inBytes;
+      if (outBytes > 0)
+      {
+        if (!emit(dictionary + dictionaryOffset, outBytes))
+          return false;
+        dictionaryOffset = (dictionaryOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+      }
+      if (status == TINFL_STATUS_DONE)
+      {
+        format = GZIP_TRAILER;
+        fieldRemaining = sizeof(trailer);
+      }
+      else if (status < 0)
+      {
+        abortImage("corrupt gzip data");
+        return false;
+      }
+      break;
+    }
+    case GZIP_TRAILER:
+      if (fieldRemaining == 0)
+        return true; // Anything after the member is padding
+      trailer[sizeof(trailer) - fieldRemaining] = b;
+      i++;
+      fieldRemaining--;
+      break;
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+// Moves to the next gzip header field the flags ask for
+void OtaUpdater::nextGzipField()
+{
+  switch (format)
+  {
+  case GZIP_HEADER:
+    if (gzipFlags & GZIP_FEXTRA)
+    {
+      format = GZIP_EXTRA_LENGTH;
+      fieldRemaining = 2;
+      extraLength = 0;
+      return;
+    }
+    // fall through
+  case GZIP_EXTRA:
+    if (gzipFlags & GZIP_FNAME)
+    {
+      format = GZIP_NAME;
+      return;
+    }
+    // fall through
+  case GZIP_NAME:
+    if (gzipFlags & GZIP_FCOMMENT)
+    {
+      format = GZIP_COMMENT;
+      return;
+    }
+    // fall through
+  case GZIP_COMMENT:
+    if (gzipFlags & GZIP_FHCRC)
+    {
+      format = GZIP_HEADER_CRC;
+      fieldRemaining = 2;
+      return;
+    }
+    // fall through
+  default:
+    format = GZIP_DEFLATE;
+    tinfl_init(inflator);
+  }
+}
+
+bool OtaUpdater::emit(const uint8_t *data, size_t len)
+{
+  mbedtls_sha256_update_ret(&sha, data, len);
+  if (Update.write((uint8_t *)data, len) != len)
+  {
+    abortImage(Update.errorString());
+    return false;
+  }
+  imageBytes += len;
+  return true;
+}
+
+bool OtaUpdater::finishImage()
+{
+  if (currentState != RECEIVING)
+    return false;
+
+  if (format == GZIP_TRAILER && fieldRemaining == 0)
+  {
+    uint32_t size = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+    if (size != (uint32_t)imageBytes)
+    {
+      abortImage("gzip size mismatch");
+      return false;
+    }
+  }
+  else if (format != RAW)
+  {
+    abortImage("image truncated");
+    return false;
+  }
+
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  if (memcmp(digest, expectedSha, sizeof(digest)) != 0)
+  {
+    abortImage("sha256 mismatch");
+    return false;
+  }
+
+  previousAddress = esp_ota_get_running_partition()->address;
+  if (!Update.end(true)) // Also makes the new partition the boot partition
+  {
+    abortImage(Update.errorString());
+    return false;
+  }
+  releaseBuffers();
+  currentState = READY;
+  LOG_INFO("Firmware verified, %u bytes", (unsigned)imageBytes);
+  return true;
+}
+
+void OtaUpdater::abortImage(const char *reason)
+{
+  Update.abort();
+  mbedtls_sha256_free(&sha);
+  releaseBuffers();
+  error = reason;
+  currentState = FAILED;
+  LOG_ERROR("Firmware update failed: %s", reason);
+}
+
+void OtaUpdater::releaseBuffers()
+{
+  free(inflator);
+  free(dictionary);
+  inflator = nullptr;
+  dictionary = nullptr;
+}
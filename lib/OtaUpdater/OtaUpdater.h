@@ -0,0 +1,156 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include <WebServer.h>
+#include <esp32/rom/miniz.h>
+#include <mbedtls/sha256.h>
+
+// Over-the-air firmware updates. Images are either pulled from the backend
+// (pull()) or pushed to POST /api/ota on the local HTTP server, and may be
+// plain .bin or gzip. Everything network- and flash-related runs in a task
+// pinned to core 0, next to the WiFi stack, one slice of at most SLICE_BYTES
+// at a time, so loop() on core 1 keeps running the pump. Flash writes stall
+// the cache on both cores for a few ms each; the step ISR is in IRAM and
+// keeps stepping through them.
+//
+// The image is inflated on the fly with the ROM copy of miniz, hashed with
+// SHA-256 as it is written and only made bootable when the hash matches.
+// A new image boots on probation: if it restarts MAX_BOOT_ATTEMPTS times
+// without markValid() being called, the previous image is restored.
+//
+// Both paths need a device secret; without one push is off and every pull is
+// refused. A pulled image must carry an HMAC-SHA256, keyed with the secret,
+// over its SHA-256, so only a backend holding the secret can offer one. A
+// pushed image must carry one over the nonce from GET /api/ota and the
+// SHA-256. The nonce changes with every upload attempt, so a captured request
+// cannot be replayed and wrong guesses cannot be retried against the same
+// nonce.
+class OtaUpdater
+{
+public:
+  static const size_t STORAGE_SIZE = 16;  // Bytes used at the EEPROM address
+  static const size_t SLICE_BYTES = 1024; // Compressed bytes handled per task wake-up
+  static const uint8_t MAX_BOOT_ATTEMPTS = 3;
+  static const size_t NONCE_BYTES = 16;
+
+  enum State : uint8_t
+  {
+    IDLE,
+    RECEIVING, // Downloading or being pushed, inflating and flashing
+    READY,     // Verified and set as boot partition, waiting for restart()
+    FAILED,
+  };
+
+  // Call right after EEPROM.begin(). Rolls back here if the running image
+  // has failed its probation. An empty secret turns OTA off; secret must
+  // outlive the updater.
+  void begin(int eepromAddress, uint16_t localPort, const char *secret);
+
+  // Queues a download from the backend. sha256Hex is the digest of the
+  // uncompressed image, hmacHex is HMAC-SHA256(secret, sha256Hex); the image
+  // is not downloaded unless it matches. Returns false if an update is
+  // already running.
+  bool pull(const String &host, uint16_t port, const String &path, const String &sha256Hex, const String &hmacHex);
+
+  // The running image works, stop counting boot attempts
+  void markValid();
+  bool isOnProbation() const { return probation; }
+
+  State state() const { return currentState; }
+  static const char *stateName(State s);
+  uint8_t progress() const; // Percent, when the size is known
+  const char *lastError() const { return error; }
+
+  // Persists the probation record for the new image and reboots into it.
+  // Only call from loop() when state() is READY.
+  void restart();
+
+private:
+  struct Record
+  {
+    uint32_t magic;
+    uint8_t probation;
+    uint8_t bootAttempts;
+    uint16_t reserved;
+    uint32_t previousAddress; // Partition to go back to
+    uint32_t check;
+  };
+
+  enum GzipState : uint8_t
+  {
+    FORMAT_UNKNOWN,
+    RAW,
+    GZIP_HEADER,
+    GZIP_EXTRA_LENGTH,
+    GZIP_EXTRA,
+    GZIP_NAME,
+    GZIP_COMMENT,
+    GZIP_HEADER_CRC,
+    GZIP_DEFLATE,
+    GZIP_TRAILER,
+  };
+
+  static void taskEntry(void *arg);
+  void taskLoop();
+  void runPull();
+  void startServer();
+  void handleUploadChunk();
+  void handleUploadDone();
+  void handleStatus();
+  bool authorizePush(const String &sha256Hex, const String &hmacHex);
+  bool hmacMatches(const String &message, const String &hmacHex) const;
+  void newNonce();
+
+  // Image pipeline shared by pull and push
+  bool beginImage(const String &sha256Hex, size_t compressedSize);
+  bool writeImage(const uint8_t *data, size_t len);
+  bool finishImage();
+  void abortImage(const char *reason);
+  bool inflate(const uint8_t *data, size_t len);
+  void nextGzipField();
+  bool emit(const uint8_t *data, size_t len);
+  void releaseBuffers();
+
+  void saveRecord();
+  static uint32_t checksum(const Record &record);
+
+  int address = 0;
+  uint16_t port = 80;
+  Record record = {};
+  bool probation = false;
+
+  WebServer *server = nullptr;
+  TaskHandle_t task = nullptr;
+  const char *secret = "";
+  char nonce[2 * NONCE_BYTES + 1] = "";
+  bool pushActive = false;   // The upload in progress is ours
+  bool pushRejected = false; // The upload in progress failed authentication
+
+  volatile State currentState = IDLE;
+  const char *error = "";
+  volatile bool pullRequested = false;
+  String pullHost;
+  uint16_t pullPort = 0;
+  String pullPath;
+  String pullSha;
+  String pullHmac;
+
+  // Image in progress
+  uint8_t expectedSha[32];
+  mbedtls_sha256_context sha;
+  tinfl_decompressor *inflator = nullptr;
+  uint8_t *dictionary = nullptr; // TINFL_LZ_DICT_SIZE window, also the output buffer
+  size_t dictionaryOffset = 0;
+  GzipState format = FORMAT_UNKNOWN;
+  uint8_t gzipFlags = 0;
+  uint16_t extraLength = 0;
+  size_t fieldRemaining = 0; // Bytes left in the current header or trailer field
+  uint8_t trailer[8];
+  size_t compressedTotal = 0;
+  volatile size_t compressedDone = 0;
+  size_t imageBytes = 0;
+  uint32_t previousAddress = 0;
+};
+
+#endif
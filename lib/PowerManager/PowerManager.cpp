@@ -0,0 +1,146 @@
+#include "PowerManager.h"
+#include <WiFi.h>
+#include <driver/gpio.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <Logger.h>
+
+SemaphoreHandle_t PowerManager::wakeSemaphore = nullptr;
+
+void PowerManager::begin(const uint8_t *wakePins, size_t wakePinCount, int maxMhz, int minMhz)
+{
+  pins = wakePins;
+  pinCount = wakePinCount;
+  maxFrequency = maxMhz;
+  minFrequency = minMhz;
+  stateSince = esp_timer_get_time();
+
+  // Prefer DFS with automatic light sleep, fall back to DFS alone when the
+  // SDK was built without tickless idle, and to manual clock switching when
+  // power management is not compiled in at all.
+  esp_pm_config_esp32_t config = {};
+  config.max_freq_mhz = maxMhz;
+  config.min_freq_mhz = minMhz;
+  config.light_sleep_enable = true;
+  esp_err_t err = esp_pm_configure(&config);
+  if (err == ESP_ERR_NOT_SUPPORTED)
+  {
+    config.light_sleep_enable = false;
+    err = esp_pm_configure(&config);
+  }
+  pmConfigured = err == ESP_OK;
+  autoLightSleep = pmConfigured && config.light_sleep_enable;
+
+  if (pmConfigured && esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "active", &cpuLock) == ESP_OK)
+    esp_pm_lock_acquire(cpuLock);
+
+  // Buttons are active low. The same level interrupt wakes the chip from light
+  // sleep and releases waitForEvent(); it stays masked outside of a wait.
+  wakeSemaphore = xSemaphoreCreateBinary();
+  gpio_install_isr_service(0); // Already installed by attachInterrupt() is fine
+  for (size_t i = 0; i < pinCount; i++)
+  {
+    gpio_num_t pin = (gpio_num_t)pins[i];
+    gpio_wakeup_enable(pin, GPIO_INTR_LOW_LEVEL);
+    gpio_isr_handler_add(pin, onWakePin, (void *)(uintptr_t)pin);
+    gpio_intr_disable(pin);
+  }
+  esp_sleep_enable_gpio_wakeup();
+
+  LOG_INFO("Power management: %s", autoLightSleep ? "DFS + auto light sleep" : pmConfigured ? "DFS" : "manual clock switching");
+}
+
+void PowerManager::onWakePin(void *arg)
+{
+  gpio_intr_disable((gpio_num_t)(uintptr_t)arg);
+  BaseType_t woken = pdFALSE;
+  xSemaphoreGiveFromISR(wakeSemaphore, &woken);
+  if (woken)
+    portYIELD_FROM_ISR();
+}
+
+void PowerManager::enterState(State next)
+{
+  int64_t now = esp_timer_get_time();
+  accumulatedUs[state] += now - stateSince;
+  stateSince = now;
+  state = next;
+}
+
+void PowerManager::setIdle(bool idle)
+{
+  if (idle == isIdle())
+    return;
+
+  if (idle)
+  {
+    enterState(IDLE);
+    WiFi.setSleep(WIFI_PS_MAX_MODEM);
+    if (cpuLock != nullptr)
+      esp_pm_lock_release(cpuLock);
+    else if (!pmConfigured)
+      setCpuFrequencyMhz(minFrequency);
+  }
+  else
+  {
+    if (cpuLock != nullptr)
+      esp_pm_lock_acquire(cpuLock);
+    else if (!pmConfigured)
+      setCpuFrequencyMhz(maxFrequency);
+    WiFi.setSleep(WIFI_PS_MIN_MODEM);
+    enterState(ACTIVE);
+  }
+}
+
+void PowerManager::wake()
+{
+  if (wakeSemaphore != nullptr)
+    xSemaphoreGive(wakeSemaphore);
+}
+
+void PowerManager::waitForEvent(unsigned long maxWaitMs)
+{
+  if (!isIdle() || maxWaitMs == 0 || wakeSemaphore == nullptr)
+    return;
+
+  // Don't block while a button is already held down
+  for (size_t i = 0; i < pinCount; i++)
+  {
+    if (digitalRead(pins[i]) == LOW)
+      return;
+  }
+
+  xSemaphoreTake(wakeSemaphore, 0); // Drop a stale wake-up
+  enterState(SLEEP);
+  for (size_t i = 0; i < pinCount; i++)
+    gpio_intr_enable((gpio_num_t)pins[i]);
+
+  xSemaphoreTake(wakeSemaphore, pdMS_TO_TICKS(maxWaitMs));
+
+  for (size_t i = 0; i < pinCount; i++)
+    gpio_intr_disable((gpio_num_t)pins[i]);
+  enterState(IDLE);
+}
+
+uint64_t PowerManager::timeInState(State s) const
+{
+  uint64_t us = accumulatedUs[s];
+  if (s == state)
+    us += esp_timer_get_time() - stateSince;
+  return us / 1000;
+}
+
+const char *PowerManager::stateName(State s)
+{
+  switch (s)
+  {
+  case ACTIVE:
+    return "active";
+  case IDLE:
+    return "idle";
+  case SLEEP:
+    return "sleep";
+  default:
+    return "?";
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include <esp_pm.h>
+
+// Idle power mode for when the pump is stopped and nobody is looking at the
+// display. Active mode holds a CPU_FREQ_MAX lock; idle releases it so dynamic
+// frequency scaling (and automatic light sleep, when the SDK supports it) can
+// take over, switches WiFi to max modem sleep, and lets loop() block until a
+// button is pressed or the next deadline comes up.
+class PowerManager
+{
+public:
+  enum State
+  {
+    ACTIVE, // Full clock, loop spinning
+    IDLE,   // Reduced clock, loop running
+    SLEEP,  // Blocked waiting for a button or deadline
+    STATE_COUNT,
+  };
+
+  void begin(const uint8_t *wakePins, size_t wakePinCount, int maxMhz, int minMhz);
+  void setIdle(bool idle);
+  bool isIdle() const { return state != ACTIVE; }
+
+  // Blocks for up to maxWaitMs, returning early when a wake button goes low
+  void waitForEvent(unsigned long maxWaitMs);
+  void wake(); // Ends a waitForEvent() early, callable from other tasks
+
+  uint64_t timeInState(State s) const; // ms, including the current stretch
+  bool hasAutoLightSleep() const { return autoLightSleep; }
+  static const char *stateName(State s);
+
+private:
+  void enterState(State next);
+  static void onWakePin(void *arg);
+
+  State state = ACTIVE;
+  int64_t stateSince = 0; // esp_timer_get_time() at the last transition
+  uint64_t accumulatedUs[STATE_COUNT] = {0, 0, 0};
+
+  int maxFrequency = 240;
+  int minFrequency = 80;
+  bool pmConfigured = false;
+  bool autoLightSleep = false;
+  esp_pm_lock_handle_t cpuLock = nullptr;
+  const uint8_t *pins = nullptr;
+  size_t pinCount = 0;
+
+  static SemaphoreHandle_t wakeSemaphore;
+};
+
+#endif
@@ -2,46 +2,241 @@
 
 PumpController::PumpController(Stream* serialPort, uint8_t stepPin, uint8_t dirPin, uint8_t enablePin, float rSense, uint8_t addr)
     : driver(serialPort, rSense, addr),
-      stepper(AccelStepper::DRIVER, stepPin, dirPin),
+      engine(new LoopStepEngine(stepPin, dirPin)),
+      enPin(enablePin) {}
+
+PumpController::PumpController(Stream* serialPort, StepEngine& engine, uint8_t enablePin, float rSense, uint8_t addr)
+    : driver(serialPort, rSense, addr),
+      engine(&engine),
       enPin(enablePin) {}
 
 void PumpController::begin() {
+  lock = xSemaphoreCreateRecursiveMutex();
   pinMode(enPin, OUTPUT);
   digitalWrite(enPin, HIGH); // Disabled by default (HIGH = off for TMC2209)
+  engine->begin();
 
   driver.begin();
   driver.toff(5);              // Enable driver
-  driver.rms_current(500);     // Set motor current (mA)
+  driver.rms_current(RUN_CURRENT_MA); // Set motor current (mA)
   driver.microsteps(256);       // Default microstepping
   driver.pwm_autoscale(true);  // Enable stealthChop
 
-  stepper.setMaxSpeed(4000);
-  stepper.setAcceleration(100);
+  ramp.setAcceleration(DEFAULT_ACCELERATION);
 }
 
 void PumpController::run() {
-  if (enabled && currentSpeed > 0) {
-    stepper.setSpeed(currentSpeed);
-    stepper.runSpeed();
+  Guard guard(lock);
+  if (!enabled) {
+    return;
+  }
+  // The ramp moves once per ms; the engine steps at whatever rate it was last given
+  uint32_t now = millis();
+  if (now != lastRampUpdate && (ramp.isRamping() || dosing)) {
+    TRACE_SCOPE(TRACE_PUMP_RUN);
+    lastRampUpdate = now;
+    updateRamp(now);
+    if (!enabled) {
+      return;
+    }
+  }
+  engine->poll();
+  if (dosing && !engine->isRunning()) {
+    stop(); // The engine stopped itself on the dose's last step
   }
 }
 
+void PumpController::updateRamp(uint32_t now) {
+  if (dosing && !doseBraking) {
+    // Slow down in time to finish the dose at a crawl instead of a dead stop
+    int32_t remaining = (int32_t)(doseEndStep - engine->stepCount());
+    if (remaining <= (int32_t)ramp.stoppingSteps(ramp.current())) {
+      doseBraking = true;
+      float crawl = max(targetSpeed * DOSE_CRAWL_FRACTION, min(DOSE_MIN_CRAWL_SPEED, targetSpeed));
+      ramp.setTarget(StepTimer::toRate(crawl), now);
+    }
+  }
+
+  uint32_t rate = ramp.update(now);
+  engine->setRate(rate); // No-op unless the rate moved
+  if (rate == 0 && !ramp.isRamping()) {
+    // Finished ramping down to a stop
+    enabled = false;
+    digitalWrite(enPin, HIGH);
+  }
+}
+
+// Stops at once, without a ramp. The target speed is kept so the pump can
+// resume; a dose's own speed gives way to the one set before it.
 void PumpController::stop() {
+  Guard guard(lock);
+  if (dosing) {
+    targetSpeed = resumeSpeed;
+    flowTrim = resumeTrim;
+    applyCalibration();
+  }
   enabled = false;
+  dosing = false;
   digitalWrite(enPin, HIGH);
-  stepper.stop();
+  engine->setRate(0);
+  engine->clearStopAt();
+  ramp.reset(0);
 }
 
 void PumpController::setSpeed(float speed) {
-  currentSpeed = constrain(speed, 0, stepper.maxSpeed());
-  enabled = (currentSpeed > 0);
-  digitalWrite(enPin, !enabled); // LOW = enabled
+  Guard guard(lock);
+  if (testing) {
+    return;
+  }
+  if (lowPower && speed > 0) {
+    setLowPower(false);
+  }
+  targetSpeed = constrain(speed, 0, maxSpeed);
+  applyCalibration();
+  if (targetSpeed > 0) {
+    enabled = true;
+    digitalWrite(enPin, LOW); // LOW = enabled
+  } else {
+    dosing = false;
+    engine->clearStopAt();
+  }
+  doseBraking = false;
+  ramp.setTarget(StepTimer::toRate(trimmedSpeed()), millis());
+  lastRampUpdate = millis();
+  if (enabled) {
+    updateRamp(lastRampUpdate);
+  }
+}
+
+bool PumpController::dose(float ml, float speed) {
+  Guard guard(lock);
+  if (testing || ml <= 0 || speed <= 0) {
+    return false;
+  }
+  // Checked before the speed changes, so a refused dose leaves a running pump alone
+  long steps = lround(ml * stepsPerMLAt(constrain(speed, 0, maxSpeed)));
+  if (steps <= 0) {
+    return false;
+  }
+  if (!dosing) {
+    resumeSpeed = targetSpeed;
+    resumeTrim = flowTrim;
+  }
+  flowTrim = 1; // Doses run open loop, their volume is counted in steps
+  setSpeed(speed);
+  doseEndStep = engine->stepCount() + steps;
+  engine->stopAt(doseEndStep); // Exact, even if loop() is late
+  dosing = enabled;
+  return dosing;
+}
+
+bool PumpController::doseIfIdle(float ml, float speed) {
+  Guard guard(lock);
+  if (enabled) {
+    return false;
+  }
+  return dose(ml, speed);
+}
+
+void PumpController::setStepsPerML(float steps) {
+  Guard guard(lock);
+  baseStepsPerML = steps;
+  applyCalibration();
+}
+
+void PumpController::setCalibrationTable(const CalibrationTable* table) {
+  Guard guard(lock);
+  calibrationTable = table;
+  applyCalibration();
+}
+
+// Looked up once per setpoint change, not per step
+void PumpController::applyCalibration() {
+  stepsPerML = stepsPerMLAt(targetSpeed);
+}
+
+float PumpController::stepsPerMLAt(float speed) const {
+  if (calibrationTable != nullptr && calibrationTable->isValid()) {
+    return calibrationTable->lookup(speed);
+  }
+  return baseStepsPerML;
 }
 
 void PumpController::setAcceleration(float accel) {
-  stepper.setAcceleration(accel);
+  Guard guard(lock);
+  ramp.setAcceleration(accel);
+}
+
+void PumpController::setMaxSpeed(float speed) {
+  Guard guard(lock);
+  maxSpeed = speed;
+  if (targetSpeed <= maxSpeed) {
+    return;
+  }
+  if (enabled) {
+    setSpeed(maxSpeed);
+  } else {
+    targetSpeed = maxSpeed; // Resumes at the new limit
+    applyCalibration();
+  }
+}
+
+// Ramps to the trimmed rate like a speed change. Ignored during a dose.
+void PumpController::setFlowTrim(float factor) {
+  Guard guard(lock);
+  if (factor == flowTrim || !(factor > 0) || dosing) {
+    return;
+  }
+  flowTrim = factor;
+  if (enabled) {
+    ramp.setTarget(StepTimer::toRate(trimmedSpeed()), millis());
+  }
+}
+
+// The lock is not held while the test runs, so the dose scheduler is not
+// blocked for the whole sweep; the testing flag keeps it off the engine.
+void PumpController::selfTest(const std::function<void(StepEngine&)>& test) {
+  {
+    Guard guard(lock);
+    stop();
+    testing = true;
+  }
+  test(*engine);
+  Guard guard(lock);
+  engine->setRate(0);
+  testing = false;
+}
+
+bool PumpController::readRegister(uint8_t address, uint32_t& value) {
+  Guard guard(lock);
+  value = driver.read(address);
+  return !driver.CRCerror;
+}
+
+// The next TMCStepper setter that touches the same register writes its own
+// copy back over this
+void PumpController::writeRegister(uint8_t address, uint32_t value) {
+  Guard guard(lock);
+  driver.write(address, value);
 }
 
 void PumpController::setMicrosteps(uint16_t ms) {
+  Guard guard(lock);
   driver.microsteps(ms);
 }
+
+void PumpController::setLowPower(bool enable) {
+  Guard guard(lock);
+  if (enable == lowPower) {
+    return;
+  }
+  lowPower = enable;
+  if (lowPower) {
+    stop();
+    driver.ihold(0); // No standstill current
+    driver.toff(0);  // Power stage off
+  } else {
+    driver.toff(5);
+    driver.rms_current(RUN_CURRENT_MA); // Restores the hold current too
+  }
+}
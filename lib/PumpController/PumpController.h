@@ -2,34 +2,125 @@
 #define PUMP_CONTROLLER_H
 
 #include <TMCStepper.h>
-#include <AccelStepper.h>
+#include <functional>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <StepEngine.h>
+#include <TimerStepEngine.h>
+#include <CalibrationTable.h>
+#include <SpeedRamp.h>
+#include <TraceRecorder.h>
+
+// TMCStepper keeps raw register access protected
+class TMC2209Registers : public TMC2209Stepper {
+public:
+  using TMC2209Stepper::TMC2209Stepper;
+  using TMC2209Stepper::read;
+  using TMC2209Stepper::write;
+};
 
 class PumpController {
 public:
-  PumpController(Stream* serialPort, uint8_t stepPin, uint8_t dirPin, uint8_t enablePin, float rSense, uint8_t addr);
+  PumpController(Stream* serialPort, uint8_t stepPin, uint8_t dirPin, uint8_t enablePin, float rSense, uint8_t addr); // Steps from run()
+  PumpController(Stream* serialPort, StepEngine& engine, uint8_t enablePin, float rSense, uint8_t addr);
   void begin();
   void run();
   void stop();
-  void setSpeed(float speed); // Speed in steps/sec
-  void setAcceleration(float accel);
+  void setSpeed(float speed); // Target speed in steps/sec, reached along the acceleration ramp
+  bool dose(float ml, float speed); // Run until ml has been delivered, then stop. The earlier target speed stays.
+  bool doseIfIdle(float ml, float speed); // dose(), unless the pump is already running
+  void setAcceleration(float accel); // steps/sec^2, 0 jumps straight to the target
   void setMicrosteps(uint16_t ms);
+  void setLowPower(bool lowPower); // Power down the driver stage while idle
+  void setMaxSpeed(float speed); // steps/sec, setSpeed() and dose() clamp to it
+  // Scales the step rate without changing the target speed, for closed-loop
+  // flow correction. 1 is open loop. A dose resets it to 1 and ignores it.
+  void setFlowTrim(float factor);
+  float getFlowTrim() const { return flowTrim; }
+  // Stops the pump and hands the step engine to test with the driver
+  // disabled. Doses and speed changes are refused until it returns.
+  void selfTest(const std::function<void(StepEngine&)>& test);
+  bool isTesting() const { return testing; }
+  bool readRegister(uint8_t address, uint32_t& value); // Raw driver register, false on a bad reply
+  void writeRegister(uint8_t address, uint32_t value); // Bypasses TMCStepper's shadow copies
   bool isEnabled() const { return enabled; }
-  float getSpeed() const { return currentSpeed; }
-  float getStepsPerML() const { return stepsPerML; }
+  bool isDosing() const { return dosing; }
+  uint32_t getStepCount() const { return engine->stepCount(); } // Total steps issued, wraps
+  float getSpeed() const { return (float)ramp.current() / (1 << StepTimer::RATE_FRACTION_BITS); } // Instantaneous
+  float getTargetSpeed() const { return targetSpeed; }
+  bool isRamping() const { return ramp.isRamping(); }
+  float getStepsPerML() const { return stepsPerML; } // Calibration at the target speed
+  float getMaxSpeed() const { return maxSpeed; }
   int getSpeedStep() const { return speedStep; }
-  void setStepsPerML(float steps) { stepsPerML = steps; } // Setter for external calibration
+  void setStepsPerML(float steps); // Single-point calibration, used when there is no table
+  void setCalibrationTable(const CalibrationTable* table); // nullptr falls back to setStepsPerML()
   void setSpeedStep(int step) { speedStep = step; }       // Setter for external calibration
   int getMaxSpeedStep() const { return maxSpeedStep; } // Getter for external calibration
 
 private:
-  TMC2209Stepper driver;
-  AccelStepper stepper;
+  // Public methods may be called from loop() and from the dose scheduler task
+  class Guard {
+  public:
+    explicit Guard(SemaphoreHandle_t lock) : lock(lock) {
+      if (lock != nullptr) {
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+      }
+    }
+    ~Guard() {
+      if (lock != nullptr) {
+        xSemaphoreGiveRecursive(lock);
+      }
+    }
+
+  private:
+    SemaphoreHandle_t lock;
+  };
+
+  void applyCalibration();
+  float stepsPerMLAt(float speed) const;
+  void updateRamp(uint32_t now);
+  float trimmedSpeed() const { return min(targetSpeed * flowTrim, maxSpeed); }
+
+  TMC2209Registers driver;
+  StepEngine* engine;
+  SemaphoreHandle_t lock = nullptr;
   uint8_t enPin;
+  float maxSpeed = 4000;
+  SpeedRamp ramp;
+  uint32_t lastRampUpdate = 0;
   bool enabled = false;
-  float currentSpeed = 0;
+  bool dosing = false;
+  bool lowPower = false;
+  bool doseBraking = false;
+  volatile bool testing = false;
+  uint32_t doseEndStep = 0;
+  float targetSpeed = 0;
+  float flowTrim = 1;
+  float resumeSpeed = 0; // Target speed and trim from before the dose
+  float resumeTrim = 1;
   float stepsPerML = 0;
+  float baseStepsPerML = 0;
+  const CalibrationTable* calibrationTable = nullptr;
   int speedStep = 2000;
   int maxSpeedStep = 4000; // Maximum speed step
+  static const uint16_t RUN_CURRENT_MA = 500;
+  static constexpr float DEFAULT_ACCELERATION = 8000; // steps/sec^2
+  static constexpr float DOSE_CRAWL_FRACTION = 0.05f; // Doses finish at this fraction of their speed
+  static constexpr float DOSE_MIN_CRAWL_SPEED = 50;    // steps/sec
+};
+
+// Pins fixed at compile time: steps come from a hardware timer ISR in IRAM
+// and each edge is a single GPIO register write
+template <uint8_t StepPin, uint8_t DirPin, uint8_t EnPin>
+class FastPumpController : public PumpController {
+  static_assert(isOutputCapable(EnPin), "Enable pin cannot drive an output");
+
+public:
+  FastPumpController(Stream* serialPort, float rSense, uint8_t addr)
+      : PumpController(serialPort, timerEngine, EnPin, rSense, addr) {}
+
+private:
+  TimerStepEngine<StepPin, DirPin> timerEngine;
 };
 
 #endif
\ No newline at end of file
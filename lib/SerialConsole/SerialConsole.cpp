@@ -0,0 +1,116 @@
+#include "SerialConsole.h"
+#include <stdlib.h>
+
+bool SerialConsole::add(const char *name, const char *usage, Handler handler)
+{
+  if (commandCount >= MAX_COMMANDS)
+    return false;
+  commands[commandCount++] = {name, usage, handler};
+  return true;
+}
+
+void SerialConsole::poll()
+{
+  for (size_t budget = BYTES_PER_POLL; budget > 0 && io.available() > 0; budget--)
+  {
+    char c = io.read();
+    if (c == '\r' || c == '\n')
+    {
+      bool complete = length > 0 && !overflow;
+      if (overflow)
+        io.println("error: line too long");
+      overflow = false;
+      if (complete)
+      {
+        line[length] = '\0';
+        length = 0;
+        run();
+        return; // The rest waits for the next pass
+      }
+      length = 0;
+    }
+    else if (overflow)
+    {
+      continue;
+    }
+    else if (length < LINE_SIZE - 1)
+    {
+      line[length++] = c;
+    }
+    else
+    {
+      overflow = true;
+      length = 0;
+    }
+  }
+}
+
+void SerialConsole::run()
+{
+  char *argv[MAX_ARGS];
+  int argc = 0;
+  char *cursor = line;
+  for (;;)
+  {
+    while (*cursor == ' ' || *cursor == '\t')
+      cursor++;
+    if (*cursor == '\0')
+      break;
+    if (argc == (int)MAX_ARGS)
+    {
+      io.println("error: too many arguments");
+      return;
+    }
+    argv[argc++] = cursor;
+    while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t')
+      cursor++;
+    if (*cursor != '\0')
+      *cursor++ = '\0';
+  }
+  if (argc == 0)
+    return;
+
+  if (strcmp(argv[0], "help") == 0)
+  {
+    printHelp();
+    return;
+  }
+  for (size_t i = 0; i < commandCount; i++)
+  {
+    if (strcmp(argv[0], commands[i].name) == 0)
+    {
+      commands[i].handler(argc, argv, io);
+      return;
+    }
+  }
+  io.printf("error: unknown command '%s', try help\n", argv[0]);
+}
+
+void SerialConsole::printHelp()
+{
+  for (size_t i = 0; i < commandCount; i++)
+    io.printf("%-9s %s\n", commands[i].name, commands[i].usage);
+}
+
+bool SerialConsole::parseFloat(const char *text, float &value)
+{
+  char *end;
+  float parsed = strtof(text, &end);
+  if (end == text || *end != '\0' || isnan(parsed) || isinf(parsed))
+    return false;
+  value = parsed;
+  return true;
+}
+
+bool SerialConsole::parseUInt(const char *text, uint32_t &value)
+{
+  if (*text == '-')
+    return false;
+  int base = text[0] == '0' && (text[1] == 'x' || text[1] == 'X') ? 16 : 10; // No octal surprises
+  char *end;
+  unsigned long parsed = strtoul(text, &end, base);
+  if (end == text || *end != '\0')
+    return false;
+  value = parsed;
+  return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SERIAL_CONSOLE_H
+#define SERIAL_CONSOLE_H
+
+#include <Arduino.h>
+
+// Line-based command console on a serial port, for bench work and for host
+// tools that drive the firmware.
+//
+// poll() never waits: it takes at most BYTES_PER_POLL bytes of whatever has
+// arrived and runs at most one complete line, so a long paste is spread over
+// many loop() passes. Lines are split into arguments in place and looked up
+// in a fixed command table; nothing is allocated.
+class SerialConsole
+{
+public:
+  // argv[0] is the command name
+  typedef void (*Handler)(int argc, char *argv[], Print &out);
+
+  static const size_t MAX_COMMANDS = 16;
+  static const size_t MAX_ARGS = 8;
+  static const size_t LINE_SIZE = 128;
+  static const size_t BYTES_PER_POLL = 64;
+
+  explicit SerialConsole(Stream &io) : io(io) {}
+
+  // name and usage must be literals. "help" is built in.
+  bool add(const char *name, const char *usage, Handler handler);
+  void poll();
+
+  // Whole-string parsers for handler arguments
+  static bool parseFloat(const char *text, float &value);
+  static bool parseUInt(const char *text, uint32_t &value); // Decimal, or hex with 0x
+
+private:
+  struct Command
+  {
+    const char *name;
+    const char *usage;
+    Handler handler;
+  };
+
+  void run();
+  void printHelp();
+
+  Stream &io;
+  Command commands[MAX_COMMANDS];
+  size_t commandCount = 0;
+  char line[LINE_SIZE];
+  size_t length = 0;
+  bool overflow = false; // Dropping the rest of a line that was too long
+};
+
+#endif
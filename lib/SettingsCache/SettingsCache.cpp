@@ -0,0 +1,41 @@
+#include "SettingsCache.h"
+#include <Fnv1a.h>
+
+void SettingsCache::begin(const char *nvsNamespace)
+{
+  prefs.begin(nvsNamespace, false);
+  rev = prefs.getString("rev", "");
+  doc = prefs.getString("doc", "");
+  if (rev.length() == 0)
+    doc = "";
+}
+
+bool SettingsCache::store(const String &body, String revision)
+{
+  if (revision.length() == 0)
+    revision = hashRevision(body);
+  if (revision == rev)
+    return false;
+
+  rev = revision;
+  doc = body;
+  if (body.length() > MAX_DOCUMENT)
+  {
+    // Too big to keep, drop the stale copy so it is never applied
+    prefs.remove("doc");
+    prefs.remove("rev");
+    return true;
+  }
+  // Document first: a reset in between leaves the old revision, which only
+  // costs a full fetch next time
+  prefs.putString("doc", body);
+  prefs.putString("rev", revision);
+  return true;
+}
+
+String SettingsCache::hashRevision(const String &body)
+{
+  char text[9];
+  snprintf(text, sizeof(text), "%08x", fnv1a(body.c_str(), body.length()));
+  return String(text);
+}
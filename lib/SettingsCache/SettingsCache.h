@@ -0,0 +1,37 @@
+#ifndef SETTINGS_CACHE_H
+#define SETTINGS_CACHE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Last settings document received from the backend, kept in NVS so the pump
+// starts from the server's settings even when the server is unreachable.
+// The revision is sent back on the next fetch; the backend answers with an
+// empty body (304) when nothing changed, so revalidating is one cheap request.
+//
+// Documents are stored in their own NVS key rather than in the EEPROM
+// emulation, which rewrites its whole blob on every commit.
+class SettingsCache
+{
+public:
+  static const size_t MAX_DOCUMENT = 2048; // Larger documents are applied but not cached
+
+  void begin(const char *nvsNamespace);
+
+  bool hasDocument() const { return doc.length() > 0; }
+  const String &document() const { return doc; }
+  const String &revision() const { return rev; }
+
+  // Caches body unless revision matches the cached one. Returns true if the
+  // document changed. An empty revision is replaced by a hash of the body.
+  bool store(const String &body, String revision);
+
+  static String hashRevision(const String &body);
+
+private:
+  Preferences prefs;
+  String doc;
+  String rev;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "SpeedRamp.h"
+#include <math.h>
+
+using SpeedRampCurve::TABLE;
+using SpeedRampCurve::LAUNCH;
+using SpeedRampCurve::LIMIT;
+using SpeedRampCurve::RATIOS;
+
+void SpeedRamp::setTarget(uint32_t targetQ16, uint32_t nowMs)
+{
+  if (ramping && targetQ16 == targetRate)
+    return;
+  float startAcceleration = 0;
+  uint32_t previousDuration = duration;
+  if (ramping)
+  {
+    update(nowMs);
+    startAcceleration = accelerationAt(nowMs);
+  }
+  targetRate = targetQ16;
+  startRate = currentRate;
+  startMs = nowMs;
+  if (acceleration <= 0)
+  {
+    reset(targetRate);
+    return;
+  }
+
+  // Mean acceleration that keeps the peak at the limit, given what the
+  // interrupted segment was doing, then at least |a0| / limit of its time
+  float delta = ((float)targetRate - (float)startRate) / (1 << 16);
+  float a0 = fmaxf(-acceleration, fminf(startAcceleration, acceleration));
+  float ratio = (delta < 0 ? -a0 : a0) / acceleration;
+  float position = (ratio + 1) * (RATIOS / 2.0f);
+  size_t index = position >= RATIOS ? RATIOS - 1 : (size_t)position;
+  float meanLimit = LIMIT[index] + (LIMIT[index + 1] - LIMIT[index]) * (position - index);
+  float ms = fabsf(delta) / (meanLimit * acceleration) * 1000.0f;
+  ms = fmaxf(ms, fabsf(a0) / acceleration * previousDuration);
+  if (ms < 1)
+  {
+    reset(targetRate);
+    return;
+  }
+  duration = (uint32_t)(ms + 0.5f);
+  // The one division per setpoint change, so update() can multiply
+  phasePerMs = ((uint64_t)SpeedRampCurve::SEGMENTS << 32) / duration;
+  launchRate = (int64_t)(a0 * duration / 1000.0f * (1 << 16));
+  ramping = true;
+}
+
+void SpeedRamp::reset(uint32_t rateQ16)
+{
+  startRate = targetRate = currentRate = rateQ16;
+  launchRate = 0;
+  ramping = false;
+}
+
+uint32_t SpeedRamp::update(uint32_t nowMs)
+{
+  if (!ramping)
+    return currentRate;
+  uint32_t elapsed = nowMs - startMs;
+  if (elapsed >= duration)
+  {
+    currentRate = targetRate;
+    ramping = false;
+    return currentRate;
+  }
+
+  // Position in the table, Q16 segments, then linear between entries
+  uint32_t position = (uint32_t)((elapsed * phasePerMs) >> 16);
+  uint32_t index = position >> 16;
+  uint32_t weight = position & 0xFFFF;
+  uint32_t s = TABLE[index] + (uint32_t)(((uint64_t)(TABLE[index + 1] - TABLE[index]) * weight) >> 16);
+  int64_t g = (int64_t)LAUNCH[index] + ((((int64_t)LAUNCH[index + 1] - (int64_t)LAUNCH[index]) * weight) >> 16);
+
+  int64_t delta = (int64_t)targetRate - (int64_t)startRate;
+  int64_t rate = (int64_t)startRate + ((delta * (int64_t)s + launchRate * g) >> SpeedRampCurve::BITS);
+  currentRate = rate > 0 ? (uint32_t)rate : 0;
+  return currentRate;
+}
+
+// Slope of update()'s curve. Only needed when a retarget starts a segment.
+float SpeedRamp::accelerationAt(uint32_t nowMs) const
+{
+  uint32_t elapsed = nowMs - startMs;
+  if (!ramping || elapsed >= duration)
+    return 0;
+  float x = (float)elapsed / duration;
+  float delta = ((float)targetRate - (float)startRate) / (1 << 16);
+  float launched = (float)launchRate / (1 << 16);
+  return (delta * (float)SpeedRampCurve::shapeSlope(x) + launched * (float)SpeedRampCurve::launchSlope(x)) /
+         (duration / 1000.0f);
+}
+
+uint32_t SpeedRamp::stoppingSteps(uint32_t rateQ16) const
+{
+  if (acceleration <= 0)
+    return 0;
+  // The S-curve is point symmetric, so the mean speed over the ramp is half
+  // the start speed: steps = v/2 * t, with t = PEAK_TO_MEAN * v / a
+  float v = (float)rateQ16 / (1 << 16);
+  return (uint32_t)(PEAK_TO_MEAN * v * v / (2 * acceleration) + 0.5f);
+}
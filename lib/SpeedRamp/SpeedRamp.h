@@ -0,0 +1,119 @@
+#ifndef SPEED_RAMP_H
+#define SPEED_RAMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+
+namespace SpeedRampCurve
+{
+  static const size_t SEGMENTS = 64;
+  static const int BITS = 16;      // Table values are Q16, 0 to 1 << 16
+  static const size_t RATIOS = 32; // LIMIT entries, start acceleration -1 to 1 times the limit
+
+  // The speed change, s(x) = 10x^3 - 15x^4 + 6x^5
+  constexpr double shape(double x) { return x * x * x * (10 + x * (-15 + 6 * x)); }
+  constexpr double shapeSlope(double x) { return 30 * x * x * (1 - x) * (1 - x); }
+  // Winds down the acceleration a retarget starts with, g(x) = x(1-x)^3(1+3x):
+  // slope 1 at the start, back to 0 with zero slope and curvature at the end
+  constexpr double launch(double x) { return x * (1 - x) * (1 - x) * (1 - x) * (1 + 3 * x); }
+  constexpr double launchSlope(double x) { return 1 + x * x * (-18 + x * (32 - 15 * x)); }
+
+  constexpr std::array<uint32_t, SEGMENTS + 1> build(double (*curve)(double))
+  {
+    std::array<uint32_t, SEGMENTS + 1> table{};
+    for (size_t i = 0; i <= SEGMENTS; i++)
+      table[i] = (uint32_t)(curve((double)i / SEGMENTS) * (1 << BITS) + 0.5);
+    return table;
+  }
+
+  // Largest mean acceleration, as a fraction of the limit, that keeps s and g
+  // together within the limit. Indexed by the start acceleration in the
+  // direction of the change, -1 to 1 times the limit. The entries are
+  // concave in between, so interpolating them errs on the slow side.
+  constexpr std::array<float, RATIOS + 1> buildLimit()
+  {
+    std::array<float, RATIOS + 1> limit{};
+    for (size_t r = 0; r <= RATIOS; r++)
+    {
+      double ratio = -1 + 2.0 * r / RATIOS;
+      double lowest = 1e9;
+      for (size_t i = 1; i < SEGMENTS; i++)
+      {
+        double x = (double)i / SEGMENTS;
+        double fraction = (1 - ratio * launchSlope(x)) / shapeSlope(x);
+        lowest = fraction < lowest ? fraction : lowest;
+      }
+      limit[r] = (float)lowest;
+    }
+    return limit;
+  }
+
+  // Computed by the compiler, land in flash as plain tables
+  constexpr std::array<uint32_t, SEGMENTS + 1> TABLE = build(shape);
+  constexpr std::array<uint32_t, SEGMENTS + 1> LAUNCH = build(launch);
+  constexpr std::array<float, RATIOS + 1> LIMIT = buildLimit();
+  static_assert(TABLE[0] == 0 && TABLE[SEGMENTS] == 1 << BITS, "S-curve must span 0 to 1");
+  static_assert(TABLE[SEGMENTS / 2] == 1 << (BITS - 1), "S-curve must be symmetric");
+  static_assert(LAUNCH[0] == 0 && LAUNCH[SEGMENTS] == 0, "Launch curve must end where it starts");
+}
+
+// Jerk-limited speed ramp. A speed change follows the quintic S-curve
+// s(x) = 10x^3 - 15x^4 + 6x^5, which starts and ends with zero acceleration
+// and zero jerk, stretched over the time that keeps the peak acceleration at
+// the configured limit.
+//
+// A retarget mid-ramp also carries the acceleration a0 it interrupts: the
+// new segment adds a0 * T * g(x), so the acceleration stays continuous and
+// winds down to zero by the end instead of dropping in one step. The segment
+// lasts at least |a0| / limit of the interrupted one, which keeps its jerk in
+// line with that segment's. While a0 winds down the speed can pass the
+// target and come back to it.
+//
+// The curves are constexpr tables, so update() is table lookups and
+// multiplies with no division or floating point. Rates are Q16.16
+// steps/sec, the same units as StepTimer.
+//
+// Kept free of Arduino headers so it builds on the host.
+class SpeedRamp
+{
+public:
+  // Peak acceleration of the quintic is 15/8 of the average over the ramp
+  static constexpr float PEAK_TO_MEAN = 15.0f / 8.0f;
+
+  void setAcceleration(float stepsPerSecond2) { acceleration = stepsPerSecond2; }
+  float getAcceleration() const { return acceleration; }
+
+  // Starts a new ramp from the current speed and acceleration. Setting the
+  // target already being ramped to leaves the ramp alone. With no
+  // acceleration set the speed jumps.
+  void setTarget(uint32_t targetQ16, uint32_t nowMs);
+  // Jumps straight to rateQ16, e.g. on an emergency stop
+  void reset(uint32_t rateQ16);
+
+  // Advances the ramp and returns the speed at nowMs
+  uint32_t update(uint32_t nowMs);
+
+  uint32_t current() const { return currentRate; }
+  uint32_t target() const { return targetRate; }
+  bool isRamping() const { return ramping; }
+  uint32_t durationMs() const { return duration; }
+  float accelerationAt(uint32_t nowMs) const; // steps/sec^2, 0 when not ramping
+
+  // Steps covered while ramping from rateQ16 down to nothing, used to start
+  // decelerating in time for a dose to end
+  uint32_t stoppingSteps(uint32_t rateQ16) const;
+
+private:
+  float acceleration = 0; // steps/sec^2
+  uint32_t startRate = 0;
+  uint32_t targetRate = 0;
+  uint32_t currentRate = 0;
+  uint32_t startMs = 0;
+  uint32_t duration = 0;
+  uint64_t phasePerMs = 0; // Table position per ms, Q16 segments
+  int64_t launchRate = 0;  // a0 * T in Q16.16 steps/sec, the scale of g(x)
+  bool ramping = false;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+
+#include <Arduino.h>
+#include <soc/gpio_struct.h>
+
+// GPIO 34-39 are input only, 6-11 are wired to the SPI flash
+constexpr bool isOutputCapable(uint8_t pin)
+{
+  return pin < 34 && (pin < 6 || pin > 11);
+}
+
+// Compile-time GPIO. Each write is a single store to the W1TS/W1TC register,
+// and pin numbers that cannot drive an output fail to compile.
+template <uint8_t Pin>
+struct FastPin
+{
+  static_assert(isOutputCapable(Pin), "GPIO cannot drive an output");
+
+  static inline void IRAM_ATTR high()
+  {
+    if (Pin < 32)
+      GPIO.out_w1ts = 1u << (Pin & 31);
+    else
+      GPIO.out1_w1ts.val = 1u << (Pin & 31);
+  }
+
+  static inline void IRAM_ATTR low()
+  {
+    if (Pin < 32)
+      GPIO.out_w1tc = 1u << (Pin & 31);
+    else
+      GPIO.out1_w1tc.val = 1u << (Pin & 31);
+  }
+
+  static void configureOutput(bool level)
+  {
+    pinMode(Pin, OUTPUT);
+    digitalWrite(Pin, level);
+  }
+};
+
+#endif
@@ -0,0 +1,29 @@
+#include "StepEngine.h"
+
+void LoopStepEngine::begin()
+{
+  pinMode(stepPin, OUTPUT);
+  digitalWrite(stepPin, LOW);
+  pinMode(dirPin, OUTPUT);
+  digitalWrite(dirPin, HIGH); // The pump only runs forward
+}
+
+void LoopStepEngine::stopAt(uint32_t count)
+{
+  stopCount = count;
+  hasStopAt = true;
+  if ((int32_t)(steps - stopCount) >= 0)
+    timer.stop();
+}
+
+void LoopStepEngine::poll()
+{
+  if (!timer.due(micros()))
+    return;
+  digitalWrite(stepPin, HIGH);
+  delayMicroseconds(STEP_PULSE_US);
+  digitalWrite(stepPin, LOW);
+  steps++;
+  if (hasStopAt && steps == stopCount)
+    timer.stop();
+}
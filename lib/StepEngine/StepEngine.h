@@ -0,0 +1,50 @@
+#ifndef STEP_ENGINE_H
+#define STEP_ENGINE_H
+
+#include <Arduino.h>
+#include <StepTimer.h>
+
+// Produces step pulses at a commanded rate. Implementations differ in where
+// the pulses come from: LoopStepEngine steps from poll() in loop(), while
+// TimerStepEngine steps from a hardware timer interrupt. Virtual calls happen
+// on setpoint changes and polls only, never per pulse.
+class StepEngine
+{
+public:
+  virtual ~StepEngine() {}
+
+  virtual void begin() = 0;
+  virtual void setRate(uint32_t rateQ16) = 0; // Q16.16 steps/sec, 0 stops
+  virtual void stopAt(uint32_t count) = 0;    // Stop by itself once stepCount() reaches count
+  virtual void clearStopAt() = 0;
+  virtual void poll() {}
+  virtual uint32_t stepCount() const = 0;
+  virtual bool isRunning() const = 0;
+};
+
+// Runtime pins, digitalWrite() pulses timed by StepTimer from loop()
+class LoopStepEngine : public StepEngine
+{
+public:
+  LoopStepEngine(uint8_t stepPin, uint8_t dirPin) : stepPin(stepPin), dirPin(dirPin) {}
+
+  void begin() override;
+  void setRate(uint32_t rateQ16) override { timer.setRate(rateQ16, micros()); }
+  void stopAt(uint32_t count) override;
+  void clearStopAt() override { hasStopAt = false; }
+  void poll() override;
+  uint32_t stepCount() const override { return steps; }
+  bool isRunning() const override { return timer.isRunning(); }
+
+private:
+  static const uint8_t STEP_PULSE_US = 1; // TMC2209 needs >100 ns
+
+  uint8_t stepPin;
+  uint8_t dirPin;
+  StepTimer timer;
+  uint32_t steps = 0;
+  uint32_t stopCount = 0;
+  bool hasStopAt = false;
+};
+
+#endif
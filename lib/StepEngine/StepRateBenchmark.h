@@ -0,0 +1,82 @@
+#ifndef STEP_RATE_BENCHMARK_H
+#define STEP_RATE_BENCHMARK_H
+
+#include <Arduino.h>
+#include "StepEngine.h"
+#include "TimerStepEngine.h"
+
+// Measures what each step path can sustain on this board. Run with the driver
+// disabled: the step pin toggles but the motor does not move. Prints the cost
+// of one pulse edge pair, then sweeps commanded rates and reports the rate
+// each engine actually delivered. The loop engine is measured with nothing
+// else in loop(), so it is an upper bound for that variant.
+template <uint8_t StepPin, uint8_t DirPin>
+void runStepRateBenchmark(Print &out, uint8_t enablePin)
+{
+  static const uint32_t PULSES = 10000;
+  static const uint32_t WINDOW_MS = 250;
+  static const uint32_t rates[] = {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000};
+
+  pinMode(enablePin, OUTPUT);
+  digitalWrite(enablePin, HIGH); // Driver off
+
+  // Edge cost, runtime pin number vs compile-time pin
+  volatile uint8_t runtimePin = StepPin; // Keeps the compiler from folding the pin
+  pinMode(StepPin, OUTPUT);
+  uint32_t start = ESP.getCycleCount();
+  for (uint32_t i = 0; i < PULSES; i++)
+  {
+    digitalWrite(runtimePin, HIGH);
+    digitalWrite(runtimePin, LOW);
+  }
+  uint32_t runtimeCycles = (ESP.getCycleCount() - start) / PULSES;
+  start = ESP.getCycleCount();
+  for (uint32_t i = 0; i < PULSES; i++)
+  {
+    FastPin<StepPin>::high();
+    FastPin<StepPin>::low();
+  }
+  uint32_t fastCycles = (ESP.getCycleCount() - start) / PULSES;
+
+  out.printf("Step pulse cost @ %u MHz: digitalWrite %u cycles, register %u cycles\n",
+             getCpuFrequencyMhz(), runtimeCycles, fastCycles);
+
+  LoopStepEngine loopEngine(StepPin, DirPin);
+  TimerStepEngine<StepPin, DirPin, 1, 0> timerEngine; // Group 1, the pump owns group 0
+  loopEngine.begin();
+  timerEngine.begin();
+
+  uint32_t maxLoop = 0;
+  uint32_t maxTimer = 0;
+  out.println("commanded  loop     timer    timer resyncs");
+  for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+  {
+    uint32_t rate = StepTimer::toRate(rates[i]);
+
+    uint32_t before = loopEngine.stepCount();
+    loopEngine.setRate(rate);
+    uint32_t began = millis();
+    while (millis() - began < WINDOW_MS)
+      loopEngine.poll();
+    loopEngine.setRate(0);
+    uint32_t loopRate = (loopEngine.stepCount() - before) * 1000 / WINDOW_MS;
+
+    before = timerEngine.stepCount();
+    uint32_t resyncs = timerEngine.resyncCount();
+    timerEngine.setRate(rate);
+    delay(WINDOW_MS);
+    timerEngine.setRate(0);
+    uint32_t timerRate = (timerEngine.stepCount() - before) * 1000 / WINDOW_MS;
+    resyncs = timerEngine.resyncCount() - resyncs;
+
+    // Sustained means within 0.5% of the commanded rate (the window edges cost a step or two)
+    if (loopRate * 1000 >= rates[i] * 995)
+      maxLoop = rates[i];
+    if (timerRate * 1000 >= rates[i] * 995 && resyncs == 0)
+      maxTimer = rates[i];
+    out.printf("%-10u %-8u %-8u %u\n", rates[i], loopRate, timerRate, resyncs);
+  }
+  out.printf("Max sustained steps/sec: loop %u, timer ISR %u\n", maxLoop, maxTimer);
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include "StepSelfTest.h"
+#include <esp_timer.h>
+
+#define SELF_TEST_PCNT_UNIT PCNT_UNIT_0
+#define SELF_TEST_CAPTURE_UNIT MCPWM_UNIT_0
+#define SELF_TEST_CAPTURE_CHANNEL MCPWM_SELECT_CAP0
+#define SETTLE_MS 20
+
+bool IRAM_ATTR StepSelfTest::onCapture(mcpwm_unit_t, mcpwm_capture_channel_id_t, const cap_event_data_t *event, void *arg)
+{
+  StepSelfTest *self = static_cast<StepSelfTest *>(arg);
+  uint32_t now = event->cap_value;
+  if (self->haveLast)
+  {
+    uint32_t interval = now - self->lastCapture;
+    uint32_t error = interval > self->idealTicks ? interval - self->idealTicks : self->idealTicks - interval;
+    uint32_t bucket = error / self->bucketTicks;
+    self->histogram[bucket < BUCKETS ? bucket : BUCKETS]++;
+    if (error > self->maxErrorTicks)
+      self->maxErrorTicks = error;
+    self->captures++;
+  }
+  self->lastCapture = now;
+  self->haveLast = true;
+  return false;
+}
+
+void IRAM_ATTR StepSelfTest::onPcntLimit(void *arg)
+{
+  static_cast<StepSelfTest *>(arg)->pcntOverflows++; // The counter restarts from 0 by itself
+}
+
+// The capture interrupt is allocated on the core that enables the channel.
+// Core 0 keeps it away from the step timer ISR on core 1.
+void StepSelfTest::captureTask(void *arg)
+{
+  StepSelfTest *self = static_cast<StepSelfTest *>(arg);
+  mcpwm_capture_config_t config = {};
+  config.cap_edge = MCPWM_POS_EDGE;
+  config.cap_prescale = 1;
+  config.capture_cb = onCapture;
+  config.user_data = self;
+  mcpwm_capture_enable_channel(SELF_TEST_CAPTURE_UNIT, SELF_TEST_CAPTURE_CHANNEL, &config);
+  self->started = true;
+  vTaskDelete(nullptr);
+}
+
+bool StepSelfTest::begin()
+{
+  pcnt_config_t counter = {};
+  counter.pulse_gpio_num = stepPin;
+  counter.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  counter.channel = PCNT_CHANNEL_0;
+  counter.unit = SELF_TEST_PCNT_UNIT;
+  counter.pos_mode = PCNT_COUNT_INC;
+  counter.neg_mode = PCNT_COUNT_DIS;
+  counter.lctrl_mode = PCNT_MODE_KEEP;
+  counter.hctrl_mode = PCNT_MODE_KEEP;
+  counter.counter_h_lim = PCNT_LIMIT;
+  counter.counter_l_lim = -1;
+  if (pcnt_unit_config(&counter) != ESP_OK)
+    return false;
+  pcnt_filter_disable(SELF_TEST_PCNT_UNIT);
+  pcnt_event_enable(SELF_TEST_PCNT_UNIT, PCNT_EVT_H_LIM);
+  pcnt_isr_service_install(0);
+  pcnt_isr_handler_add(SELF_TEST_PCNT_UNIT, onPcntLimit, this);
+
+  mcpwm_gpio_init(SELF_TEST_CAPTURE_UNIT, MCPWM_CAP_0, stepPin);
+  started = false;
+  xTaskCreatePinnedToCore(captureTask, "capture", 2048, this, 5, nullptr, 0);
+  while (!started)
+    delay(1);
+
+  // Both drivers turned the pin into an input, give it its output back
+  gpio_set_direction((gpio_num_t)stepPin, GPIO_MODE_INPUT_OUTPUT);
+  return true;
+}
+
+void StepSelfTest::end()
+{
+  mcpwm_capture_disable_channel(SELF_TEST_CAPTURE_UNIT, SELF_TEST_CAPTURE_CHANNEL);
+  pcnt_isr_handler_remove(SELF_TEST_PCNT_UNIT);
+  pcnt_event_disable(SELF_TEST_PCNT_UNIT, PCNT_EVT_H_LIM);
+  pcnt_counter_pause(SELF_TEST_PCNT_UNIT);
+  pinMode(stepPin, OUTPUT);
+}
+
+// Only exact while no pulses arrive, so it is read with the engine stopped
+uint32_t StepSelfTest::pulseCount()
+{
+  int16_t value = 0;
+  pcnt_get_counter_value(SELF_TEST_PCNT_UNIT, &value);
+  return pcntOverflows * PCNT_LIMIT + value;
+}
+
+void StepSelfTest::resetCapture(uint32_t stepsPerSecond)
+{
+  haveLast = false;
+  captures = 0;
+  maxErrorTicks = 0;
+  for (size_t i = 0; i <= BUCKETS; i++)
+    histogram[i] = 0;
+  idealTicks = CAPTURE_HZ / stepsPerSecond;
+  bucketTicks = max(idealTicks / BUCKETS_PER_INTERVAL, (uint32_t)1);
+}
+
+StepSelfTest::Point StepSelfTest::measure(uint32_t stepsPerSecond, uint32_t durationMs, const Load &load)
+{
+  Point point = {};
+  point.rate = stepsPerSecond;
+
+  pcnt_counter_pause(SELF_TEST_PCNT_UNIT);
+  pcnt_counter_clear(SELF_TEST_PCNT_UNIT);
+  pcntOverflows = 0;
+  resetCapture(stepsPerSecond);
+  pcnt_counter_resume(SELF_TEST_PCNT_UNIT);
+
+  uint32_t startSteps = engine.stepCount();
+  int64_t start = esp_timer_get_time();
+  engine.setRate(StepTimer::toRate(stepsPerSecond));
+  while (esp_timer_get_time() - start < (int64_t)durationMs * 1000)
+  {
+    engine.poll();
+    if (load.work)
+      load.work();
+  }
+  engine.setRate(0);
+  int64_t elapsed = esp_timer_get_time() - start;
+  delay(SETTLE_MS);
+
+  uint32_t pulses = pulseCount();
+  uint32_t steps = engine.stepCount() - startSteps;
+  point.achieved = pulses * 1000000.0f / elapsed;
+  point.lostSteps = steps > pulses ? steps - pulses : 0;
+
+  // Missed captures show up as fewer intervals than pulses
+  point.jitterKnown = pulses > 1 && captures >= pulses - 1;
+  if (point.jitterKnown)
+  {
+    uint32_t threshold = captures - captures / 100;
+    uint32_t seen = 0;
+    size_t bucket = 0;
+    for (; bucket < BUCKETS; bucket++)
+    {
+      seen += histogram[bucket];
+      if (seen >= threshold)
+        break;
+    }
+    // Upper edge of the bucket. Past the last one only the maximum is known.
+    uint32_t p99Ticks = bucket < BUCKETS ? (bucket + 1) * bucketTicks : maxErrorTicks;
+    point.p99JitterUs = p99Ticks * 1e6f / CAPTURE_HZ;
+    point.maxJitterUs = maxErrorTicks * 1e6f / CAPTURE_HZ;
+  }
+
+  float intervalUs = 1e6f / stepsPerSecond;
+  point.passed = point.lostSteps == 0 && point.achieved >= stepsPerSecond * (1 - MAX_RATE_ERROR) &&
+                 point.achieved <= stepsPerSecond * (1 + MAX_RATE_ERROR) &&
+                 (!point.jitterKnown || point.p99JitterUs <= intervalUs * MAX_JITTER_FRACTION);
+  return point;
+}
+
+uint32_t StepSelfTest::sweep(Print &out, const uint32_t *rates, size_t rateCount, const Load *loads, size_t loadCount,
+                             uint32_t durationMs)
+{
+  uint32_t safe = 0;
+  bool allPassed = true;
+  out.println("rate     load      achieved  lost  p99 us  max us  result");
+  for (size_t r = 0; r < rateCount && allPassed; r++)
+  {
+    for (size_t l = 0; l < loadCount; l++)
+    {
+      Point point = measure(rates[r], durationMs, loads[l]);
+      out.printf("%-8u %-9s %-9.0f %-5u ", (unsigned)point.rate, loads[l].name, point.achieved, (unsigned)point.lostSteps);
+      if (point.jitterKnown)
+        out.printf("%-7.1f %-7.1f ", point.p99JitterUs, point.maxJitterUs);
+      else
+        out.print("n/a     n/a     ");
+      out.println(point.passed ? "ok" : "FAIL");
+      allPassed = allPassed && point.passed;
+    }
+    if (allPassed)
+      safe = rates[r];
+  }
+  return safe;
+}
@@ -0,0 +1,83 @@
+#ifndef STEP_SELF_TEST_H
+#define STEP_SELF_TEST_H
+
+#include <Arduino.h>
+#include <functional>
+#include <driver/mcpwm.h>
+#include <driver/pcnt.h>
+#include "StepEngine.h"
+
+// Measures what the step path actually delivers on the step pin, with the
+// production engine and under the loads the firmware really sees. The driver
+// must be disabled: the pin toggles, the motor does not move.
+//
+// The pin is read back while it drives. PCNT counts every pulse, which gives
+// the achieved rate and catches pulses the engine counted but never produced.
+// An MCPWM capture channel timestamps each rising edge at 80 MHz in hardware;
+// its interrupt, on the other core from the step ISR, bins the error of each
+// interval against the ideal one. At rates where the capture interrupt cannot
+// keep up, jitter is reported as unknown and only the rate is judged.
+class StepSelfTest
+{
+public:
+  struct Load
+  {
+    const char *name;
+    std::function<void()> work; // Called over and over during a measurement, may be empty
+  };
+
+  struct Point
+  {
+    uint32_t rate;      // Commanded, steps/sec
+    float achieved;     // Pulses seen on the pin per second
+    uint32_t lostSteps; // Counted by the engine but not seen on the pin
+    bool jitterKnown;   // Every interval was captured
+    float p99JitterUs;  // 99th percentile of |interval - ideal|
+    float maxJitterUs;
+    bool passed;
+  };
+
+  // Limits for a point to pass
+  static constexpr float MAX_RATE_ERROR = 0.01f;     // Achieved within 1% of commanded
+  static constexpr float MAX_JITTER_FRACTION = 0.25f; // p99 jitter within a quarter interval
+
+  StepSelfTest(StepEngine &engine, uint8_t stepPin) : engine(engine), stepPin(stepPin) {}
+
+  bool begin(); // Sets up PCNT and capture on the step pin
+  void end();
+
+  Point measure(uint32_t stepsPerSecond, uint32_t durationMs, const Load &load);
+
+  // Measures every rate under every load, prints a table and returns the
+  // highest rate that passed under all loads, with all lower rates passing too
+  uint32_t sweep(Print &out, const uint32_t *rates, size_t rateCount, const Load *loads, size_t loadCount,
+                 uint32_t durationMs);
+
+private:
+  static const int16_t PCNT_LIMIT = 30000;
+  static const uint32_t CAPTURE_HZ = 80000000; // APB clock
+  static const size_t BUCKETS = 64;
+  static const uint32_t BUCKETS_PER_INTERVAL = 256; // The buckets span a quarter interval, the jitter limit
+
+  static bool onCapture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel, const cap_event_data_t *event, void *arg);
+  static void onPcntLimit(void *arg);
+  static void captureTask(void *arg);
+  uint32_t pulseCount();
+  void resetCapture(uint32_t stepsPerSecond);
+
+  StepEngine &engine;
+  uint8_t stepPin;
+  volatile bool started = false; // Set by the capture setup task
+
+  // Written from the interrupts
+  volatile uint32_t pcntOverflows = 0;
+  volatile uint32_t idealTicks = 0;
+  volatile uint32_t bucketTicks = 1;
+  volatile uint32_t lastCapture = 0;
+  volatile bool haveLast = false;
+  volatile uint32_t captures = 0;
+  volatile uint32_t maxErrorTicks = 0;
+  volatile uint32_t histogram[BUCKETS + 1];
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef TIMER_STEP_ENGINE_H
+#define TIMER_STEP_ENGINE_H
+
+#include <Arduino.h>
+#include <driver/timer.h>
+#include "StepEngine.h"
+#include "FastPin.h"
+
+// Steps from a hardware timer alarm instead of loop(). The ISR lives in IRAM,
+// so stepping carries on while the flash cache is off (EEPROM commits), and
+// with the pins fixed at compile time each edge is one register store. The
+// alarm is re-armed one interval at a time with the same remainder carry as
+// StepTimer, so there is one interrupt per step and no periodic tick.
+//
+// The timer runs at 1 MHz from the 80 MHz APB clock. DFS keeps APB at 80 MHz
+// as long as the minimum CPU frequency is 80 MHz or more.
+template <uint8_t StepPin, uint8_t DirPin, int Group = 0, int Index = 0>
+class TimerStepEngine : public StepEngine
+{
+public:
+  static const uint32_t TICK_HZ = 1000000;
+  static const uint32_t MIN_LEAD_US = 2; // An alarm closer than this could be missed
+
+  ~TimerStepEngine()
+  {
+    if (initialized)
+    {
+      timer_pause(group(), index());
+      timer_isr_callback_remove(group(), index());
+      timer_deinit(group(), index());
+    }
+  }
+
+  void begin() override
+  {
+    FastPin<StepPin>::configureOutput(LOW);
+    FastPin<DirPin>::configureOutput(HIGH); // The pump only runs forward
+
+    timer_config_t config = {};
+    config.alarm_en = TIMER_ALARM_EN;
+    config.counter_en = TIMER_PAUSE;
+    config.intr_type = TIMER_INTR_LEVEL;
+    config.counter_dir = TIMER_COUNT_UP;
+    config.auto_reload = TIMER_AUTORELOAD_DIS;
+    config.divider = APB_CLK_FREQ / TICK_HZ;
+    timer_init(group(), index(), &config);
+    timer_set_counter_value(group(), index(), 0);
+    timer_isr_callback_add(group(), index(), onAlarm, this, ESP_INTR_FLAG_IRAM);
+    initialized = true;
+  }
+
+  // The interval division happens here, in task context
+  void setRate(uint32_t rateQ16) override
+  {
+    if (rateQ16 != 0 && rateQ16 < StepTimer::MIN_RATE)
+      rateQ16 = StepTimer::MIN_RATE;
+    uint32_t base = 0;
+    uint32_t rem = 0;
+    if (rateQ16 != 0)
+    {
+      const uint64_t numerator = (uint64_t)TICK_HZ << StepTimer::RATE_FRACTION_BITS;
+      base = (uint32_t)(numerator / rateQ16);
+      rem = (uint32_t)(numerator % rateQ16);
+    }
+
+    portENTER_CRITICAL(&mux);
+    if (rateQ16 != rate && initialized)
+    {
+      rate = rateQ16;
+      baseInterval = base;
+      remainder = rem;
+      error = 0;
+      if (rate == 0)
+      {
+        halt();
+      }
+      else
+      {
+        uint64_t now = timer_group_get_counter_value_in_isr(group(), index());
+        // Keep the phase of a running schedule, start a new one a full interval out
+        if (!running)
+          lastAlarm = now;
+        alarm = lastAlarm + baseInterval;
+        if ((int64_t)(alarm - now) < (int64_t)MIN_LEAD_US)
+          alarm = now + MIN_LEAD_US;
+        timer_group_set_alarm_value_in_isr(group(), index(), alarm);
+        timer_group_enable_alarm_in_isr(group(), index());
+        if (!running)
+        {
+          running = true;
+          timer_group_set_counter_enable_in_isr(group(), index(), TIMER_START);
+        }
+      }
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void stopAt(uint32_t count) override
+  {
+    portENTER_CRITICAL(&mux);
+    stopCount = count;
+    hasStopAt = true;
+    if ((int32_t)(steps - stopCount) >= 0)
+      halt();
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void clearStopAt() override
+  {
+    portENTER_CRITICAL(&mux);
+    hasStopAt = false;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint32_t stepCount() const override { return steps; }
+  bool isRunning() const override { return running; }
+  uint32_t resyncCount() const { return resyncs; } // Alarms that fell behind and were pushed out
+
+private:
+  static constexpr timer_group_t group() { return (timer_group_t)Group; }
+  static constexpr timer_idx_t index() { return (timer_idx_t)Index; }
+
+  static bool IRAM_ATTR onAlarm(void *arg)
+  {
+    TimerStepEngine *self = static_cast<TimerStepEngine *>(arg);
+    FastPin<StepPin>::high();
+    portENTER_CRITICAL_ISR(&self->mux);
+    self->steps++;
+    if (self->hasStopAt && self->steps == self->stopCount)
+      self->halt();
+    else
+      self->scheduleNext();
+    portEXIT_CRITICAL_ISR(&self->mux);
+    // The bookkeeping above is the pulse width, well over the 100 ns the TMC2209 needs
+    FastPin<StepPin>::low();
+    return false;
+  }
+
+  // Called with mux held
+  void IRAM_ATTR scheduleNext()
+  {
+    lastAlarm = alarm;
+    alarm += baseInterval;
+    error += remainder;
+    if (error >= rate)
+    {
+      error -= rate;
+      alarm++;
+    }
+    uint64_t now = timer_group_get_counter_value_in_isr(group(), index());
+    if ((int64_t)(alarm - now) < (int64_t)MIN_LEAD_US)
+    {
+      // Fell behind, don't burst the missed steps out
+      alarm = now + MIN_LEAD_US;
+      error = 0;
+      resyncs++;
+    }
+    timer_group_set_alarm_value_in_isr(group(), index(), alarm);
+  }
+
+  // Called with mux held. Pausing the counter keeps the re-enabled alarm quiet.
+  void IRAM_ATTR halt()
+  {
+    timer_group_set_counter_enable_in_isr(group(), index(), TIMER_PAUSE);
+    running = false;
+    rate = 0;
+  }
+
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  bool initialized = false;
+  volatile bool running = false;
+  volatile uint32_t steps = 0;
+  uint32_t stopCount = 0;
+  bool hasStopAt = false;
+  uint32_t rate = 0;
+  uint32_t baseInterval = 0;
+  uint32_t remainder = 0;
+  uint32_t error = 0;
+  uint64_t alarm = 0;
+  uint64_t lastAlarm = 0;
+  volatile uint32_t resyncs = 0;
+};
+
+#endif
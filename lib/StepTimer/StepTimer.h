@@ -0,0 +1,87 @@
+#ifndef STEP_TIMER_H
+#define STEP_TIMER_H
+
+#include <stdint.h>
+
+// Integer step scheduler. The rate is Q16.16 steps/sec; the interval is split
+// into whole microseconds plus a remainder that is carried Bresenham-style, so
+// k steps always span exactly floor(k * 1e6 / rate) microseconds and a long
+// run lands on the commanded step count. Steps are scheduled from the previous
+// due time rather than from when the caller noticed, so loop latency does not
+// accumulate either. The only division happens in setRate().
+class StepTimer
+{
+public:
+  static const int RATE_FRACTION_BITS = 16;
+  static const uint32_t MAX_CATCH_UP_STEPS = 8; // Beyond this lag the schedule restarts
+  static const uint32_t MIN_RATE = 1 << (RATE_FRACTION_BITS - 4); // 1/16 step/sec keeps intervals in 32 bits
+
+  static uint32_t toRate(float stepsPerSecond)
+  {
+    return stepsPerSecond <= 0 ? 0 : (uint32_t)(stepsPerSecond * (1 << RATE_FRACTION_BITS) + 0.5f);
+  }
+
+  void setRate(uint32_t rateQ16, uint32_t nowUs)
+  {
+    if (rateQ16 != 0 && rateQ16 < MIN_RATE)
+      rateQ16 = MIN_RATE;
+    if (rateQ16 == rate)
+      return;
+    rate = rateQ16;
+    error = 0;
+    if (rate == 0)
+    {
+      running = false;
+      return;
+    }
+    const uint64_t numerator = 1000000ULL << RATE_FRACTION_BITS;
+    baseInterval = (uint32_t)(numerator / rate);
+    remainder = (uint32_t)(numerator % rate);
+    // Keep the phase of a running schedule, start a new one a full interval out
+    if (!running)
+      lastDue = nowUs;
+    nextDue = lastDue + baseInterval;
+    running = true;
+  }
+
+  // Returns true when a step is due and advances the schedule by one interval
+  inline bool due(uint32_t nowUs)
+  {
+    if (!running || (int32_t)(nowUs - nextDue) < 0)
+      return false;
+    if (nowUs - nextDue > baseInterval * MAX_CATCH_UP_STEPS)
+    {
+      // Stalled for too long, don't burst the missed steps out
+      nextDue = nowUs;
+      error = 0;
+      resyncs++;
+    }
+    lastDue = nextDue;
+    nextDue += baseInterval;
+    error += remainder;
+    if (error >= rate)
+    {
+      error -= rate;
+      nextDue++;
+    }
+    return true;
+  }
+
+  void stop() { running = false; rate = 0; }
+  bool isRunning() const { return running; }
+  uint32_t rateQ16() const { return rate; }
+  uint32_t intervalUs() const { return baseInterval; }
+  uint32_t resyncCount() const { return resyncs; }
+
+private:
+  uint32_t rate = 0;
+  uint32_t baseInterval = 0;
+  uint32_t remainder = 0;
+  uint32_t error = 0;
+  uint32_t nextDue = 0;
+  uint32_t lastDue = 0;
+  uint32_t resyncs = 0;
+  bool running = false;
+};
+
+#endif
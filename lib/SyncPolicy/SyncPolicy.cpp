@@ -0,0 +1,58 @@
+#include "SyncPolicy.h"
+#include <LinkQuality.h>
+
+SyncPolicy::SyncPolicy(const Config &config) : config(config), reconnectDelay(config.reconnectBaseMs) {}
+
+uint32_t SyncPolicy::syncInterval(const LinkQuality *link) const
+{
+  return link != nullptr ? link->syncInterval(config.syncIntervalMs) : config.syncIntervalMs;
+}
+
+size_t SyncPolicy::historyBatch(const LinkQuality *link) const
+{
+  return link != nullptr ? link->batchSize(config.historyBatch) : config.historyBatch;
+}
+
+bool SyncPolicy::syncDue(uint32_t now, const LinkQuality *link) const
+{
+  return now - lastSync >= syncInterval(link);
+}
+
+bool SyncPolicy::revalidateDue(uint32_t now) const
+{
+  return now - lastFetch >= config.revalidateIntervalMs;
+}
+
+bool SyncPolicy::reconnectDue(uint32_t now) const
+{
+  return now - lastReconnect >= reconnectDelay;
+}
+
+uint32_t SyncPolicy::reconnectStarted(uint32_t now, const LinkQuality &wifi, uint32_t random)
+{
+  uint32_t backoff = wifi.reconnectDelay(config.reconnectBaseMs, config.reconnectMaxMs);
+  reconnectDelay = backoff + random % (backoff / 4 + 1);
+  lastReconnect = now;
+  return reconnectDelay;
+}
+
+uint32_t SyncPolicy::remaining(uint32_t now, uint32_t since, uint32_t interval)
+{
+  uint32_t elapsed = now - since;
+  return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+uint32_t SyncPolicy::msUntilNext(uint32_t now, bool wifiConnected, const LinkQuality *link) const
+{
+  uint32_t next = remaining(now, lastSync, syncInterval(link));
+  uint32_t fetch = remaining(now, lastFetch, config.revalidateIntervalMs);
+  if (fetch < next)
+    next = fetch;
+  if (!wifiConnected)
+  {
+    uint32_t reconnect = remaining(now, lastReconnect, reconnectDelay);
+    if (reconnect < next)
+      next = reconnect;
+  }
+  return next;
+}
@@ -0,0 +1,64 @@
+#ifndef SYNC_POLICY_H
+#define SYNC_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+class LinkQuality;
+
+// When the pump talks to the backend: the sync and settings revalidation
+// timers, how many schedule executions one sync carries, and the WiFi
+// reconnect backoff. Pacing follows the WiFi link quality while WiFi is the
+// active link; pass nullptr for link otherwise and the base rates apply.
+//
+// Times are millis() values and may wrap. tools/fleet_sim runs the same
+// class, so its traffic follows any change made here.
+//
+// Builds on the host, with the tools/bench/host stub LinkQuality needs.
+class SyncPolicy
+{
+public:
+  struct Config
+  {
+    uint32_t syncIntervalMs;       // Between syncs on a good link
+    uint32_t revalidateIntervalMs; // Between conditional settings fetches
+    uint32_t reconnectBaseMs;      // First WiFi reconnect delay
+    uint32_t reconnectMaxMs;       // Cap on the reconnect backoff
+    size_t historyBatch;           // Schedule executions per sync on a good link
+  };
+
+  explicit SyncPolicy(const Config &config);
+
+  uint32_t syncInterval(const LinkQuality *link) const;
+  size_t historyBatch(const LinkQuality *link) const;
+
+  bool syncDue(uint32_t now, const LinkQuality *link) const;
+  void synced(uint32_t now) { lastSync = now; }
+  bool revalidateDue(uint32_t now) const;
+  void fetched(uint32_t now) { lastFetch = now; }
+
+  bool reconnectDue(uint32_t now) const;
+  // A connection attempt started. The next one waits the link's backoff
+  // plus up to a quarter of it again, picked by random, so pumps sharing an
+  // AP don't retry in step after it restarts. Returns the wait.
+  uint32_t reconnectStarted(uint32_t now, const LinkQuality &wifi, uint32_t random);
+  // Waits the current delay again without growing it, for the attempt at
+  // boot and when an earlier attempt is still running
+  void reconnectDeferred(uint32_t now) { lastReconnect = now; }
+  void connected() { reconnectDelay = config.reconnectBaseMs; }
+
+  // Time until the next sync, fetch or (while disconnected) reconnect falls
+  // due, for sleeping in between
+  uint32_t msUntilNext(uint32_t now, bool wifiConnected, const LinkQuality *link) const;
+
+private:
+  static uint32_t remaining(uint32_t now, uint32_t since, uint32_t interval);
+
+  Config config;
+  uint32_t lastSync = 0;
+  uint32_t lastFetch = 0;
+  uint32_t lastReconnect = 0;
+  uint32_t reconnectDelay;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel(uint32_t startTick) : current(startTick) {}
+
+void TimerWheel::schedule(Timer &timer, uint32_t expiresTick)
+{
+  if (timer.armed)
+    unlink(timer);
+  uint32_t delay = expiresTick - current;
+  if ((int32_t)delay <= 0)
+    expiresTick = current + 1; // Already due, fire on the next tick
+  else if (delay > MAX_DELAY)
+    expiresTick = current + MAX_DELAY;
+  timer.expires = expiresTick;
+  insert(timer);
+}
+
+void TimerWheel::cancel(Timer &timer)
+{
+  if (timer.armed)
+    unlink(timer);
+}
+
+// Picks the level by how far out the timer is, the slot by its expiry bits
+void TimerWheel::insert(Timer &timer)
+{
+  uint32_t delay = timer.expires - current;
+  int level = 0;
+  while (level < LEVELS - 1 && delay >= (1UL << (SLOT_BITS * (level + 1))))
+    level++;
+  Slot &slot = slots[level][(timer.expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+
+  timer.prev = nullptr;
+  timer.next = slot.head;
+  if (slot.head != nullptr)
+    slot.head->prev = &timer;
+  slot.head = &timer;
+  timer.armed = true;
+  armed++;
+}
+
+void TimerWheel::unlink(Timer &timer)
+{
+  if (timer.prev != nullptr)
+  {
+    timer.prev->next = timer.next;
+  }
+  else
+  {
+    // Head of its slot, find which one from the same placement rule
+    for (int level = 0; level < LEVELS; level++)
+    {
+      Slot &slot = slots[level][(timer.expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+      if (slot.head == &timer)
+      {
+        slot.head = timer.next;
+        break;
+      }
+    }
+  }
+  if (timer.next != nullptr)
+    timer.next->prev = timer.prev;
+  timer.next = timer.prev = nullptr;
+  timer.armed = false;
+  armed--;
+}
+
+// Moves the timers in the level's current slot down to finer levels
+void TimerWheel::cascade(int level)
+{
+  Slot &slot = slots[level][(current >> (SLOT_BITS * level)) & (SLOTS - 1)];
+  Timer *timer = slot.head;
+  slot.head = nullptr;
+  while (timer != nullptr)
+  {
+    Timer *next = timer->next;
+    armed--;
+    insert(*timer);
+    timer = next;
+  }
+}
+
+void TimerWheel::advance(uint32_t nowTick, Callback callback, void *context)
+{
+  while ((int32_t)(nowTick - current) > 0)
+  {
+    current++;
+    // Entering a new block of a level pulls that block's timers down
+    for (int level = 1; level < LEVELS && (current & ((1UL << (SLOT_BITS * level)) - 1)) == 0; level++)
+      cascade(level);
+
+    Slot &slot = slots[0][current & (SLOTS - 1)];
+    Timer *timer = slot.head;
+    slot.head = nullptr;
+    while (timer != nullptr)
+    {
+      Timer *next = timer->next;
+      if (next != nullptr)
+        next->prev = nullptr;
+      timer->next = timer->prev = nullptr;
+      timer->armed = false;
+      armed--;
+      // Detached before the callback, which may re-arm it anywhere
+      slot.head = next;
+      callback(*timer, context);
+      timer = slot.head;
+    }
+  }
+}
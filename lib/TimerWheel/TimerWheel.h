@@ -0,0 +1,64 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Hierarchical timing wheel: four levels of 64 slots, each level 64 times
+// coarser than the one below. Scheduling and cancelling are O(1) list
+// operations; advancing one tick touches a single level-0 slot, plus a
+// higher-level slot every 64 ticks that is redistributed ("cascaded") into
+// the finer levels. Timers are intrusive, so nothing is allocated.
+//
+// Expiries more than MAX_DELAY ticks out are clamped; the owner must check
+// whether a fired timer was really due and re-arm it if not.
+//
+// Kept free of Arduino headers so it builds on the host.
+class TimerWheel
+{
+public:
+  static const int SLOT_BITS = 6;
+  static const uint32_t SLOTS = 1 << SLOT_BITS;
+  static const int LEVELS = 4;
+  static const uint32_t MAX_DELAY = (1UL << (SLOT_BITS * LEVELS)) - 1;
+
+  struct Timer
+  {
+    Timer *next = nullptr;
+    Timer *prev = nullptr;
+    uint32_t expires = 0; // Tick the timer fires on
+    uint32_t id = 0;      // Free for the owner
+    bool armed = false;
+  };
+
+  typedef void (*Callback)(Timer &timer, void *context);
+
+  explicit TimerWheel(uint32_t startTick = 0);
+
+  void schedule(Timer &timer, uint32_t expiresTick); // Re-arms if already armed
+  void cancel(Timer &timer);
+
+  // Runs every tick up to and including nowTick, firing the timers that
+  // expire on each. Callbacks may schedule and cancel timers, including the
+  // one that fired.
+  void advance(uint32_t nowTick, Callback callback, void *context);
+
+  uint32_t now() const { return current; }
+  size_t armedCount() const { return armed; }
+
+private:
+  struct Slot
+  {
+    Timer *head = nullptr;
+  };
+
+  void insert(Timer &timer);
+  void unlink(Timer &timer);
+  void cascade(int level);
+
+  Slot slots[LEVELS][SLOTS];
+  uint32_t current;
+  size_t armed = 0;
+};
+
+#endif
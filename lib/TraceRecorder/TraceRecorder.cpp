@@ -0,0 +1,81 @@
+#include "TraceRecorder.h"
+
+#ifdef TRACE_ENABLED
+#include <esp_timer.h>
+
+#define DUMP_PROGRESS_LINES 32
+
+static TraceRecorder::Event events[TraceRecorder::CAPACITY];
+static uint32_t head = 0; // Total events claimed, the slot is head % CAPACITY
+static volatile bool paused = false;
+
+static const char *const ID_NAMES[TRACE_ID_COUNT] = {
+    "wifi-connect",
+    "http-request",
+    "display-flush",
+    "button",
+    "pump-run",
+    "sync",
+    "settings-fetch",
+    "scheduler-tick",
+};
+
+void IRAM_ATTR TraceRecorder::record(Type type, uint8_t id, uint8_t arg)
+{
+  if (paused)
+    return;
+  uint32_t index = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  Event &event = events[index & (CAPACITY - 1)];
+  event.us = (uint32_t)esp_timer_get_time();
+  event.type = type;
+  event.id = id;
+  event.core = xPortGetCoreID();
+  event.arg = arg;
+}
+
+const char *TraceRecorder::idName(uint8_t id)
+{
+  return id < TRACE_ID_COUNT ? ID_NAMES[id] : "unknown";
+}
+
+void TraceRecorder::dump(Print &out, const std::function<void()> &progress)
+{
+  paused = true;
+  delayMicroseconds(10); // Lets a record() that already claimed a slot finish
+
+  // The full clock, to unwrap the events' 32 bits against
+  int64_t now = esp_timer_get_time();
+  uint32_t total = head;
+  uint32_t count = total < CAPACITY ? total : CAPACITY;
+  out.printf("TRACE BEGIN 2 %lld %u %u %d\n", now, (unsigned)count, (unsigned)(total - count), portNUM_PROCESSORS);
+  for (uint8_t id = 0; id < TRACE_ID_COUNT; id++)
+    out.printf("TRACE NAME %u %s\n", id, ID_NAMES[id]);
+
+  for (uint32_t i = total - count; i != total; i++)
+  {
+    const Event &event = events[i & (CAPACITY - 1)];
+    out.printf("TRACE EV %08x %02x %02x %02x %02x\n", (unsigned)event.us, event.type, event.id, event.core, event.arg);
+    if (progress && (i % DUMP_PROGRESS_LINES) == 0)
+      progress();
+  }
+  out.println("TRACE END");
+
+  head = 0;
+  paused = false;
+}
+
+#else
+
+void TraceRecorder::record(Type, uint8_t, uint8_t) {}
+
+void TraceRecorder::dump(Print &out, const std::function<void()> &)
+{
+  out.println("Tracing is not built in, use the esp32dev-trace environment");
+}
+
+const char *TraceRecorder::idName(uint8_t)
+{
+  return "unknown";
+}
+
+#endif
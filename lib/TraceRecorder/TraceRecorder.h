@@ -0,0 +1,101 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <Arduino.h>
+#include <functional>
+
+// Timeline of what the firmware was doing, for explaining one slow loop()
+// iteration that the averaged counters hide. Build with -DTRACE_ENABLED (the
+// esp32dev-trace environment); otherwise the TRACE_* macros compile to
+// nothing and there is no buffer.
+//
+// Events are 8 bytes: the microsecond clock, a type, an event id, the core
+// and a small argument. record() claims a slot in a ring with one atomic add
+// and is safe from any task or interrupt; the ring keeps the newest
+// CAPACITY events. dump() prints them as hex lines that
+// tools/trace/trace2chrome.py turns into a Chrome/Perfetto trace.
+//
+// Events carry the low 32 bits of esp_timer_get_time(), which both cores
+// share and which keeps its rate when the power manager scales the CPU
+// clock. The dump prints the full clock, and the converter unwraps backwards
+// from it one event at a time, so any gap between consecutive events under
+// ~35 minutes comes out right. Syncs and settings fetches keep gaps far
+// shorter, and the converter refuses a dump it can't unwrap.
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 4096 // 32 KB, a power of two
+#endif
+
+enum TraceId : uint8_t
+{
+  TRACE_WIFI_CONNECT,   // Async, startConnect() until the link is up or the attempt times out
+  TRACE_HTTP_REQUEST,   // WiFiManager request, arg = method
+  TRACE_DISPLAY_FLUSH,  // Frame buffer to the panel
+  TRACE_BUTTON,         // Handling one press, arg = pin
+  TRACE_PUMP_RUN,       // PumpController::run() ramp batch, at most once per ms
+  TRACE_SYNC,           // syncData()
+  TRACE_SETTINGS_FETCH, // fetchSettings()
+  TRACE_SCHEDULER_TICK, // DoseScheduler task tick
+  TRACE_ID_COUNT,
+};
+
+class TraceRecorder
+{
+public:
+  enum Type : uint8_t
+  {
+    BEGIN,
+    END,
+    INSTANT,
+    ASYNC_BEGIN, // May end in a later loop() pass or another task
+    ASYNC_END,
+  };
+
+  struct Event
+  {
+    uint32_t us; // Low 32 bits of esp_timer_get_time()
+    uint8_t type;
+    uint8_t id;
+    uint8_t core;
+    uint8_t arg;
+  };
+
+  static const uint32_t CAPACITY = TRACE_BUFFER_EVENTS;
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Trace buffer size must be a power of two");
+
+  static void record(Type type, uint8_t id, uint8_t arg);
+  // Prints the buffered events oldest first and empties the buffer. Recording
+  // pauses meanwhile. progress is called every few lines, e.g. to feed a watchdog.
+  static void dump(Print &out, const std::function<void()> &progress);
+  static const char *idName(uint8_t id);
+};
+
+class TraceScope
+{
+public:
+  explicit TraceScope(uint8_t id, uint8_t arg = 0) : id(id) { TraceRecorder::record(TraceRecorder::BEGIN, id, arg); }
+  ~TraceScope() { TraceRecorder::record(TraceRecorder::END, id, 0); }
+
+private:
+  uint8_t id;
+};
+
+#ifdef TRACE_ENABLED
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_BEGIN(id) TraceRecorder::record(TraceRecorder::BEGIN, id, 0)
+#define TRACE_END(id) TraceRecorder::record(TraceRecorder::END, id, 0)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+#define TRACE_INSTANT(id, arg) TraceRecorder::record(TraceRecorder::INSTANT, id, arg)
+#define TRACE_ASYNC_BEGIN(id) TraceRecorder::record(TraceRecorder::ASYNC_BEGIN, id, 0)
+#define TRACE_ASYNC_END(id, arg) TraceRecorder::record(TraceRecorder::ASYNC_END, id, arg)
+#else
+#define TRACE_BEGIN(id) ((void)0)
+#define TRACE_END(id) ((void)0)
+#define TRACE_SCOPE(...) ((void)0)
+#define TRACE_INSTANT(id, arg) ((void)0)
+#define TRACE_ASYNC_BEGIN(id) ((void)0)
+#define TRACE_ASYNC_END(id, arg) ((void)0)
+#endif
+
+#endif
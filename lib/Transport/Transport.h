@@ -0,0 +1,29 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <Arduino.h>
+
+// Common request surface shared by the WiFi and Bluetooth links so callers can
+// route traffic without caring which one carries it.
+class Transport
+{
+public:
+  virtual ~Transport() {}
+
+  virtual const char *name() const = 0;
+  virtual bool connect() = 0;
+  virtual bool isConnected() = 0;
+  virtual void disconnect() = 0;
+
+  // Requests give up after the link's own timeout or limitMs, whichever
+  // comes first
+  static const unsigned long NO_LIMIT = ~0UL;
+  virtual bool get(const char *path, String &response, unsigned long limitMs) = 0;
+  virtual bool post(const char *path, const char *contentType, const char *body, String &response, unsigned long limitMs) = 0;
+  virtual bool put(const char *path, const char *contentType, const char *body, String &response, unsigned long limitMs) = 0;
+  virtual bool del(const char *path, String &response, unsigned long limitMs) = 0;
+
+  virtual bool checkApiHealth() = 0;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef LINK_HEALTH_H
+#define LINK_HEALTH_H
+
+#include <stdint.h>
+
+// TransportRouter's view of one link: unhealthy after FAILURE_THRESHOLD
+// consecutive failed requests, then probed every probe interval until a
+// request gets through again.
+//
+// Kept free of Arduino headers so tools/fleet_sim runs the same rule.
+struct LinkHealth
+{
+  static const uint8_t FAILURE_THRESHOLD = 2;
+
+  bool healthy = true;
+  uint8_t consecutiveFailures = 0;
+  unsigned long lastProbeTime = 0;
+
+  // Returns true when this failure is the one that made the link unhealthy
+  bool recordResult(bool ok)
+  {
+    if (ok)
+    {
+      consecutiveFailures = 0;
+      healthy = true;
+      return false;
+    }
+    if (consecutiveFailures < 255)
+      consecutiveFailures++;
+    if (consecutiveFailures >= FAILURE_THRESHOLD && healthy)
+    {
+      healthy = false;
+      return true;
+    }
+    return false;
+  }
+
+  bool probeDue(unsigned long now, unsigned long probeInterval) const
+  {
+    return !healthy && now - lastProbeTime >= probeInterval;
+  }
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "TransportRouter.h"
+#include <Logger.h>
+
+// Extra cost per step down the priority order, so a backup link only wins
+// when the primary is unhealthy or much slower
+#define PRIORITY_PENALTY_MS 250.0f
+#define UNHEALTHY_PENALTY_MS 100000.0f
+#define LATENCY_SMOOTHING 0.25f
+
+TransportRouter::TransportRouter(unsigned long failoverBudgetMs, unsigned long probeIntervalMs)
+    : failoverBudget(failoverBudgetMs), probeInterval(probeIntervalMs) {}
+
+bool TransportRouter::addTransport(Transport *transport)
+{
+  if (count >= MAX_TRANSPORTS)
+    return false;
+  links[count].transport = transport;
+  count++;
+  return true;
+}
+
+bool TransportRouter::isAvailable()
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    if (links[i].healthy && links[i].transport->isConnected())
+      return true;
+  }
+  return false;
+}
+
+bool TransportRouter::isPrimaryActive()
+{
+  return count > 0 && links[0].healthy && links[0].transport->isConnected();
+}
+
+// Fills order[] with connected links, cheapest first. Returns how many there are.
+size_t TransportRouter::rank(size_t order[])
+{
+  float cost[MAX_TRANSPORTS];
+  size_t n = 0;
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!links[i].transport->isConnected())
+      continue;
+    cost[i] = links[i].latencyMs + i * PRIORITY_PENALTY_MS + (links[i].healthy ? 0 : UNHEALTHY_PENALTY_MS);
+
+    // Insertion sort, there are at most MAX_TRANSPORTS entries
+    size_t pos = n++;
+    while (pos > 0 && cost[order[pos - 1]] > cost[i])
+    {
+      order[pos] = order[pos - 1];
+      pos--;
+    }
+    order[pos] = i;
+  }
+  return n;
+}
+
+void TransportRouter::record(LinkStats &link, bool ok, unsigned long latency)
+{
+  if (ok)
+  {
+    link.successes++;
+    link.latencyMs = link.latencyMs == 0 ? latency : link.latencyMs + LATENCY_SMOOTHING * (latency - link.latencyMs);
+  }
+  else
+  {
+    link.failures++;
+  }
+  if (link.recordResult(ok))
+    LOG_WARN("%s link unhealthy, failing over", link.transport->name());
+}
+
+bool TransportRouter::attempt(LinkStats &link, Method method, const char *path, const char *contentType, const char *body, String &response,
+                              unsigned long limitMs)
+{
+  Transport *transport = link.transport;
+  unsigned long start = millis();
+  bool ok = false;
+  switch (method)
+  {
+  case METHOD_GET:
+    ok = transport->get(path, response, limitMs);
+    break;
+  case METHOD_POST:
+    ok = transport->post(path, contentType, body, response, limitMs);
+    break;
+  case METHOD_PUT:
+    ok = transport->put(path, contentType, body, response, limitMs);
+    break;
+  case METHOD_DELETE:
+    ok = transport->del(path, response, limitMs);
+    break;
+  }
+  record(link, ok, millis() - start);
+  if (ok)
+    lastUsed = transport;
+  return ok;
+}
+
+bool TransportRouter::route(Method method, const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure)
+{
+  size_t order[MAX_TRANSPORTS];
+  size_t n = rank(order);
+  unsigned long start = millis();
+
+  for (size_t i = 0; i < n; i++)
+  {
+    // The first link gets its own timeout, the others what is left of the budget
+    unsigned long limit = Transport::NO_LIMIT;
+    if (i > 0)
+    {
+      unsigned long elapsed = millis() - start;
+      if (elapsed >= failoverBudget)
+        break;
+      limit = failoverBudget - elapsed;
+    }
+    if (attempt(links[order[i]], method, path, contentType, body, response, limit))
+      return true;
+  }
+
+  if (queueOnFailure && (method == METHOD_POST || method == METHOD_PUT))
+    enqueue(method, path, contentType, body);
+  return false;
+}
+
+bool TransportRouter::get(const char *path, String &response)
+{
+  return route(METHOD_GET, path, "", "", response, false);
+}
+
+bool TransportRouter::post(const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure)
+{
+  return route(METHOD_POST, path, contentType, body, response, queueOnFailure);
+}
+
+bool TransportRouter::put(const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure)
+{
+  return route(METHOD_PUT, path, contentType, body, response, queueOnFailure);
+}
+
+bool TransportRouter::del(const char *path, String &response)
+{
+  return route(METHOD_DELETE, path, "", "", response, false);
+}
+
+void TransportRouter::enqueue(Method method, const char *path, const char *contentType, const char *body)
+{
+  // A newer write to the same endpoint supersedes the queued one
+  for (size_t i = 0; i < queueCount; i++)
+  {
+    QueuedRequest &queued = queue[(queueHead + i) % QUEUE_SIZE];
+    if (queued.method == method && queued.path == path)
+    {
+      queued.contentType = contentType;
+      queued.body = body;
+      return;
+    }
+  }
+
+  if (queueCount == QUEUE_SIZE)
+  {
+    // Drop the oldest
+    queueHead = (queueHead + 1) % QUEUE_SIZE;
+    queueCount--;
+  }
+  QueuedRequest &slot = queue[(queueHead + queueCount) % QUEUE_SIZE];
+  slot.method = method;
+  slot.path = path;
+  slot.contentType = contentType;
+  slot.body = body;
+  queueCount++;
+}
+
+// Sends one queued request per call so a long backlog doesn't stall loop()
+void TransportRouter::replayQueued()
+{
+  if (queueCount == 0 || !isPrimaryActive())
+    return;
+
+  QueuedRequest &queued = queue[queueHead];
+  String response;
+  if (!attempt(links[0], queued.method, queued.path.c_str(), queued.contentType.c_str(), queued.body.c_str(), response,
+               Transport::NO_LIMIT))
+    return;
+
+  LOG_INFO("Replayed queued request to %s", queued.path.c_str());
+  queued.path = "";
+  queued.contentType = "";
+  queued.body = "";
+  queueHead = (queueHead + 1) % QUEUE_SIZE;
+  queueCount--;
+}
+
+void TransportRouter::poll()
+{
+  unsigned long now = millis();
+  for (size_t i = 0; i < count; i++)
+  {
+    LinkStats &link = links[i];
+    if (!link.probeDue(now, probeInterval) || !link.transport->isConnected())
+      continue;
+    link.lastProbeTime = now;
+    unsigned long start = millis();
+    bool ok = link.transport->checkApiHealth();
+    record(link, ok, millis() - start);
+    if (ok)
+    {
+      LOG_INFO("%s link recovered", link.transport->name());
+    }
+  }
+
+  replayQueued();
+}
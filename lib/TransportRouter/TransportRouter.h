@@ -0,0 +1,81 @@
+#ifndef TRANSPORT_ROUTER_H
+#define TRANSPORT_ROUTER_H
+
+#include <Arduino.h>
+#include <Transport.h>
+#include <LinkHealth.h>
+
+// Routes requests over whichever registered link is currently best. Links are
+// ranked by health, smoothed latency and registration order (the first link
+// added is the primary). A failed request is retried on the next links with
+// whatever is left of the failover budget as their timeout, so a request
+// takes at most the first link's timeout or the budget, whichever is longer.
+// Writes that fail everywhere are queued and replayed over the primary once
+// it is healthy again.
+class TransportRouter
+{
+public:
+  static const size_t MAX_TRANSPORTS = 3;
+  static const size_t QUEUE_SIZE = 8;
+  struct LinkStats : LinkHealth
+  {
+    Transport *transport = nullptr;
+    float latencyMs = 0; // Exponentially smoothed request latency
+    uint32_t successes = 0;
+    uint32_t failures = 0;
+  };
+
+  TransportRouter(unsigned long failoverBudgetMs, unsigned long probeIntervalMs);
+
+  bool addTransport(Transport *transport);
+  void poll();
+
+  bool get(const char *path, String &response);
+  bool post(const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure = true);
+  bool put(const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure = true);
+  bool del(const char *path, String &response);
+
+  bool isAvailable();
+  bool isPrimaryActive();
+  Transport *lastTransport() const { return lastUsed; }
+  size_t transportCount() const { return count; }
+  const LinkStats &stats(size_t index) const { return links[index]; }
+  size_t queuedRequests() const { return queueCount; }
+
+private:
+  enum Method : uint8_t
+  {
+    METHOD_GET,
+    METHOD_POST,
+    METHOD_PUT,
+    METHOD_DELETE,
+  };
+
+  struct QueuedRequest
+  {
+    Method method;
+    String path;
+    String contentType;
+    String body;
+  };
+
+  bool route(Method method, const char *path, const char *contentType, const char *body, String &response, bool queueOnFailure);
+  bool attempt(LinkStats &link, Method method, const char *path, const char *contentType, const char *body, String &response,
+               unsigned long limitMs);
+  void record(LinkStats &link, bool ok, unsigned long latency);
+  size_t rank(size_t order[]);
+  void enqueue(Method method, const char *path, const char *contentType, const char *body);
+  void replayQueued();
+
+  unsigned long failoverBudget;
+  unsigned long probeInterval;
+  LinkStats links[MAX_TRANSPORTS];
+  size_t count = 0;
+  Transport *lastUsed = nullptr;
+
+  QueuedRequest queue[QUEUE_SIZE];
+  size_t queueHead = 0;
+  size_t queueCount = 0;
+};
+
+#endif
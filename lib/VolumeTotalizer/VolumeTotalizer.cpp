@@ -0,0 +1,95 @@
+#include "VolumeTotalizer.h"
+#include <EEPROM.h>
+#include <Fnv1a.h>
+#include <Logger.h>
+
+#define TOTALIZER_MAGIC 0x544F5431 // "TOT1"
+
+uint32_t VolumeTotalizer::checksum(const Record &record)
+{
+  return fnv1aRecord(record);
+}
+
+void VolumeTotalizer::begin(int eepromAddress, unsigned long flushIntervalMs)
+{
+  static_assert(sizeof(Record) == STORAGE_SIZE, "STORAGE_SIZE out of date");
+
+  address = eepromAddress;
+  flushInterval = flushIntervalMs;
+  lastFlushTime = millis();
+
+  Record record;
+  EEPROM.get(address, record);
+  if (record.magic == TOTALIZER_MAGIC && record.check == checksum(record) && !isnan(record.ml))
+  {
+    totalSteps = record.steps;
+    foldedML = record.ml;
+    LOG_INFO("Lifetime volume restored: %.2f mL", foldedML);
+  }
+  sessionStartML = foldedML;
+  doseStartML = doseEndML = foldedML;
+}
+
+void VolumeTotalizer::update(long stepCount)
+{
+  unsigned long delta = (unsigned long)stepCount - (unsigned long)lastStepCount;
+  lastStepCount = stepCount;
+  if (delta == 0)
+    return;
+  totalSteps += delta;
+  unfoldedSteps += delta;
+  dirty = true;
+}
+
+void VolumeTotalizer::fold()
+{
+  if (currentStepsPerML > 0)
+    foldedML += unfoldedSteps / (double)currentStepsPerML;
+  unfoldedSteps = 0;
+}
+
+void VolumeTotalizer::setStepsPerML(float stepsPerML)
+{
+  if (stepsPerML == currentStepsPerML)
+    return;
+  fold();
+  currentStepsPerML = stepsPerML;
+}
+
+double VolumeTotalizer::lifetimeML() const
+{
+  if (currentStepsPerML <= 0)
+    return foldedML;
+  return foldedML + unfoldedSteps / (double)currentStepsPerML;
+}
+
+void VolumeTotalizer::beginDose()
+{
+  doseStartML = lifetimeML();
+  doseActive = true;
+}
+
+void VolumeTotalizer::endDose()
+{
+  if (!doseActive)
+    return;
+  doseEndML = lifetimeML();
+  doseActive = false;
+}
+
+bool VolumeTotalizer::flush(unsigned long now, bool force)
+{
+  if (!dirty || (!force && now - lastFlushTime < flushInterval))
+    return false;
+
+  Record record;
+  record.magic = TOTALIZER_MAGIC;
+  record.steps = totalSteps;
+  record.ml = lifetimeML();
+  record.check = checksum(record);
+  EEPROM.put(address, record);
+  EEPROM.commit(); // NVS-backed, the blob is replaced atomically
+  lastFlushTime = now;
+  dirty = false;
+  return true;
+}
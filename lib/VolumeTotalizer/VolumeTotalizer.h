@@ -0,0 +1,62 @@
+#ifndef VOLUME_TOTALIZER_H
+#define VOLUME_TOTALIZER_H
+
+#include <Arduino.h>
+
+// Tracks how much liquid the pump has delivered. Steps are taken from the
+// pump's cumulative step counter, so none are lost between updates, and are
+// kept as an integer count until the calibration changes; only then are they
+// folded into millilitres. The lifetime total is written to EEPROM at most
+// once per flush interval, which bounds both flash wear and the amount lost
+// on power failure.
+class VolumeTotalizer
+{
+public:
+  static const size_t STORAGE_SIZE = 24; // Bytes used at the EEPROM address
+
+  void begin(int eepromAddress, unsigned long flushIntervalMs);
+  void update(long stepCount); // Cumulative step count from the pump
+  void setStepsPerML(float stepsPerML);
+
+  void beginDose();
+  void endDose();
+  bool isDoseActive() const { return doseActive; }
+
+  double lifetimeML() const;
+  double sessionML() const { return lifetimeML() - sessionStartML; }
+  double doseML() const { return (doseActive ? lifetimeML() : doseEndML) - doseStartML; }
+  uint64_t lifetimeSteps() const { return totalSteps; }
+
+  // Writes the totals if they changed and the flush interval has passed
+  bool flush(unsigned long now, bool force = false);
+
+private:
+  struct Record
+  {
+    uint32_t magic;
+    uint32_t check; // Checksum of the record with this field zeroed
+    uint64_t steps;
+    double ml;
+  };
+
+  void fold();
+  static uint32_t checksum(const Record &record);
+
+  int address = 0;
+  unsigned long flushInterval = 60000;
+  unsigned long lastFlushTime = 0;
+  bool dirty = false;
+
+  float currentStepsPerML = 0;
+  long lastStepCount = 0;
+  uint64_t totalSteps = 0;
+  double foldedML = 0;        // Volume from steps before the last calibration change
+  uint64_t unfoldedSteps = 0; // Steps at the current calibration
+
+  double sessionStartML = 0;
+  double doseStartML = 0;
+  double doseEndML = 0;
+  bool doseActive = false;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "WallClock.h"
+
+void WallClock::sync(int64_t unixUs, int64_t monoUs)
+{
+  if (synced)
+  {
+    lastCorrection = unixUs - this->unixUs(monoUs);
+    int64_t window = monoUs - driftBaseMono;
+    if (window >= MIN_DRIFT_WINDOW_US)
+    {
+      // Rate error over the window, blended with the previous estimate
+      float measured = (float)((unixUs - driftBaseUnix) - window) * 1e6f / window;
+      if (measured > MAX_DRIFT_PPM)
+        measured = MAX_DRIFT_PPM;
+      else if (measured < -MAX_DRIFT_PPM)
+        measured = -MAX_DRIFT_PPM;
+      drift = syncs < 2 ? measured : drift + DRIFT_SMOOTHING * (measured - drift);
+      driftBaseUnix = unixUs;
+      driftBaseMono = monoUs;
+    }
+  }
+  else
+  {
+    driftBaseUnix = unixUs;
+    driftBaseMono = monoUs;
+  }
+  baseUnix = unixUs;
+  baseMono = monoUs;
+  synced = true;
+  syncs++;
+}
+
+int64_t WallClock::unixUs(int64_t monoUs) const
+{
+  int64_t elapsed = monoUs - baseMono;
+  return baseUnix + elapsed + (int64_t)(elapsed * (double)drift / 1e6);
+}
+
+int64_t WallClock::monoUs(int64_t unixUs) const
+{
+  int64_t elapsed = unixUs - baseUnix;
+  return baseMono + (int64_t)(elapsed / (1 + (double)drift / 1e6));
+}
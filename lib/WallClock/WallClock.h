@@ -0,0 +1,40 @@
+#ifndef WALL_CLOCK_H
+#define WALL_CLOCK_H
+
+#include <stdint.h>
+
+// Maps the monotonic microsecond counter to Unix time. Each NTP sample
+// rebases the offset; samples far enough apart also refine an estimate of
+// how fast the local crystal runs, so between syncs the clock keeps the
+// correction instead of drifting freely.
+//
+// Kept free of Arduino headers so it builds on the host.
+class WallClock
+{
+public:
+  static const int64_t MIN_DRIFT_WINDOW_US = 600LL * 1000000; // Shorter gaps only rebase
+  static constexpr float MAX_DRIFT_PPM = 500;
+  static constexpr float DRIFT_SMOOTHING = 0.5f;
+
+  // A reference time: unixUs was true at monotonic time monoUs
+  void sync(int64_t unixUs, int64_t monoUs);
+
+  bool isSynced() const { return synced; }
+  int64_t unixUs(int64_t monoUs) const;
+  int64_t monoUs(int64_t unixUs) const; // Inverse, for scheduling wall-clock deadlines
+  float driftPpm() const { return drift; }
+  int64_t lastCorrectionUs() const { return lastCorrection; } // Error found at the last sync
+  uint32_t syncCount() const { return syncs; }
+
+private:
+  bool synced = false;
+  int64_t baseUnix = 0;
+  int64_t baseMono = 0;
+  int64_t driftBaseUnix = 0; // Start of the current drift measurement window
+  int64_t driftBaseMono = 0;
+  float drift = 0;           // Local clock error, ppm (positive: local clock slow)
+  int64_t lastCorrection = 0;
+  uint32_t syncs = 0;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include "WiFiManager.h"
+#include <Logger.h>
 
-WiFiManager::WiFiManager(const char *ssid, const char *password)
+WiFiManager::WiFiManager(const char *ssid, const char *password, unsigned long httpTimeout)
+    : _httpTimeout(httpTimeout)
 {
   _ssid = ssid;
   _password = password;
@@ -43,10 +45,10 @@ bool WiFiManager::connect()
       httpClient = new HttpClient(wifiClient, _serverAddress.c_str(), _port);
       if (httpClient == nullptr)
       {
-        Serial.println("Failed to create HttpClient");
+        LOG_ERROR("Failed to create HttpClient");
         return false;
       }
-      httpClient->setTimeout(HTTP_TIMEOUT);
+      httpClient->setTimeout(_httpTimeout);
     }
 
     int rssi = getSignalStrength();
@@ -65,9 +67,38 @@ bool WiFiManager::connect()
   }
 }
 
+bool WiFiManager::startConnect()
+{
+  if (isConnected() || (connecting && millis() - connectStartTime < CONNECT_TIMEOUT))
+    return false;
+
+  if (httpClient == nullptr)
+  {
+    httpClient = new HttpClient(wifiClient, _serverAddress.c_str(), _port);
+    httpClient->setTimeout(_httpTimeout);
+  }
+  if (connecting)
+  {
+    TRACE_ASYNC_END(TRACE_WIFI_CONNECT, 0); // The last attempt timed out
+    quality.connectFailed();
+  }
+  TRACE_ASYNC_BEGIN(TRACE_WIFI_CONNECT);
+  WiFi.begin(_ssid, _password);
+  connecting = true;
+  connectStartTime = millis();
+  return true;
+}
+
 bool WiFiManager::isConnected()
 {
-  return WiFi.status() == WL_CONNECTED;
+  bool connected = WiFi.status() == WL_CONNECTED;
+  if (connected && connecting)
+  {
+    connecting = false;
+    quality.connected();
+    TRACE_ASYNC_END(TRACE_WIFI_CONNECT, 1);
+  }
+  return connected;
 }
 
 void WiFiManager::disconnect()
@@ -87,29 +118,36 @@ int WiFiManager::getSignalStrength()
   if (isConnected())
   {
     int rssi = WiFi.RSSI();
-    Serial.print("Signal Strength: ");
-    Serial.println(rssi);
+    quality.addSignal(rssi);
     return rssi;
   }
   else
   {
-    Serial.println("Not connected to WiFi");
     return -1;
   }
 }
 
+// Feeds the link quality estimate and passes the result through
+bool WiFiManager::finishRequest(bool ok, unsigned long startTime)
+{
+  quality.addRequest(ok, millis() - startTime);
+  return ok;
+}
+
 // GET request
-bool WiFiManager::get(const char *path, String &response)
+bool WiFiManager::get(const char *path, String &response, unsigned long limitMs)
 {
   if (!isConnected())
   {
-    Serial.println("Cannot perform GET: Not connected to WiFi");
+    LOG_WARN("Cannot perform GET: not connected to WiFi");
     return false;
   }
 
-  Serial.print("GET ");
-  Serial.println(path);
+  TRACE_SCOPE(TRACE_HTTP_REQUEST, 0);
+  LOG_DEBUG("GET %s", path);
 
+  unsigned long timeout = min(_httpTimeout, limitMs);
+  httpClient->setTimeout(timeout);
   unsigned long startTime = millis(); // Start the timeout timer
 
   httpClient->beginRequest();
@@ -117,15 +155,15 @@ bool WiFiManager::get(const char *path, String &response)
   httpClient->endRequest();
 
   // Wait for the response with a timeout
-  while (!httpClient->available() && (millis() - startTime) < HTTP_TIMEOUT)
+  while (!httpClient->available() && (millis() - startTime) < timeout)
   {
     delay(10); // Small delay to avoid busy-waiting
   }
 
-  if ((millis() - startTime) >= HTTP_TIMEOUT)
+  if ((millis() - startTime) >= timeout)
   {
-    Serial.println("GET request timed out");
-    return false;
+    LOG_WARN("GET %s timed out", path);
+    return finishRequest(false, startTime);
   }
 
   int httpCode = httpClient->responseStatusCode();
@@ -133,32 +171,30 @@ bool WiFiManager::get(const char *path, String &response)
 
   if (httpCode > 0 && httpCode < 400)
   {
-    Serial.print("Response Code: ");
-    Serial.println(httpCode);
-    Serial.print("Response Body: ");
-    Serial.println(response);
-    return true; // Add this return to stop further execution
+    LOG_DEBUG("GET %s: %d %s", path, httpCode, response.c_str());
+    return finishRequest(true, startTime); // Add this return to stop further execution
   }
   else
   {
-    Serial.print("GET failed with code: ");
-    Serial.println(httpCode);
-    return false;
+    LOG_WARN("GET %s failed with code %d", path, httpCode);
+    return finishRequest(false, startTime);
   }
 }
 
 // POST request
-bool WiFiManager::post(const char *path, const char *contentType, const char *body, String &response)
+bool WiFiManager::post(const char *path, const char *contentType, const char *body, String &response, unsigned long limitMs)
 {
   if (!isConnected())
   {
-    Serial.println("Cannot perform POST: Not connected to WiFi");
+    LOG_WARN("Cannot perform POST: not connected to WiFi");
     return false;
   }
 
-  Serial.print("POST ");
-  Serial.println(path);
+  TRACE_SCOPE(TRACE_HTTP_REQUEST, 1);
+  LOG_DEBUG("POST %s", path);
 
+  unsigned long timeout = min(_httpTimeout, limitMs);
+  httpClient->setTimeout(timeout);
   unsigned long startTime = millis(); // Start the timeout timer
 
   httpClient->beginRequest();
@@ -166,15 +202,15 @@ bool WiFiManager::post(const char *path, const char *contentType, const char *bo
   httpClient->endRequest();
 
   // Wait for the response with a timeout
-  while (!httpClient->available() && (millis() - startTime) < HTTP_TIMEOUT)
+  while (!httpClient->available() && (millis() - startTime) < timeout)
   {
     delay(10); // Small delay to avoid busy-waiting
   }
 
-  if ((millis() - startTime) >= HTTP_TIMEOUT)
+  if ((millis() - startTime) >= timeout)
   {
-    Serial.println("POST request timed out");
-    return false;
+    LOG_WARN("POST %s timed out", path);
+    return finishRequest(false, startTime);
   }
 
   int httpCode = httpClient->responseStatusCode();
@@ -182,32 +218,30 @@ bool WiFiManager::post(const char *path, const char *contentType, const char *bo
 
   if (httpCode > 0 && httpCode < 400) // Success codes (2xx and 3xx)
   {
-    Serial.print("HTTP Code: ");
-    Serial.println(httpCode);
-    Serial.print("Response: ");
-    Serial.println(response);
-    return true;
+    LOG_DEBUG("POST %s: %d %s", path, httpCode, response.c_str());
+    return finishRequest(true, startTime);
   }
   else
   {
-    Serial.print("POST failed with code: ");
-    Serial.println(httpCode);
-    return false;
+    LOG_WARN("POST %s failed with code %d", path, httpCode);
+    return finishRequest(false, startTime);
   }
 }
 
 // PUT request
-bool WiFiManager::put(const char *path, const char *contentType, const char *body, String &response)
+bool WiFiManager::put(const char *path, const char *contentType, const char *body, String &response, unsigned long limitMs)
 {
   if (!isConnected())
   {
-    Serial.println("Cannot perform PUT: Not connected to WiFi");
+    LOG_WARN("Cannot perform PUT: not connected to WiFi");
     return false;
   }
 
-  Serial.print("PUT ");
-  Serial.println(path);
+  TRACE_SCOPE(TRACE_HTTP_REQUEST, 2);
+  LOG_DEBUG("PUT %s", path);
 
+  unsigned long timeout = min(_httpTimeout, limitMs);
+  httpClient->setTimeout(timeout);
   unsigned long startTime = millis(); // Start the timeout timer
 
   httpClient->beginRequest();
@@ -215,15 +249,15 @@ bool WiFiManager::put(const char *path, const char *contentType, const char *bod
   httpClient->endRequest();
 
   // Wait for the response with a timeout
-  while (!httpClient->available() && (millis() - startTime) < HTTP_TIMEOUT)
+  while (!httpClient->available() && (millis() - startTime) < timeout)
   {
     delay(10); // Small delay to avoid busy-waiting
   }
 
-  if ((millis() - startTime) >= HTTP_TIMEOUT)
+  if ((millis() - startTime) >= timeout)
   {
-    Serial.println("PUT request timed out");
-    return false;
+    LOG_WARN("PUT %s timed out", path);
+    return finishRequest(false, startTime);
   }
 
   int httpCode = httpClient->responseStatusCode();
@@ -231,32 +265,30 @@ bool WiFiManager::put(const char *path, const char *contentType, const char *bod
 
   if (httpCode > 0 && httpCode < 400) // Success codes (2xx and 3xx)
   {
-    Serial.print("HTTP Code: ");
-    Serial.println(httpCode);
-    Serial.print("Response: ");
-    Serial.println(response);
-    return true;
+    LOG_DEBUG("PUT %s: %d %s", path, httpCode, response.c_str());
+    return finishRequest(true, startTime);
   }
   else
   {
-    Serial.print("PUT failed with code: ");
-    Serial.println(httpCode);
-    return false;
+    LOG_WARN("PUT %s failed with code %d", path, httpCode);
+    return finishRequest(false, startTime);
   }
 }
 
 // DELETE request
-bool WiFiManager::del(const char *path, String &response)
+bool WiFiManager::del(const char *path, String &response, unsigned long limitMs)
 {
   if (!isConnected())
   {
-    Serial.println("Cannot perform DELETE: Not connected to WiFi");
+    LOG_WARN("Cannot perform DELETE: not connected to WiFi");
     return false;
   }
 
-  Serial.print("DELETE ");
-  Serial.println(path);
+  TRACE_SCOPE(TRACE_HTTP_REQUEST, 3);
+  LOG_DEBUG("DELETE %s", path);
 
+  unsigned long timeout = min(_httpTimeout, limitMs);
+  httpClient->setTimeout(timeout);
   unsigned long startTime = millis(); // Start the timeout timer
 
   httpClient->beginRequest();
@@ -264,15 +296,15 @@ bool WiFiManager::del(const char *path, String &response)
   httpClient->endRequest();
 
   // Wait for the response with a timeout
-  while (!httpClient->available() && (millis() - startTime) < HTTP_TIMEOUT)
+  while (!httpClient->available() && (millis() - startTime) < timeout)
   {
     delay(10); // Small delay to avoid busy-waiting
   }
 
-  if ((millis() - startTime) >= HTTP_TIMEOUT)
+  if ((millis() - startTime) >= timeout)
   {
-    Serial.println("DELETE request timed out");
-    return false;
+    LOG_WARN("DELETE %s timed out", path);
+    return finishRequest(false, startTime);
   }
 
   int httpCode = httpClient->responseStatusCode();
@@ -280,17 +312,13 @@ bool WiFiManager::del(const char *path, String &response)
 
   if (httpCode > 0 && httpCode < 400) // Success codes (2xx and 3xx)
   {
-    Serial.print("HTTP Code: ");
-    Serial.println(httpCode);
-    Serial.print("Response: ");
-    Serial.println(response);
-    return true;
+    LOG_DEBUG("DELETE %s: %d %s", path, httpCode, response.c_str());
+    return finishRequest(true, startTime);
   }
   else
   {
-    Serial.print("DELETE failed with code: ");
-    Serial.println(httpCode);
-    return false;
+    LOG_WARN("DELETE %s failed with code %d", path, httpCode);
+    return finishRequest(false, startTime);
   }
 }
 
@@ -298,5 +326,5 @@ bool WiFiManager::del(const char *path, String &response)
 bool WiFiManager::checkApiHealth()
 {
   String response;
-  return get("/api/health", response);
+  return get("/api/health", response, NO_LIMIT);
 }
\ No newline at end of file
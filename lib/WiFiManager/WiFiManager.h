@@ -4,35 +4,52 @@
 #include <WiFi.h>
 #include <DisplayManager.h>
 #include <ArduinoHttpClient.h>
+#include <Transport.h>
+#include <LinkQuality.h>
+#include <TraceRecorder.h>
 
-class WiFiManager {
+class WiFiManager : public Transport {
 private:
   const char* _ssid;
   const char* _password;
   const int MAX_ATTEMPTS = 20;
   const String _serverAddress = "192.168.68.108";
   const int _port = 3000;
-  const int HTTP_TIMEOUT = 1000; // Timeout for HTTP requests
+  const unsigned long _httpTimeout; // Timeout for HTTP requests
   const int MIN_RSSI = -80; // Minimum RSSI for a good connection
   WiFiClient wifiClient;               // WiFi client for HTTP
   HttpClient* httpClient = nullptr;    // Pointer to HttpClient, initialized later
+  unsigned long connectStartTime = 0;
+  bool connecting = false;
+  const unsigned long CONNECT_TIMEOUT = 10000; // Same budget as MAX_ATTEMPTS blocking polls
+  LinkQuality quality;
+
+  bool finishRequest(bool ok, unsigned long startTime);
 
 public:
-  WiFiManager(const char* ssid, const char* password);
+  WiFiManager(const char* ssid, const char* password, unsigned long httpTimeout);
   ~WiFiManager();  // Destructor to clean up
 
-  bool connect();
-  bool isConnected();
-  void disconnect();
-  int getSignalStrength();
+  const char* name() const override { return "WiFi"; }
+  bool connect() override;
+  // Non-blocking alternative to connect(): starts an attempt and returns.
+  // isConnected() turns true once the link is up. Returns false while an
+  // earlier attempt is still within its time limit.
+  bool startConnect();
+  bool isConnected() override;
+  void disconnect() override;
+  int getSignalStrength(); // Also feeds the link quality estimate
+  const LinkQuality& linkQuality() const { return quality; }
+  const String& serverAddress() const { return _serverAddress; }
+  int serverPort() const { return _port; }
   
   // HTTP Methods
-  bool get(const char* path, String& response);
-  bool post(const char* path, const char* contentType, const char* body, String& response);
-  bool put(const char* path, const char* contentType, const char* body, String& response);
-  bool del(const char* path, String& response);
+  bool get(const char* path, String& response, unsigned long limitMs) override;
+  bool post(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) override;
+  bool put(const char* path, const char* contentType, const char* body, String& response, unsigned long limitMs) override;
+  bool del(const char* path, String& response, unsigned long limitMs) override;
 
-  bool checkApiHealth();
+  bool checkApiHealth() override;
 };
 
 #endif
\ No newline at end of file
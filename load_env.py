@@ -8,11 +8,13 @@ def before_build(env, platform):
     # Read environment variables from .env
     wifi_ssid = os.getenv("WIFI_SSID", "DefaultSSID")
     wifi_password = os.getenv("WIFI_PASSWORD", "DefaultPassword")
+    ota_secret = os.getenv("OTA_SECRET", "")
 
     # Pass them as build flags
     env.Append(
         CPPDEFINES=[
             ("WIFI_SSID", f'"{wifi_ssid}"'),
-            ("WIFI_PASSWORD", f'"{wifi_password}"')
+            ("WIFI_PASSWORD", f'"{wifi_password}"'),
+            ("OTA_SECRET", f'"{ota_secret}"')
         ]
     )
\ No newline at end of file
@@ -5,6 +5,31 @@
 #include <Config.h>
 #include <ArduinoJson.h>
 #include "PumpController.h"
+#include <BleService.h>
+#include <BluetoothManager.h>
+#include <TransportRouter.h>
+#include <PowerManager.h>
+#include <VolumeTotalizer.h>
+#include <CalibrationTable.h>
+#include <OtaUpdater.h>
+#include <BootTimeline.h>
+#include <DoseScheduler.h>
+#include <SettingsCache.h>
+#include <LoopWatchdog.h>
+#include <ButtonRepeat.h>
+#include <StepSelfTest.h>
+#include <TraceRecorder.h>
+#include <Logger.h>
+#include <SerialConsole.h>
+#include <FlowSensor.h>
+#include <FlowRegulator.h>
+#include <AnalogSetpoint.h>
+#include <SyncPolicy.h>
+#include <BackendDocuments.h>
+#include <Fnv1a.h>
+#ifdef STEP_RATE_BENCHMARK
+#include <StepRateBenchmark.h>
+#endif
 
 #define EN_PIN 26  // Enable
 #define DIR_PIN 2  // Direction
@@ -12,6 +37,25 @@
 #define RX_PIN 16  // ESP32 RX orange line
 #define TX_PIN 17  // ESP32 TX blue line
 
+// Every GPIO in use, -1 entries are features left unwired. Checked at
+// compile time so two functions can never end up on one pin.
+constexpr int usedPins[] = {EN_PIN, DIR_PIN, STEP_PIN, RX_PIN, TX_PIN, SDA, SCL,
+                            BUTTON_ENABLE_PIN, BUTTON_SPEED_UP_PIN, BUTTON_SPEED_DOWN_PIN, BUTTON_MENU_PIN,
+                            POT_PIN, FLOW_SENSOR_PIN};
+
+constexpr bool pinsDistinct()
+{
+  for (size_t i = 0; i < sizeof(usedPins) / sizeof(usedPins[0]); i++)
+    for (size_t j = i + 1; j < sizeof(usedPins) / sizeof(usedPins[0]); j++)
+      if (usedPins[i] >= 0 && usedPins[i] == usedPins[j])
+        return false;
+  return true;
+}
+
+static_assert(pinsDistinct(), "Two functions share a GPIO, check the pins in Config.h and main.cpp");
+static_assert(isOutputCapable(TX_PIN), "TX_PIN cannot drive an output");
+static_assert(POT_PIN < 0 || AnalogSetpoint::adc1Channel(POT_PIN) >= 0, "POT_PIN must be an ADC1 pin, GPIO 32-39");
+
 #define R_SENSE 0.11f
 #define DRIVER_ADDR 0b00 // Default address for TMC2209
 
@@ -30,48 +74,134 @@ int menuIndex = 0;
 unsigned long lastButtonPressTime = 0;
 float stepsPerML = 0;
 int stepsPerSecond = 2000;
-const char *menuItems[] = {"Calibrate Drop", "Settings Info", "Save Speed"};
+const char *menuItems[] = {"Calibrate Drop", "Settings Info", "Save Speed", "Calibrate Table", "Step Self-Test"};
 const int menuItemCount = sizeof(menuItems) / sizeof(menuItems[0]);
-unsigned long lastWiFiRetryTime = 0;
-unsigned long lastSyncTime = 0;
+SyncPolicy syncPolicy({SYNC_INTERVAL, SETTINGS_REVALIDATE_INTERVAL, WIFI_RETRY_INTERVAL, WIFI_RETRY_MAX_INTERVAL,
+                       SCHEDULE_HISTORY_REPORT});
+bool wifiWasConnected = false;
+unsigned long lastLinkSampleTime = 0;
 unsigned long lastSettingsDisplayTime = 0;
 unsigned long lastCalibrationResultTime = 0;
 bool showingSettings = false;
 bool showingCalibrationResult = false;
+uint32_t selfTestSafeMax = 0; // steps/sec from the last self-test, 0 if none ran
+
+// Boot stages deferred to loop(), in order
+enum BootStage
+{
+  BOOT_DISPLAY,
+  BOOT_BLE,
+  BOOT_BLUETOOTH,
+  BOOT_POWER,
+  BOOT_WIFI,
+  BOOT_DONE,
+};
+BootStage bootStage = BOOT_DISPLAY;
+BootTimeline bootTimeline;
+bool bootReported = false;
+uint32_t lastReportedExecution = 0; // Highest schedule execution seq the backend has
+
+// Last commanded pump state, restored after a reset
+struct RunState
+{
+  uint32_t magic;
+  float speed; // steps/sec
+  uint32_t enabled;
+  uint32_t check;
+};
+RunState runState = {};
+unsigned long runStateChangeTime = 0;
 
 // Create WiFiManager instance
-WiFiManager wifi(ssid, password);
+WiFiManager wifi(ssid, password, HTTP_TIMEOUT);
 DisplayManager &display = DisplayManager::getInstance();
-PumpController pump(&Serial2, STEP_PIN, DIR_PIN, EN_PIN, R_SENSE, DRIVER_ADDR);
+FastPumpController<STEP_PIN, DIR_PIN, EN_PIN> pump(&Serial2, R_SENSE, DRIVER_ADDR);
+BleService ble(BLE_DEVICE_NAME);
+BluetoothManager bluetooth(BT_DEVICE_NAME);
+TransportRouter router(FAILOVER_BUDGET_MS, LINK_PROBE_INTERVAL); // WiFi first, Bluetooth as fallback
+bool bluetoothWasConnected = false;
+PowerManager power;
+VolumeTotalizer totalizer;
+CalibrationTable calibrationTable;
+OtaUpdater ota;
+DoseScheduler scheduler;
+SettingsCache settingsCache;
+LoopWatchdog watchdog;
+FlowSensor flowSensor;
+FlowRegulator flowRegulator;
+AnalogSetpoint pot;
+float flowSetpoint = 0;       // mL/min the regulator is holding, 0 while it is not
+bool flowFaultReported = false;
+SerialConsole console(Serial);
+uint8_t phaseBoot, phaseWifi, phaseUi, phaseSync, phaseRadio, phasePump, phaseIdle; // loop() phases
+uint8_t phaseSelfTest, heartbeatScheduler;
+const float calibrationTableSpeeds[] = CALIBRATION_TABLE_SPEEDS;
+const uint8_t wakePins[] = {BUTTON_ENABLE_PIN, BUTTON_SPEED_UP_PIN, BUTTON_SPEED_DOWN_PIN, BUTTON_MENU_PIN};
 
 // Forward declarations
 bool checkButtonPress(uint8_t pin);
 bool checkButtonPressOrHold(uint8_t pin);
 void calibrateDrop();
+void calibrateTable();
+long runCalibrationPass(float speed);
+float promptMeasuredML();
+void saveCalibrationTable();
 void runMenuSelection();
 void syncData();
+void fetchSettings();
+void applySettings(const BackendDocuments::Settings &settings);
+void offerFirmware(const BackendDocuments::Firmware &firmware);
+float cachedSpeed();
+void updatePowerMode();
+void updateTotalizer(unsigned long now);
+void setupFlowRegulation();
+void updateFlow(unsigned long now);
+void applyFlowRecalibration(float factor);
+void updateOta(unsigned long now);
+void continueBoot();
+void restoreRunState(float savedSpeed);
+void applyPrograms(const BackendDocuments::Program *list, size_t count);
+void updateRunState(unsigned long now);
+unsigned long msUntilNextDeadline(unsigned long now);
+unsigned long syncInterval();
+const LinkQuality *pacingLink();
+int sampleLink();
+void setupBle();
+void setupWatchdog();
+void saveCalibration(float newStepsPerML);
+void setupConsole();
+void showPumpStatus();
+void runSelfTest();
 
 void setup()
 {
+  bootTimeline.mark("setup");
   Serial.begin(115200);
-  while (!Serial)
-    ;
-  Serial.println("Starting...");
+  Logger::begin(Serial);
+  LOG_INFO("Starting...");
+  setupWatchdog();
   EEPROM.begin(512);
-  Serial2.begin(115200, SERIAL_8N1, RX_PIN, TX_PIN);
+  ota.begin(OTA_EEPROM_ADDR, OTA_LOCAL_PORT, OTA_SECRET); // Early, so a crashing image is still rolled back
+  bootTimeline.mark("eeprom");
 
-  pinMode(BUTTON_ENABLE_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_SPEED_UP_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_SPEED_DOWN_PIN, INPUT_PULLUP);
-  pinMode(BUTTON_MENU_PIN, INPUT_PULLUP);
-
-  display.begin();
+  // Fast path: the pump gets back to its last state before anything slow runs
+  Serial2.begin(115200, SERIAL_8N1, RX_PIN, TX_PIN);
   pump.begin();
+  pump.setAcceleration(ACCELERATION);
+  pump.setMaxSpeed(MAX_SPEED);
+  bootTimeline.mark("driver");
+#ifdef STEP_RATE_BENCHMARK
+  runStepRateBenchmark<STEP_PIN, DIR_PIN>(Serial, EN_PIN);
+#endif
 
   // Load stepsPerML and speed from EEPROM
   EEPROM.get(EEPROM_ADDR, stepsPerML);
   float savedSpeed = 0;
   EEPROM.get(EEPROM_ADDR + sizeof(stepsPerML), savedSpeed);
+  settingsCache.begin(SETTINGS_CACHE_NAMESPACE);
+  float serverSpeed = cachedSpeed();
+  if (!isnan(serverSpeed))
+    savedSpeed = serverSpeed; // The server's last word beats the menu's
 
   if (isnan(stepsPerML) || stepsPerML <= 0)
     stepsPerML = 0;
@@ -79,90 +209,121 @@ void setup()
   pump.setStepsPerML(stepsPerML);
   pump.setSpeedStep(stepsPerSecond);
 
-  if (!isnan(savedSpeed) && savedSpeed > 0)
+  CalibrationTable::Stored storedTable;
+  EEPROM.get(CALIBRATION_TABLE_EEPROM_ADDR, storedTable);
+  if (calibrationTable.load(storedTable, pump.getMaxSpeed()))
+    pump.setCalibrationTable(&calibrationTable);
+
+  restoreRunState(savedSpeed);
+  bootTimeline.mark("pump resumed");
+
+  // Runs from its own task, doses keep to time whatever loop() is doing
+  scheduler.onDoseStarted([]() { power.wake(); });
+  scheduler.onTick([]() { watchdog.feed(heartbeatScheduler); });
+  scheduler.begin(pump, SCHEDULE_EEPROM_ADDR, DOSE_DEFAULT_SPEED);
+
+  totalizer.begin(TOTALIZER_EEPROM_ADDR, TOTALIZER_FLUSH_INTERVAL);
+  totalizer.setStepsPerML(pump.getStepsPerML());
+  setupFlowRegulation();
+
+  pinMode(BUTTON_ENABLE_PIN, INPUT_PULLUP);
+  pinMode(BUTTON_SPEED_UP_PIN, INPUT_PULLUP);
+  pinMode(BUTTON_SPEED_DOWN_PIN, INPUT_PULLUP);
+  pinMode(BUTTON_MENU_PIN, INPUT_PULLUP);
+  if (POT_PIN >= 0 && !pot.begin(POT_PIN, POT_HYSTERESIS, POT_DEAD_ZONE))
+    LOG_ERROR("Potentiometer ADC failed to start");
+
+  router.addTransport(&wifi);
+  router.addTransport(&bluetooth);
+  setupConsole();
+  bootTimeline.mark("setup done");
+  // Display, radios and power management come up from loop(), see continueBoot()
+}
+
+// Brings up one slow subsystem per loop() pass, so the pump keeps being
+// serviced in between
+void continueBoot()
+{
+  switch (bootStage)
   {
-    pump.setSpeed(savedSpeed);
-    Serial.print("Loaded saved speed from EEPROM: ");
-    Serial.println(savedSpeed);
+  case BOOT_DISPLAY:
+    display.begin(DISPLAY_I2C_CLOCK);
+    display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
+    bootTimeline.mark("display");
+    break;
+  case BOOT_BLE:
+    setupBle();
+    bootTimeline.mark("ble");
+    break;
+  case BOOT_BLUETOOTH:
+    bluetooth.begin();
+    bootTimeline.mark("bluetooth");
+    break;
+  case BOOT_POWER:
+    power.begin(wakePins, sizeof(wakePins) / sizeof(wakePins[0]), ACTIVE_CPU_MHZ, IDLE_CPU_MHZ);
+    bootTimeline.mark("power");
+    break;
+  case BOOT_WIFI:
+    wifi.startConnect();
+    syncPolicy.reconnectDeferred(millis());
+    bootTimeline.mark("wifi started");
+    bootTimeline.print(Serial);
+    break;
+  case BOOT_DONE:
+    return;
   }
-
-  lastWiFiRetryTime = millis();
-  display.showText("WiFi Connecting...");
+  bootStage = (BootStage)(bootStage + 1);
 }
 
 void loop()
 {
   unsigned long currentTime = millis();
-  // WiFi Connection Handling
-  if (!wifi.isConnected())
+  if (bootStage != BOOT_DONE)
   {
-    if (currentTime - lastWiFiRetryTime >= WIFI_RETRY_INTERVAL)
+    watchdog.enter(phaseBoot);
+    continueBoot();
+    pump.run();
+    updateTotalizer(currentTime);
+    return;
+  }
+
+  // WiFi Connection Handling, never blocks: the attempt runs in the background
+  watchdog.enter(phaseWifi);
+  bool wifiConnected = wifi.isConnected();
+  if (wifiConnected && !wifiWasConnected)
+  {
+    bootTimeline.markOnce("wifi connected");
+    syncPolicy.connected();
+    sampleLink();
+    lastLinkSampleTime = currentTime;
+    display.showText("WiFi Connected");
+    scheduler.startTimeSync(TIMEZONE, NTP_SERVER, NTP_SYNC_INTERVAL);
+    fetchSettings(); // Doubles as the health check
+  }
+  else if (!wifiConnected && syncPolicy.reconnectDue(currentTime))
+  {
+    if (wifi.startConnect())
     {
-      Serial.println("Attempting WiFi Connect...");
-      if (wifi.connect())
-      {
-        display.setSignalStrength(wifi.getSignalStrength());
-        display.showText("WiFi Connected");
-        if (wifi.checkApiHealth())
-        {
-          String response;
-          if (wifi.get((String(PUMP_BY_ID_API) + "?pump-id=" + String(ID_PERISTALTIC_STEPPER)).c_str(), response))
-          {
-            // Parse the JSON response
-            JsonDocument doc; // Adjust size as needed
-            DeserializationError error = deserializeJson(doc, response);
-
-            if (error)
-            {
-              Serial.print("Failed to parse JSON: ");
-              Serial.println(error.c_str());
-              display.showText("Invalid Server Data");
-            }
-            else
-            {
-              // Extract current speed from the response
-              if (doc["currentSpeed"].is<float>())
-              {
-                float currentSpeed = doc["currentSpeed"];
-                Serial.print("Setting pump speed to: ");
-                Serial.println(currentSpeed);
-
-                // Update the pump's speed
-                pump.setSpeed(currentSpeed);
-                display.updateStatus(pump.isEnabled(), currentSpeed > 0 ? currentSpeed / pump.getSpeedStep() : 0);
-              }
-              else
-              {
-                Serial.println("Response missing 'currentSpeed' field");
-                display.showText("Invalid Server Data");
-              }
-            }
-
-            display.showText("Server OK");
-            display.updateStatus(pump.isEnabled(), pump.getSpeed() > 0 ? pump.getSpeed() / pump.getSpeedStep() : 0);
-          }
-        }
-        else
-        {
-          // display.showText("Server Down");
-        }
-      }
-      else
-      {
-        display.showText("WiFi Failed");
-      }
-      lastWiFiRetryTime = currentTime;
+      uint32_t retryDelay = syncPolicy.reconnectStarted(currentTime, wifi.linkQuality(), esp_random());
+      LOG_INFO("Attempting WiFi connect, next try in %lu ms", (unsigned long)retryDelay);
+    }
+    else
+    {
+      syncPolicy.reconnectDeferred(currentTime);
     }
   }
-  else if (!wifi.isConnected() && currentTime - lastWiFiRetryTime >= WIFI_RETRY_INTERVAL)
+  else if (wifiConnected && !power.isIdle() && currentTime - lastLinkSampleTime >= LINK_SAMPLE_INTERVAL)
   {
-    Serial.println("Server Health Check Failed");
-    display.showText("Server Down");
-    lastWiFiRetryTime = currentTime;
+    sampleLink();
+    lastLinkSampleTime = currentTime;
   }
+  wifiWasConnected = wifiConnected;
 
+  watchdog.enter(phaseUi);
+  console.poll();
   if (checkButtonPress(BUTTON_MENU_PIN))
   {
+    TRACE_SCOPE(TRACE_BUTTON, BUTTON_MENU_PIN);
     if (!inMenu)
     {
       inMenu = true;
@@ -179,10 +340,12 @@ void loop()
   {
     if (checkButtonPressOrHold(BUTTON_SPEED_UP_PIN))
     {
+      TRACE_SCOPE(TRACE_BUTTON, BUTTON_SPEED_UP_PIN);
       menuIndex = (menuIndex + 1) % menuItemCount;
     }
     if (checkButtonPressOrHold(BUTTON_SPEED_DOWN_PIN))
     {
+      TRACE_SCOPE(TRACE_BUTTON, BUTTON_SPEED_DOWN_PIN);
       menuIndex = (menuIndex - 1 + menuItemCount) % menuItemCount;
     }
     display.showMenu(menuIndex, menuItems, menuItemCount);
@@ -191,85 +354,548 @@ void loop()
   {
     if (checkButtonPress(BUTTON_ENABLE_PIN))
     {
+      TRACE_SCOPE(TRACE_BUTTON, BUTTON_ENABLE_PIN);
       if (pump.isEnabled())
         pump.stop();
       else
-        pump.setSpeed(pump.getSpeed() > 0 ? pump.getSpeed() : 0);
-      display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getSpeed() / pump.getStepsPerML() * 60 : 0);
+        pump.setSpeed(pump.getTargetSpeed() > 0 ? pump.getTargetSpeed() : 0);
+      display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
     }
 
     if (checkButtonPressOrHold(BUTTON_SPEED_UP_PIN))
     {
-      Serial.println("getSpeedStep: " + String(pump.getSpeedStep()));
-      Serial.println("getMaxSpeedStep: " + String(pump.getMaxSpeedStep()));
-      Serial.println("getSpeed: " + String(pump.getSpeed()));
-      Serial.println("getStepsPerML: " + String(pump.getStepsPerML()));
-      pump.setSpeed(pump.getSpeed() + pump.getSpeedStep());
-      display.updateStatus(pump.isEnabled(), pump.getSpeed() > 0 ? pump.getSpeed() / pump.getSpeedStep() : 0);
+      TRACE_SCOPE(TRACE_BUTTON, BUTTON_SPEED_UP_PIN);
+      LOG_DEBUG("Speed up: step %d, max step %d, target %.0f, steps/mL %.2f", pump.getSpeedStep(), pump.getMaxSpeedStep(),
+                pump.getTargetSpeed(), pump.getStepsPerML());
+      pump.setSpeed(pump.getTargetSpeed() + pump.getSpeedStep());
+      display.updateStatus(pump.isEnabled(), pump.getTargetSpeed() > 0 ? pump.getTargetSpeed() / pump.getSpeedStep() : 0);
     }
 
     if (checkButtonPressOrHold(BUTTON_SPEED_DOWN_PIN))
     {
-      pump.setSpeed(max(pump.getSpeed() - pump.getSpeedStep(), 0.0f));
-      display.updateStatus(pump.isEnabled(), pump.getSpeed() > 0 ? pump.getSpeed() / pump.getSpeedStep() : 0);
+      TRACE_SCOPE(TRACE_BUTTON, BUTTON_SPEED_DOWN_PIN);
+      pump.setSpeed(max(pump.getTargetSpeed() - pump.getSpeedStep(), 0.0f));
+      display.updateStatus(pump.isEnabled(), pump.getTargetSpeed() > 0 ? pump.getTargetSpeed() / pump.getSpeedStep() : 0);
+    }
+
+    // Filtered in the background, only a knob that was turned sets the speed
+    float position;
+    if (pot.takeChange(position))
+    {
+      lastButtonPressTime = currentTime;
+      if (display.isSleeping())
+        display.wakeDisplay();
+      pump.setSpeed(position * pump.getMaxSpeed());
+      display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
     }
   }
 
   if (!display.isSleeping() && (currentTime - lastButtonPressTime >= DISPLAY_TIMEOUT))
   {
-    Serial.print(currentTime - lastButtonPressTime);
-    Serial.print(" > ");
-    Serial.println("Display Timeout");
+    LOG_DEBUG("Display timeout, idle for %lu ms", currentTime - lastButtonPressTime);
     display.sleepDisplay();
   }
+  // Pull settings over Bluetooth when it comes up while WiFi is down
+  watchdog.enter(phaseSync);
+  bool bluetoothConnected = bluetooth.isConnected();
+  if (bluetoothConnected && !bluetoothWasConnected && !wifi.isConnected())
+    fetchSettings();
+  bluetoothWasConnected = bluetoothConnected;
+
+  // Revalidate the cached settings, a conditional request that is usually empty
+  if (router.isAvailable() && syncPolicy.revalidateDue(currentTime))
+    fetchSettings();
+
   // Sync Data
-  if (wifi.isConnected() && currentTime - lastSyncTime >= SYNC_INTERVAL)
+  if (router.isAvailable() && syncPolicy.syncDue(currentTime, pacingLink()))
   {
     syncData();
-    lastSyncTime = currentTime;
+    syncPolicy.synced(currentTime);
   }
 
   // Handle Settings Display Timeout
+  watchdog.enter(phaseUi);
   if (showingSettings && currentTime - lastSettingsDisplayTime >= SETTINGS_DISPLAY_DURATION)
   {
     showingSettings = false;
-    display.updateStatus(pump.isEnabled(), stepsPerML > 0 ? pump.getSpeed() / stepsPerML * 60 : 0);
+    display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
   }
 
   // Handle Calibration Result Timeout
   if (showingCalibrationResult && currentTime - lastCalibrationResultTime >= CALIBRATION_RESULT_DURATION)
   {
     showingCalibrationResult = false;
-    display.updateStatus(pump.isEnabled(), stepsPerML > 0 ? pump.getSpeed() / stepsPerML * 60 : 0);
+    display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
   }
 
+  watchdog.enter(phaseRadio);
+  ble.poll();
+  bluetooth.poll();
+  router.poll();
+  watchdog.enter(phasePump);
   pump.run();
+  updateTotalizer(currentTime);
+  updateFlow(currentTime);
+  updateRunState(currentTime);
+  updateOta(currentTime);
+  watchdog.enter(phaseIdle);
+  updatePowerMode();
 }
 
-void syncData()
+void updateTotalizer(unsigned long now)
 {
-  JsonDocument doc;
+  totalizer.update(pump.getStepCount());
+  totalizer.setStepsPerML(pump.getStepsPerML()); // Follows the calibration table across speeds
+  if (pump.isDosing() && !totalizer.isDoseActive())
+    totalizer.beginDose(); // Started by the scheduler
+  if (totalizer.isDoseActive() && !pump.isDosing())
+    totalizer.endDose();
+  totalizer.flush(now);
+}
+
+void setupFlowRegulation()
+{
+  if (FLOW_SENSOR_PIN < 0)
+    return;
+  FlowRegulator::Config config = {
+      FLOW_PULSES_PER_ML, FLOW_KP, FLOW_KI, FLOW_MAX_TRIM, FLOW_WINDOW_MS, FLOW_MIN_PULSES,
+      FLOW_RECALIBRATE_ERROR, FLOW_RECALIBRATE_ML, FLOW_MAX_RECALIBRATION,
+  };
+  flowRegulator.configure(config);
+  if (!flowSensor.begin(FLOW_SENSOR_PIN))
+    LOG_ERROR("Flow sensor failed to start, running open loop");
+}
+
+// Holds the commanded mL/min against tubing wear by trimming the step rate.
+// Doses are left alone, their volume is counted in steps.
+void updateFlow(unsigned long now)
+{
+  if (!flowSensor.isStarted())
+    return;
+
+  float setpoint = pump.isEnabled() && !pump.isDosing() && pump.getStepsPerML() > 0
+                       ? pump.getTargetSpeed() / pump.getStepsPerML() * 60
+                       : 0;
+  if (setpoint != flowSetpoint)
+  {
+    flowSetpoint = setpoint;
+    flowRegulator.reset(); // Skips the window the ramp lands in
+  }
+  if (setpoint <= 0)
+    return;
+
+  pump.setFlowTrim(flowRegulator.update(now, setpoint, pump.getStepsPerML(), pump.getStepCount(), flowSensor.pulses()));
+
+  if (flowRegulator.sensorFault() != flowFaultReported)
+  {
+    flowFaultReported = flowRegulator.sensorFault();
+    if (flowFaultReported)
+      LOG_WARN("No flow sensor pulses while pumping, running open loop");
+    else
+      LOG_INFO("Flow sensor pulses back");
+  }
+
+  float factor;
+  if (flowRegulator.takeRecalibration(factor))
+  {
+    LOG_INFO("Tubing drifted, scaling the calibration by %.3f", factor);
+    applyFlowRecalibration(factor);
+    pump.setFlowTrim(flowRegulator.trim());
+  }
+}
+
+// Wear scales every speed alike, so a table is rescaled point by point. The
+// target speed moves with the calibration so the mL/min setpoint stays put.
+void applyFlowRecalibration(float factor)
+{
+  float speed = pump.getTargetSpeed() * factor;
+  if (calibrationTable.isValid())
+  {
+    CalibrationTable scaled = calibrationTable;
+    for (size_t i = 0; i < calibrationTable.pointCount(); i++)
+      scaled.addPoint(calibrationTable.point(i).speed, calibrationTable.point(i).stepsPerML * factor);
+    if (!scaled.build(pump.getMaxSpeed()))
+      return;
+    calibrationTable = scaled;
+    saveCalibrationTable();
+  }
+  else
+  {
+    saveCalibration(stepsPerML * factor);
+  }
+  pump.setSpeed(speed);
+  // Not a setpoint change, so no settling window
+  flowSetpoint = pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0;
+}
+
+#define RUN_STATE_MAGIC 0x52554E31 // "RUN1"
 
+uint32_t runStateCheck(const RunState &state)
+{
+  return fnv1aRecord(state);
+}
+
+// Picks up where the pump was before the reset. Without a record (first boot
+// after flashing) the pump starts at the speed saved from the menu, as before.
+void restoreRunState(float savedSpeed)
+{
+  EEPROM.get(RUN_STATE_EEPROM_ADDR, runState);
+  if (runState.magic != RUN_STATE_MAGIC || runState.check != runStateCheck(runState) || isnan(runState.speed))
+  {
+    runState.magic = RUN_STATE_MAGIC;
+    runState.speed = !isnan(savedSpeed) && savedSpeed > 0 ? savedSpeed : 0;
+    runState.enabled = runState.speed > 0;
+  }
+  if (runState.speed > 0)
+  {
+    pump.setSpeed(runState.speed);
+    if (!runState.enabled)
+      pump.stop(); // Keeps the speed for the enable button
+  }
+}
+
+// Persists the pump's on/off state and target speed once they have been
+// stable for RUN_STATE_SAVE_DELAY, so button bursts cost one flash write.
+// Doses are one-off and are not resumed.
+void updateRunState(unsigned long now)
+{
+  if (pump.isDosing())
+    return;
+  uint32_t enabled = pump.isEnabled();
+  float speed = pump.getTargetSpeed();
+  if (enabled == runState.enabled && speed == runState.speed)
+  {
+    runStateChangeTime = now;
+    return;
+  }
+  if (now - runStateChangeTime < RUN_STATE_SAVE_DELAY)
+    return;
+  runState.enabled = enabled;
+  runState.speed = speed;
+  runState.check = runStateCheck(runState);
+  EEPROM.put(RUN_STATE_EEPROM_ADDR, runState);
+  EEPROM.commit();
+}
+
+// A new image proves itself by reaching the backend or by staying up for
+// OTA_VALIDATION_MS. A downloaded one is booted once no dose is running.
+void updateOta(unsigned long now)
+{
+  if (ota.isOnProbation() && now >= OTA_VALIDATION_MS)
+    ota.markValid();
+
+  if (ota.state() == OtaUpdater::READY && !pump.isDosing())
+  {
+    pump.stop();
+    totalizer.update(pump.getStepCount());
+    totalizer.flush(now, true);
+    ota.restart();
+  }
+}
+
+// Drops into idle power mode while the pump is stopped and the display is off,
+// waking for buttons and for the next WiFi retry or sync.
+void updatePowerMode()
+{
+  bool idle = !pump.isEnabled() && display.isSleeping() && !inMenu && !showingSettings && !showingCalibrationResult &&
+              ota.state() != OtaUpdater::RECEIVING;
+  if (idle != power.isIdle())
+  {
+    power.setIdle(idle);
+    pump.setLowPower(idle);
+    pot.setLowPower(idle);
+  }
+  if (idle)
+    power.waitForEvent(min(msUntilNextDeadline(millis()), (unsigned long)IDLE_MAX_WAIT_MS));
+}
+
+unsigned long msUntilNextDeadline(unsigned long now)
+{
+  return syncPolicy.msUntilNext(now, wifi.isConnected(), pacingLink());
+}
+
+// Pacing backs off on a weak WiFi link. Bluetooth is a short local hop and
+// keeps the base rates.
+const LinkQuality *pacingLink()
+{
+  return router.isPrimaryActive() ? &wifi.linkQuality() : nullptr;
+}
+
+unsigned long syncInterval()
+{
+  return syncPolicy.syncInterval(pacingLink());
+}
+
+// Takes an RSSI sample for the link quality estimate and shows the result.
+// Returns the RSSI, -1 when WiFi is down.
+int sampleLink()
+{
   int rssi = wifi.getSignalStrength();
+  display.setSignalBars(rssi == -1 ? 0 : wifi.linkQuality().bars());
+  return rssi;
+}
+
+// Stall thresholds per loop() phase. Sync covers whole requests including
+// failover, the rest should never take more than a few hundred ms.
+void setupWatchdog()
+{
+  watchdog.begin(WATCHDOG_TIMEOUT_S);
+  phaseBoot = watchdog.add("boot", BOOT_STALL_MS);
+  phaseWifi = watchdog.add("wifi", NETWORK_STALL_MS); // Includes the settings fetch on connect
+  phaseUi = watchdog.add("ui", STALL_MS);
+  phaseSync = watchdog.add("sync", NETWORK_STALL_MS);
+  phaseRadio = watchdog.add("radio", NETWORK_STALL_MS); // Replays queued requests
+  phasePump = watchdog.add("pump", STALL_MS);
+  phaseIdle = watchdog.add("idle", STALL_MS);
+  phaseSelfTest = watchdog.add("selftest", NETWORK_STALL_MS); // Its network load blocks
+  heartbeatScheduler = watchdog.add("scheduler", STALL_MS);
+}
+
+void setupBle()
+{
+  // Handlers run from ble.poll() inside loop()
+  ble.onSpeedWrite([](float speed) {
+    pump.setSpeed(max(speed, 0.0f));
+    display.updateStatus(pump.isEnabled(), pump.getTargetSpeed() > 0 ? pump.getTargetSpeed() / pump.getSpeedStep() : 0);
+  });
+
+  ble.onDose([](float ml, float speed) {
+    totalizer.update(pump.getStepCount());
+    if (pump.dose(ml, speed > 0 ? speed : DOSE_DEFAULT_SPEED))
+      totalizer.beginDose();
+    else
+      LOG_WARN("Dose rejected: pump not calibrated or invalid volume");
+  });
+
+  ble.onCalibrationWrite([](float newStepsPerML) {
+    saveCalibration(newStepsPerML);
+  });
+
+  ble.setStateSource([]() {
+    BleService::State state;
+    state.speed = pump.getSpeed();
+    state.stepsPerML = pump.getStepsPerML();
+    state.mlPerMin = pump.isEnabled() && pump.getStepsPerML() > 0 ? pump.getSpeed() / pump.getStepsPerML() * 60 : 0;
+    state.steps = pump.getStepCount();
+    state.enabled = pump.isEnabled();
+    state.dosing = pump.isDosing();
+    return state;
+  });
+
+  ble.begin(BLE_MTU, BLE_TELEMETRY_INTERVAL, BLE_TELEMETRY_BATCH);
+}
+
+void syncData()
+{
+  TRACE_SCOPE(TRACE_SYNC);
+  BackendDocuments::SyncReport report = {};
+  report.rssi = sampleLink();
+  report.pumpId = ID_PERISTALTIC_STEPPER;
+  report.stepsPerML = pump.getStepsPerML();
+  report.stepsPerSecond = pump.getSpeedStep();
+  report.currentSpeed = pump.getTargetSpeed();
+  report.actualSpeed = pump.getSpeed();
+
+  const LinkQuality &quality = wifi.linkQuality();
+  report.link = {quality.percent(),     quality.hasSignal(),       quality.rssi(),
+                 quality.successRate(), quality.latencyMs(),       (uint32_t)syncInterval(),
+                 quality.connectFailures()};
+
+  BackendDocuments::FlowReport flow;
+  if (flowSensor.isStarted())
+  {
+    flow = {flowRegulator.measuredMlPerMin(), pump.getFlowTrim(), flowRegulator.sensorFault(),
+            flowRegulator.recalibrationCount()};
+    report.flow = &flow;
+  }
+
+  if (calibrationTable.isValid())
+  {
+    report.calibration = &calibrationTable.point(0);
+    report.calibrationCount = calibrationTable.pointCount();
+  }
 
-  doc["pumpId"] = ID_PERISTALTIC_STEPPER;
-  doc["stepsPerML"] = stepsPerML;
-  doc["stepsPerSecond"] = pump.getSpeedStep();
-  doc["currentSpeed"] = pump.getSpeed();
-  doc["rssi"] = rssi;
-  display.setSignalStrength(rssi);
+  totalizer.update(pump.getStepCount());
+  report.lifetimeML = totalizer.lifetimeML();
+  report.sessionML = totalizer.sessionML();
+  report.doseML = totalizer.doseML();
+  report.doseActive = totalizer.isDoseActive();
+  report.lifetimeSteps = totalizer.lifetimeSteps();
 
+  report.activeMs = power.timeInState(PowerManager::ACTIVE);
+  report.idleMs = power.timeInState(PowerManager::IDLE);
+  report.sleepMs = power.timeInState(PowerManager::SLEEP);
+
+  BackendDocuments::BootStage stages[BootTimeline::MAX_STAGES];
+  if (!bootReported)
+  {
+    report.resetReason = BootTimeline::resetReason();
+    report.bootStages = stages;
+    report.bootStageCount = bootTimeline.count();
+    for (size_t i = 0; i < report.bootStageCount; i++)
+      stages[i] = {bootTimeline.stage(i), bootTimeline.timeUs(i)};
+  }
+
+  // Fewer executions per request on a weak link, the rest go with the next sync
+  DoseScheduler::Execution executions[SCHEDULE_HISTORY_REPORT];
+  BackendDocuments::Execution history[SCHEDULE_HISTORY_REPORT];
+  size_t executionCount = scheduler.history(lastReportedExecution, executions, syncPolicy.historyBatch(pacingLink()));
+  for (size_t i = 0; i < executionCount; i++)
+  {
+    const DoseScheduler::Execution &execution = executions[i];
+    history[i] = {execution.seq,           execution.programId, DoseScheduler::outcomeName(execution.outcome),
+                  execution.scheduledUnix, execution.jitterMs,  execution.requestedML,
+                  execution.deliveredML};
+  }
+  report.programs = scheduler.programCount();
+  report.timeSynced = scheduler.isTimeSynced();
+  report.driftPpm = scheduler.driftPpm();
+  report.maxJitterMs = scheduler.maxJitterMs();
+  report.history = history;
+  report.historyCount = executionCount;
+
+  LoopWatchdog::Record stalls[LoopWatchdog::MAX_RECORDS];
+  BackendDocuments::Stall stallReports[LoopWatchdog::MAX_RECORDS];
+  size_t stallCount = watchdog.records(stalls, LoopWatchdog::MAX_RECORDS);
+  for (size_t i = 0; i < stallCount; i++)
+  {
+    const LoopWatchdog::Record &stall = stalls[i];
+    stallReports[i] = {stall.seq,       stall.boot,      stall.uptimeMs,          stall.subsystem,
+                       stall.loopPhase, stall.stalledMs, stall.resetFollowed != 0};
+  }
+  report.watchdogBoot = watchdog.bootCount();
+  report.stalls = stallReports;
+  report.stallCount = stallCount;
+
+  report.selfTestSafeMax = selfTestSafeMax;
+  report.maxSpeed = pump.getMaxSpeed();
+  report.firmwareVersion = FIRMWARE_VERSION;
+  report.otaState = OtaUpdater::stateName(ota.state());
+  report.otaProgress = ota.progress();
+  if (ota.state() == OtaUpdater::FAILED)
+    report.otaError = ota.lastError();
+
+  JsonDocument doc;
+  BackendDocuments::buildSync(doc, report);
   String jsonData;
   serializeJson(doc, jsonData);
 
   String response;
-  if (wifi.post(PUMP_SETTINGS_API, "application/json", jsonData.c_str(), response))
+  if (router.post(PUMP_SETTINGS_API, "application/json", jsonData.c_str(), response))
   {
-    Serial.println("Sync Ok");
+    LOG_INFO("Sync ok via %s", router.lastTransport()->name());
+    bootTimeline.markOnce("first sync");
+    bootReported = true;
+    if (executionCount > 0)
+      lastReportedExecution = executions[executionCount - 1].seq;
+    if (stallCount > 0)
+      watchdog.acknowledge(stalls[stallCount - 1].seq);
   }
   else
   {
-    Serial.println("Sync failed");
+    LOG_WARN("Sync failed, queued for replay");
+  }
+}
+
+// Revalidates the cached settings: the request carries the cached revision
+// and an empty response means nothing changed. Only a new revision is
+// applied, so local changes stick until the server's settings change.
+void fetchSettings()
+{
+  TRACE_SCOPE(TRACE_SETTINGS_FETCH);
+  syncPolicy.fetched(millis());
+  String path = String(PUMP_BY_ID_API) + "?pump-id=" + String(ID_PERISTALTIC_STEPPER);
+  if (settingsCache.hasDocument())
+    path += "&revision=" + settingsCache.revision();
+  String response;
+  if (!router.get(path.c_str(), response))
+    return;
+
+  // The backend reachable is good enough proof that a new image works
+  ota.markValid();
+  bootTimeline.markOnce("settings fetched");
+
+  JsonDocument doc;
+  const String &body = response.length() > 0 ? response : settingsCache.document();
+  DeserializationError error = deserializeJson(doc, body);
+  if (error)
+  {
+    LOG_ERROR("Failed to parse settings JSON: %s", error.c_str());
+    display.showText("Invalid Server Data");
+    return;
+  }
+
+  BackendDocuments::Settings settings;
+  BackendDocuments::parseSettings(doc, settings);
+  if (response.length() > 0 && settingsCache.store(response, settings.revision))
+  {
+    LOG_INFO("Settings revision %s", settingsCache.revision().c_str());
+    applySettings(settings);
+    display.showText("Server OK");
+    display.updateStatus(pump.isEnabled(), pump.getTargetSpeed() > 0 ? pump.getTargetSpeed() / pump.getSpeedStep() : 0);
+  }
+  offerFirmware(settings.firmware); // Every time, so a failed download is retried
+}
+
+void applySettings(const BackendDocuments::Settings &settings)
+{
+  if (settings.hasSpeed)
+  {
+    LOG_INFO("Setting pump speed to %.2f", settings.currentSpeed);
+    pump.setSpeed(settings.currentSpeed);
+  }
+  else
+  {
+    LOG_WARN("Response missing 'currentSpeed' field");
+    display.showText("Invalid Server Data");
+  }
+
+  if (settings.hasPrograms)
+    applyPrograms(settings.programs, settings.programCount);
+}
+
+// Offered firmware: {"version", "path", "sha256", "hmac"}, the sha256 of the
+// uncompressed image and its HMAC with the device secret
+void offerFirmware(const BackendDocuments::Firmware &firmware)
+{
+  if (firmware.version != nullptr && strcmp(firmware.version, FIRMWARE_VERSION) != 0 && firmware.path != nullptr &&
+      firmware.sha256 != nullptr && firmware.hmac != nullptr && wifi.isConnected())
+  {
+    if (ota.pull(wifi.serverAddress(), wifi.serverPort(), firmware.path, firmware.sha256, firmware.hmac))
+    {
+      LOG_INFO("Updating firmware to %s", firmware.version);
+    }
+  }
+}
+
+// currentSpeed from the cached settings, NAN if there is none. Dose programs
+// are not applied from here, the scheduler keeps its own copy.
+float cachedSpeed()
+{
+  JsonDocument doc;
+  if (!settingsCache.hasDocument() || deserializeJson(doc, settingsCache.document()) || !doc["currentSpeed"].is<float>())
+    return NAN;
+  return doc["currentSpeed"];
+}
+
+// Programs as parsed by BackendDocuments::parseSettings()
+void applyPrograms(const BackendDocuments::Program *list, size_t count)
+{
+  static_assert(BackendDocuments::MAX_PROGRAMS == DoseScheduler::MAX_PROGRAMS, "Program limits differ");
+  DoseScheduler::Program programs[DoseScheduler::MAX_PROGRAMS] = {};
+  for (size_t i = 0; i < count; i++)
+  {
+    programs[i].id = list[i].id;
+    programs[i].kind = list[i].daily ? DoseScheduler::DAILY : DoseScheduler::INTERVAL;
+    programs[i].enabled = list[i].enabled;
+    programs[i].time = list[i].time;
+    programs[i].ml = list[i].ml;
+    programs[i].speed = list[i].speed;
+  }
+
+  if (scheduler.setPrograms(programs, count))
+  {
+    LOG_INFO("Dose programs updated: %u", (unsigned)scheduler.programCount());
   }
 }
 
@@ -281,33 +907,276 @@ void runMenuSelection()
   }
   else if (menuIndex == 1)
   {
-    display.showSettingsInfo(pump.getSpeed(), pump.getStepsPerML(), pump.getSpeedStep());
+    display.showSettingsInfo(pump.getTargetSpeed(), pump.getStepsPerML(), pump.getSpeedStep());
     showingSettings = true;
     lastSettingsDisplayTime = millis();
   }
   else if (menuIndex == 2) // Save Speed
   {
-    float currentSpeed = pump.getSpeed();
+    float currentSpeed = pump.getTargetSpeed();
     EEPROM.put(EEPROM_ADDR + sizeof(stepsPerML), currentSpeed); // Store speed after stepsPerML
     EEPROM.commit();
-    Serial.print("Saved speed to EEPROM: ");
-    Serial.println(currentSpeed);
+    LOG_INFO("Saved speed to EEPROM: %.2f", currentSpeed);
     display.showText("Speed Saved!");
     delay(1000); // Show confirmation message briefly
   }
+  else if (menuIndex == 3)
+  {
+    calibrateTable();
+  }
+  else if (menuIndex == 4)
+  {
+    runSelfTest();
+  }
   inMenu = false;
 }
 
+void showPumpStatus()
+{
+  display.updateStatus(pump.isEnabled(), pump.getStepsPerML() > 0 ? pump.getTargetSpeed() / pump.getStepsPerML() * 60 : 0);
+}
+
+// Serial commands for bench work and host-side load tests
+void setupConsole()
+{
+  console.add("speed", "[steps/s]  show or set the pump speed, 0 stops", [](int argc, char *argv[], Print &out) {
+    float speed;
+    if (argc == 2 && SerialConsole::parseFloat(argv[1], speed) && speed >= 0)
+    {
+      pump.setSpeed(speed);
+      showPumpStatus();
+    }
+    else if (argc != 1)
+    {
+      out.println("usage: speed [steps/s]");
+      return;
+    }
+    out.printf("%s, target %.0f steps/s, now %.0f steps/s, limit %.0f\n", pump.isEnabled() ? "running" : "stopped",
+               pump.getTargetSpeed(), pump.getSpeed(), pump.getMaxSpeed());
+  });
+  console.add("stop", "stop the pump, keeping its speed", [](int, char *[], Print &out) {
+    pump.stop();
+    showPumpStatus();
+    out.println("stopped");
+  });
+  console.add("dose", "<mL> [steps/s]  deliver a volume", [](int argc, char *argv[], Print &out) {
+    float ml, speed = DOSE_DEFAULT_SPEED;
+    if (argc < 2 || argc > 3 || !SerialConsole::parseFloat(argv[1], ml) || (argc == 3 && !SerialConsole::parseFloat(argv[2], speed)))
+    {
+      out.println("usage: dose <mL> [steps/s]");
+      return;
+    }
+    totalizer.update(pump.getStepCount());
+    if (!pump.dose(ml, speed))
+    {
+      out.println("error: dose rejected, pump not calibrated or invalid volume");
+      return;
+    }
+    totalizer.beginDose();
+    showPumpStatus();
+    out.printf("dosing %.2f mL at %.0f steps/s\n", ml, pump.getTargetSpeed());
+  });
+  console.add("cal", "[steps/mL]  show the calibration, or set a single-point one", [](int argc, char *argv[], Print &out) {
+    float value;
+    if (argc == 2 && SerialConsole::parseFloat(argv[1], value) && value > 0)
+      saveCalibration(value);
+    else if (argc != 1)
+    {
+      out.println("usage: cal [steps/mL]");
+      return;
+    }
+    out.printf("base %.3f steps/mL, at target speed %.3f steps/mL\n", stepsPerML, pump.getStepsPerML());
+    for (size_t i = 0; i < calibrationTable.pointCount(); i++)
+      out.printf("  %.0f steps/s: %.3f steps/mL\n", calibrationTable.point(i).speed, calibrationTable.point(i).stepsPerML);
+  });
+  console.add("stats", "pump, volume, power, link, flow, pot, display and log counters", [](int, char *[], Print &out) {
+    totalizer.update(pump.getStepCount());
+    out.printf("uptime %lu ms, free heap %u, boot %u\n", millis(), (unsigned)ESP.getFreeHeap(), (unsigned)watchdog.bootCount());
+    out.printf("pump %s, %.0f steps/s, %u steps\n", pump.isEnabled() ? "running" : "stopped", pump.getSpeed(),
+               (unsigned)pump.getStepCount());
+    out.printf("volume lifetime %.2f mL, session %.2f mL, dose %.2f mL\n", totalizer.lifetimeML(), totalizer.sessionML(),
+               totalizer.doseML());
+    out.printf("power active %llu ms, idle %llu ms, sleep %llu ms\n", power.timeInState(PowerManager::ACTIVE),
+               power.timeInState(PowerManager::IDLE), power.timeInState(PowerManager::SLEEP));
+    for (size_t i = 0; i < router.transportCount(); i++)
+    {
+      const TransportRouter::LinkStats &link = router.stats(i);
+      out.printf("link %s %s, %.0f ms, %u ok, %u failed\n", link.transport->name(), link.healthy ? "healthy" : "unhealthy",
+                 link.latencyMs, (unsigned)link.successes, (unsigned)link.failures);
+    }
+    const LinkQuality &quality = wifi.linkQuality();
+    out.printf("wifi quality %u%%, rssi %.0f dBm, success %.0f%%, latency %.0f ms, sync every %lu s\n",
+               (unsigned)quality.percent(), quality.rssi(), quality.successRate() * 100, quality.latencyMs(),
+               syncInterval() / 1000);
+    if (flowSensor.isStarted())
+      out.printf("flow %.2f mL/min measured, trim %.3f, %u pulses, %u recalibrations%s\n",
+                 flowRegulator.measuredMlPerMin(), pump.getFlowTrim(), (unsigned)flowSensor.pulses(),
+                 (unsigned)flowRegulator.recalibrationCount(), flowRegulator.sensorFault() ? ", sensor fault" : "");
+    if (pot.isStarted())
+      out.printf("pot %u counts, position %.1f%%\n", (unsigned)pot.reading(), pot.position() * 100);
+    out.printf("schedule %u programs, max jitter %d ms\n", (unsigned)scheduler.programCount(), (int)scheduler.maxJitterMs());
+    DisplayManager::FlushStats flushes = display.flushStats();
+    out.printf("display %u transfers, %u bytes, last %u us, max %u us, %u errors\n", (unsigned)flushes.transfers,
+               (unsigned)flushes.bytes, (unsigned)flushes.lastUs, (unsigned)flushes.maxUs, (unsigned)flushes.errors);
+    out.printf("log dropped %u\n", (unsigned)Logger::dropped());
+  });
+  console.add("trace", "dump the event trace", [](int, char *[], Print &out) {
+    Logger::flush(1000); // Keeps log lines out of the dump
+    TraceRecorder::dump(out, []() { watchdog.feed(); });
+  });
+  console.add("selftest", "sweep step rates with the driver disabled", [](int, char *[], Print &) { runSelfTest(); });
+  console.add("tmc", "<register> [value]  read or write a driver register", [](int argc, char *argv[], Print &out) {
+    uint32_t address, value = 0;
+    if (argc < 2 || argc > 3 || !SerialConsole::parseUInt(argv[1], address) || address > 0x7F ||
+        (argc == 3 && !SerialConsole::parseUInt(argv[2], value)))
+    {
+      out.println("usage: tmc <register> [value]");
+      return;
+    }
+    if (argc == 3)
+      pump.writeRegister(address, value);
+    if (!pump.readRegister(address, value))
+      out.printf("error: no valid reply for register 0x%02x\n", (unsigned)address);
+    else
+      out.printf("0x%02x = 0x%08x\n", (unsigned)address, (unsigned)value);
+  });
+  console.add("settings", "show the cached server settings", [](int, char *[], Print &out) {
+    if (!settingsCache.hasDocument())
+    {
+      out.println("no cached settings");
+      return;
+    }
+    out.printf("revision %s\n", settingsCache.revision().c_str());
+    out.println(settingsCache.document());
+  });
+}
+
+// Sweeps step rates on the real step pin with the driver disabled, alone and
+// under display and network load, and reports the highest rate that held up
+// under all of them. MAX_SPEED should be set from this, with some margin.
+void runSelfTest()
+{
+  watchdog.enter(phaseSelfTest);
+  display.showText("Step self-test...");
+  LOG_INFO("Step self-test, driver disabled");
+  Logger::flush(1000); // The results table goes straight to Serial
+
+  static const uint32_t rates[] = SELF_TEST_RATES;
+  const StepSelfTest::Load loads[] = {
+      {"none", []() { watchdog.feed(); }},
+      {"display", []() {
+         watchdog.feed();
+         display.showText("Step self-test...");
+       }},
+      {"network", []() {
+         watchdog.feed();
+         if (wifi.isConnected())
+           wifi.checkApiHealth();
+       }},
+  };
+  uint32_t safeMax = 0;
+  bool ran = false;
+  pump.selfTest([&](StepEngine &engine) {
+    StepSelfTest test(engine, STEP_PIN);
+    if (!test.begin())
+      return;
+    safeMax = test.sweep(Serial, rates, sizeof(rates) / sizeof(rates[0]), loads, sizeof(loads) / sizeof(loads[0]),
+                         SELF_TEST_DURATION_MS);
+    test.end();
+    ran = true;
+  });
+  if (!ran)
+  {
+    LOG_ERROR("Self-test could not set up the pulse counter");
+    display.showText("Self-test failed");
+    return;
+  }
+  if (!wifi.isConnected())
+    LOG_WARN("WiFi was down, the network load was idle");
+
+  selfTestSafeMax = safeMax;
+  float mlPerMinute = pump.getStepsPerML() > 0 ? safeMax / pump.getStepsPerML() * 60 : 0;
+  LOG_INFO("Safe maximum: %u steps/sec (%.1f mL/min), limit is %.0f steps/sec", (unsigned)safeMax, mlPerMinute,
+           pump.getMaxSpeed());
+  display.showText(std::vector<String>{"Self-test done", "Safe max:", String(safeMax) + " steps/s",
+                                       String(mlPerMinute, 1) + " mL/min"});
+  showingCalibrationResult = true; // Same timeout back to the status screen
+  lastCalibrationResultTime = millis();
+}
+
 void calibrateDrop()
+{
+  runCalibrationPass(CALIBRATE_SPEED);
+  float ml = promptMeasuredML();
+
+  saveCalibration(ml > 0 ? (float)CALIBRATE_SPEED / ml : 0);
+  display.showCalibrationResult(stepsPerML, stepsPerSecond);
+  showingCalibrationResult = true;
+  lastCalibrationResultTime = millis();
+}
+
+// Guided multi-speed calibration: one timed run and one volume entry per speed.
+// Enable starts the next point, Menu finishes early with the points taken so far.
+void calibrateTable()
+{
+  const size_t speedCount = sizeof(calibrationTableSpeeds) / sizeof(calibrationTableSpeeds[0]);
+  CalibrationTable newTable;
+
+  for (size_t i = 0; i < speedCount; i++)
+  {
+    float speed = min(calibrationTableSpeeds[i], pump.getMaxSpeed());
+    std::vector<String> lines = {"Calibrate table",
+                                 "Point " + String(i + 1) + "/" + String(speedCount),
+                                 "Speed: " + String((int)speed),
+                                 "Enable: start",
+                                 "Menu: finish"};
+    display.showText(lines);
+
+    bool start = false;
+    while (!start)
+    {
+      watchdog.feed();
+      if (checkButtonPress(BUTTON_ENABLE_PIN))
+        start = true;
+      else if (checkButtonPress(BUTTON_MENU_PIN))
+        break;
+    }
+    if (!start)
+      break;
+
+    long steps = runCalibrationPass(speed);
+    float ml = promptMeasuredML();
+    if (ml > 0 && steps > 0)
+      newTable.addPoint(speed, steps / ml);
+  }
+
+  if (newTable.pointCount() == 0 || !newTable.build(pump.getMaxSpeed()))
+  {
+    display.showText("Calibration Aborted");
+    delay(1000);
+    return;
+  }
+
+  calibrationTable = newTable;
+  saveCalibrationTable();
+  display.showCalibrationResult(pump.getStepsPerML(), stepsPerSecond);
+  showingCalibrationResult = true;
+  lastCalibrationResultTime = millis();
+}
+
+// Runs the pump at speed for CALIBRATE_TIME and returns the steps issued
+long runCalibrationPass(float speed)
 {
   display.showCalibrationStart(CALIBRATE_TIME);
-  pump.setSpeed(CALIBRATE_SPEED);
+  uint32_t startSteps = pump.getStepCount();
+  pump.setSpeed(speed);
   unsigned long startTime = millis();
   unsigned long runDuration = CALIBRATE_TIME * 1000UL;
   unsigned long lastUpdate = 0;
   while (millis() - startTime < runDuration)
   {
     pump.run();
+    watchdog.feed();
     if (millis() - lastUpdate > 1000)
     {
       lastUpdate = millis();
@@ -315,11 +1184,16 @@ void calibrateDrop()
     }
   }
   pump.stop();
+  return (long)(pump.getStepCount() - startSteps);
+}
 
+float promptMeasuredML()
+{
   float ml = 0.0f;
   bool calibrating = true;
   while (calibrating)
   {
+    watchdog.feed();
     display.showCalibrationInput(ml);
     if (checkButtonPressOrHold(BUTTON_SPEED_UP_PIN))
       ml += 0.1f;
@@ -328,16 +1202,42 @@ void calibrateDrop()
     if (checkButtonPress(BUTTON_ENABLE_PIN))
       calibrating = false;
   }
+  return ml;
+}
+
+void saveCalibrationTable()
+{
+  totalizer.update(pump.getStepCount());
+  pump.setCalibrationTable(calibrationTable.isValid() ? &calibrationTable : nullptr);
+  totalizer.setStepsPerML(pump.getStepsPerML());
+
+  CalibrationTable::Stored stored;
+  calibrationTable.store(stored);
+  EEPROM.put(CALIBRATION_TABLE_EEPROM_ADDR, stored);
+  EEPROM.commit();
+}
 
-  stepsPerML = ml > 0 ? (float)CALIBRATE_SPEED / ml : 0;
+void saveCalibration(float newStepsPerML)
+{
+  // Credit steps run so far to the old calibration before switching
+  totalizer.update(pump.getStepCount());
+  stepsPerML = newStepsPerML > 0 ? newStepsPerML : 0;
   stepsPerSecond = stepsPerML > 0 ? (int)(stepsPerML / 60) : 2000;
   pump.setStepsPerML(stepsPerML);
   pump.setSpeedStep(stepsPerSecond);
   EEPROM.put(EEPROM_ADDR, stepsPerML);
-  EEPROM.commit();
-  display.showCalibrationResult(stepsPerML, stepsPerSecond);
-  showingCalibrationResult = true;
-  lastCalibrationResultTime = millis();
+
+  // A single-point calibration replaces the table
+  if (calibrationTable.pointCount() > 0)
+  {
+    calibrationTable.clear();
+    saveCalibrationTable(); // Commits both
+  }
+  else
+  {
+    totalizer.setStepsPerML(pump.getStepsPerML());
+    EEPROM.commit();
+  }
 }
 
 bool checkButtonPress(uint8_t pin)
@@ -351,12 +1251,14 @@ bool checkButtonPress(uint8_t pin)
       while (digitalRead(pin) == LOW)
       {
         pump.run();
+        watchdog.feed();
       }
       return false;
     }
     while (digitalRead(pin) == LOW)
     {
       pump.run();
+      watchdog.feed();
     }
     return true;
   }
@@ -365,47 +1267,23 @@ bool checkButtonPress(uint8_t pin)
 
 bool checkButtonPressOrHold(uint8_t pin)
 {
-  static unsigned long holdStartTime[4] = {0}; // Tracks when the button was first pressed
-  static unsigned long lastActionTime[4] = {0}; // Tracks the last time an action was triggered
+  static ButtonRepeat repeat[4];
   int index = (pin == BUTTON_SPEED_UP_PIN) ? 0 : (pin == BUTTON_SPEED_DOWN_PIN) ? 1
                                              : (pin == BUTTON_MENU_PIN)         ? 2
                                                                                 : 3;
 
-  if (digitalRead(pin) == LOW)
+  bool pressed = digitalRead(pin) == LOW;
+  if (pressed && display.isSleeping())
   {
-    if (display.isSleeping())
-    {
-      lastButtonPressTime = millis();
-      display.wakeDisplay();
-      while (digitalRead(pin) == LOW)
-        pump.run();
-      return false;
-    }
-
-    if (holdStartTime[index] == 0)
-    {
-      // Button just pressed
-      holdStartTime[index] = millis();
-      lastActionTime[index] = millis();
-      return true;
-    }
-    else
+    lastButtonPressTime = millis();
+    display.wakeDisplay();
+    while (digitalRead(pin) == LOW)
     {
-      unsigned long totalHoldTime = millis() - holdStartTime[index]; // Total time button has been held
-      unsigned long interval = (totalHoldTime > 2000) ? 100 : 500;   // Reduce interval to 100ms after 2 seconds
-
-      if (millis() - lastActionTime[index] >= interval)
-      {
-        lastActionTime[index] = millis(); // Update the last action time
-        return true;
-      }
+      pump.run();
+      watchdog.feed();
     }
+    repeat[index].update(false, millis()); // The wake press does not count
+    return false;
   }
-  else
-  {
-    // Button released, reset timers
-    holdStartTime[index] = 0;
-    lastActionTime[index] = 0;
-  }
-  return false;
-}
\ No newline at end of file
+  return repeat[index].update(pressed, millis());
+}
@@ -0,0 +1,320 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <new>
+#include <sstream>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Allocation counting. glibc exposes its allocator as __libc_*, so malloc()
+// can be wrapped without dlsym; operator new goes through malloc() too.
+extern "C"
+{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void __libc_free(void *ptr);
+}
+
+namespace
+{
+  bool counting = false;
+  uint64_t allocations = 0;
+  uint64_t allocatedBytes = 0;
+
+  inline void count(size_t size)
+  {
+    if (counting)
+    {
+      allocations++;
+      allocatedBytes += size;
+    }
+  }
+}
+
+extern "C"
+{
+  void *malloc(size_t size)
+  {
+    count(size);
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t n, size_t size)
+  {
+    count(n * size);
+    return __libc_calloc(n, size);
+  }
+
+  void *realloc(void *ptr, size_t size)
+  {
+    count(size);
+    return __libc_realloc(ptr, size);
+  }
+
+  void free(void *ptr)
+  {
+    __libc_free(ptr);
+  }
+}
+
+void *operator new(size_t size)
+{
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size)
+{
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+namespace bench
+{
+  namespace
+  {
+    struct Entry
+    {
+      std::string name;
+      std::function<void()> body;
+    };
+
+    std::vector<Entry> &registry()
+    {
+      static std::vector<Entry> entries;
+      return entries;
+    }
+
+    size_t lastOutputBytes = 0;
+
+    uint64_t timeOps(const std::function<void()> &body, uint64_t ops)
+    {
+      auto start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < ops; i++)
+        body();
+      auto end = std::chrono::steady_clock::now();
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    Result measure(const Entry &entry)
+    {
+      Result result;
+      result.name = entry.name;
+
+      // Warm up, then grow the batch until one sample is long enough
+      uint64_t ops = 1;
+      uint64_t elapsed = timeOps(entry.body, ops);
+      while (elapsed < SAMPLE_NS && ops < (1ULL << 40))
+      {
+        ops = elapsed == 0 ? ops * 100 : std::max(ops * 2, (uint64_t)(ops * 1.2 * SAMPLE_NS / elapsed));
+        elapsed = timeOps(entry.body, ops);
+      }
+
+      std::vector<double> samples;
+      for (int i = 0; i < SAMPLES; i++)
+        samples.push_back((double)timeOps(entry.body, ops) / ops);
+      std::sort(samples.begin(), samples.end());
+      result.nsPerOp = samples[SAMPLES / 2];
+      result.minNsPerOp = samples[0];
+      result.spread = (samples[SAMPLES * 3 / 4] - samples[SAMPLES / 4]) / result.nsPerOp;
+
+      const uint64_t countOps = 1000;
+      lastOutputBytes = 0;
+      allocations = 0;
+      allocatedBytes = 0;
+      counting = true;
+      for (uint64_t i = 0; i < countOps; i++)
+        entry.body();
+      counting = false;
+      result.allocsPerOp = (double)allocations / countOps;
+      result.bytesPerOp = (double)allocatedBytes / countOps;
+      result.outputBytes = lastOutputBytes;
+      return result;
+    }
+
+    // Baseline file: one "name ns/op allocs/op" line per benchmark
+    std::map<std::string, Result> loadBaseline(const char *path)
+    {
+      std::map<std::string, Result> baseline;
+      std::ifstream in(path);
+      std::string line;
+      while (std::getline(in, line))
+      {
+        if (line.empty() || line[0] == '#')
+          continue;
+        std::istringstream fields(line);
+        Result result;
+        if (fields >> result.name >> result.nsPerOp >> result.allocsPerOp)
+          baseline[result.name] = result;
+      }
+      return baseline;
+    }
+
+    bool saveBaseline(const char *path, const std::vector<Result> &results)
+    {
+      FILE *out = fopen(path, "w");
+      if (!out)
+        return false;
+      fprintf(out, "# name ns/op allocs/op\n");
+      for (const Result &result : results)
+        fprintf(out, "%s %.3f %.3f\n", result.name.c_str(), result.nsPerOp, result.allocsPerOp);
+      fclose(out);
+      return true;
+    }
+
+    // Every sample slower than the baseline by more than the tolerance and
+    // the noise floor, or allocating more. Noise only ever adds time, so a
+    // real slowdown moves the fastest sample too.
+    bool regressed(const Result &result, const Result &base, double tolerance)
+    {
+      return result.minNsPerOp > base.nsPerOp * (1 + tolerance) + NOISE_FLOOR_NS ||
+             result.allocsPerOp > base.allocsPerOp + 0.01;
+    }
+
+    void pinToOneCpu()
+    {
+#ifdef __linux__
+      // Migrations between cores are a large part of the run-to-run noise
+      int cpu = sched_getcpu();
+      if (cpu >= 0)
+      {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+      }
+#endif
+    }
+
+    void usage(const char *program)
+    {
+      printf("usage: %s [--filter TEXT] [--save FILE] [--baseline FILE] [--tolerance PERCENT]\n", program);
+    }
+  }
+
+  void setOutputBytes(size_t bytes)
+  {
+    lastOutputBytes = bytes;
+  }
+
+  void add(const char *name, std::function<void()> body)
+  {
+    registry().push_back({name, body});
+  }
+
+  int runAll(int argc, char **argv)
+  {
+    const char *filter = nullptr;
+    const char *savePath = nullptr;
+    const char *baselinePath = nullptr;
+    double tolerance = 0.10;
+    for (int i = 1; i < argc; i++)
+    {
+      bool hasValue = i + 1 < argc;
+      if (strcmp(argv[i], "--filter") == 0 && hasValue)
+        filter = argv[++i];
+      else if (strcmp(argv[i], "--save") == 0 && hasValue)
+        savePath = argv[++i];
+      else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+        baselinePath = argv[++i];
+      else if (strcmp(argv[i], "--tolerance") == 0 && hasValue)
+        tolerance = atof(argv[++i]) / 100;
+      else
+      {
+        usage(argv[0]);
+        return 2;
+      }
+    }
+
+    std::map<std::string, Result> baseline;
+    if (baselinePath)
+    {
+      baseline = loadBaseline(baselinePath);
+      if (baseline.empty())
+      {
+        fprintf(stderr, "no baseline entries in %s\n", baselinePath);
+        return 2;
+      }
+    }
+
+    pinToOneCpu();
+    printf("%-32s %12s %7s %10s %10s %8s\n", "benchmark", "ns/op", "+-", "allocs/op", "B/op", "out B");
+
+    std::vector<Result> results;
+    int regressions = 0;
+    for (const Entry &entry : registry())
+    {
+      if (filter && entry.name.find(filter) == std::string::npos)
+        continue;
+      Result result = measure(entry);
+
+      auto base = baseline.find(entry.name);
+      bool slower = base != baseline.end() && regressed(result, base->second, tolerance);
+      // A slow result gets two more chances, the best one counts
+      for (int retry = 0; slower && retry < 2; retry++)
+      {
+        Result again = measure(entry);
+        if (again.minNsPerOp < result.minNsPerOp)
+          result = again;
+        slower = regressed(result, base->second, tolerance);
+      }
+
+      printf("%-32s %12.2f %6.1f%% %10.2f %10.1f %8zu", result.name.c_str(), result.nsPerOp, result.spread * 100,
+             result.allocsPerOp, result.bytesPerOp, result.outputBytes);
+      if (base != baseline.end())
+      {
+        printf("  %+6.1f%%", (result.nsPerOp / base->second.nsPerOp - 1) * 100);
+        if (slower)
+        {
+          printf("  REGRESSION");
+          regressions++;
+        }
+      }
+      printf("\n");
+      results.push_back(result);
+    }
+
+    if (savePath && !saveBaseline(savePath, results))
+    {
+      fprintf(stderr, "cannot write %s\n", savePath);
+      return 2;
+    }
+    if (regressions > 0)
+    {
+      printf("%d benchmark(s) regressed beyond %.0f%%\n", regressions, tolerance * 100);
+      return 1;
+    }
+    return 0;
+  }
+}
@@ -0,0 +1,56 @@
+// Minimal benchmark harness for the host suite: repeatable timings, heap
+// allocation counts and a baseline file for regression checks.
+//
+// Each benchmark body runs one operation. The harness picks an iteration
+// count that makes a sample last SAMPLE_NS, takes SAMPLES samples and
+// reports the median, so one preempted sample does not move the result.
+// A regression needs even the fastest sample to be slower than the
+// baseline's median by the tolerance plus NOISE_FLOOR_NS, so a noisy run of
+// an unchanged build does not fail the check.
+// Allocations are counted in a separate single pass through the malloc and
+// operator new hooks in bench.cpp, so counting does not skew the timings.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace bench
+{
+  const int SAMPLES = 9;
+  const uint64_t SAMPLE_NS = 20000000; // 20 ms
+  const double NOISE_FLOOR_NS = 0.5;   // Per op, changes below this are timer and clock jitter
+
+  struct Result
+  {
+    std::string name;
+    double nsPerOp = 0;
+    double minNsPerOp = 0; // Fastest sample
+    double spread = 0; // Interquartile range over the median
+    double allocsPerOp = 0;
+    double bytesPerOp = 0; // Heap bytes requested per op
+    size_t outputBytes = 0; // What one op produced, e.g. serialized JSON, 0 if n/a
+  };
+
+  // Keeps the compiler from optimizing away a value or the work behind it
+  template <typename T>
+  inline void keep(T const &value)
+  {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+
+  void setOutputBytes(size_t bytes); // Call from a benchmark body
+
+  // Registers a benchmark, run later by runAll()
+  void add(const char *name, std::function<void()> body);
+
+  // Parses --filter, --baseline, --save and --tolerance, runs the matching
+  // benchmarks and prints the report. Returns the process exit code.
+  int runAll(int argc, char **argv);
+}
+
+#endif
@@ -0,0 +1,247 @@
+// Host benchmarks for the firmware's hot paths.
+//
+// Build from the repository root:
+//   g++ -std=gnu++17 -O2 -Ilib/StepTimer -Ilib/SpeedRamp -Ilib/ButtonRepeat -Ilib/DisplayManager
+//       -o bench_suite lib/SpeedRamp/SpeedRamp.cpp tools/bench/bench.cpp tools/bench/bench_suite.cpp
+//
+// The JSON and display benchmarks need ArduinoJson and Adafruit GFX, which
+// PlatformIO downloads on the first firmware build. With
+// LIBDEPS=.pio/libdeps/esp32dev, add:
+//   -I$LIBDEPS/ArduinoJson/src -Ilib/CalibrationTable -Ilib/BackendDocuments
+//       lib/BackendDocuments/BackendDocuments.cpp
+//   -Itools/bench/host "-I$LIBDEPS/Adafruit GFX Library"
+//       lib/DisplayManager/DisplayScreens.cpp "$LIBDEPS/Adafruit GFX Library/Adafruit_GFX.cpp"
+// Benchmarks whose library is missing are skipped.
+//
+// Usage:
+//   ./bench_suite                        run everything and print the report
+//   ./bench_suite --filter json          only benchmarks whose name contains "json"
+//   ./bench_suite --save before.txt      record a baseline
+//   ./bench_suite --baseline before.txt  compare, exit 1 if anything's fastest
+//                                        sample got more than --tolerance percent
+//                                        (default 10) slower than the baseline
+//                                        median, or it allocates more
+//
+// Baselines are only comparable on the same machine and compiler flags: save
+// one before a change and check against it after. The JSON benchmarks run
+// BackendDocuments, the code syncData() and fetchSettings() call.
+
+#include "bench.h"
+
+#include <ButtonRepeat.h>
+#include <SpeedRamp.h>
+#include <StepTimer.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#include <BackendDocuments.h>
+#define HAVE_ARDUINOJSON 1
+#endif
+
+#if __has_include(<Adafruit_GFX.h>)
+#include <Adafruit_GFX.h>
+#include <DisplayScreens.h>
+#define HAVE_GFX 1
+#endif
+
+namespace
+{
+  // PumpController's step interval generation: StepTimer paces the steps,
+  // SpeedRamp moves the rate
+  void addStepBenchmarks()
+  {
+    static StepTimer timer;
+    static uint32_t now = 0;
+    timer.setRate(StepTimer::toRate(3333.33f), 0);
+    bench::add("step/StepTimer::due", []() {
+      now += 7; // A busy loop() polls every few us
+      bench::keep(timer.due(now));
+    });
+
+    static uint32_t rampNow = 0;
+    bench::add("step/StepTimer::setRate", []() {
+      rampNow += 7;
+      timer.setRate(StepTimer::toRate(3000.0f + (rampNow & 0xFF)), rampNow);
+      bench::keep(timer.due(rampNow));
+    });
+
+    static SpeedRamp ramp;
+    static uint32_t rampMs = 0;
+    ramp.setAcceleration(8000);
+    bench::add("step/SpeedRamp::update", []() {
+      // Once per ms while ramping, back and forth between 0 and 4000 steps/s
+      if (!ramp.isRamping())
+        ramp.setTarget(ramp.current() == 0 ? StepTimer::toRate(4000) : 0, rampMs);
+      bench::keep(ramp.update(rampMs++));
+    });
+  }
+
+  // checkButtonPressOrHold(): press, hold for 3 s, release for 1 s, polled
+  // every 50 us. The trace is built up front so every op costs the same.
+  void addButtonBenchmarks()
+  {
+    static const size_t TRACE_LENGTH = 80000; // 4 s at 50 us
+    static std::vector<bool> pressed(TRACE_LENGTH);
+    for (size_t i = 0; i < TRACE_LENGTH; i++)
+      pressed[i] = i < TRACE_LENGTH * 3 / 4;
+    static ButtonRepeat repeat;
+    static size_t poll = 0;
+    bench::add("buttons/ButtonRepeat::update", []() {
+      size_t i = poll++ % TRACE_LENGTH;
+      bench::keep(repeat.update(pressed[i], (unsigned long)(poll / 20)));
+    });
+  }
+
+#ifdef HAVE_ARDUINOJSON
+  // A pump mid-run with a flow sensor, a calibration table, a self-test and
+  // a boot not reported yet, so every part of the document is there
+  const BackendDocuments::SyncReport &syncReport()
+  {
+    static const BackendDocuments::FlowReport flow = {38.2f, 1.03f, false, 2};
+    static const CalibrationTable::Point calibration[] = {
+        {500, 3100}, {1375, 3111.5f}, {2250, 3123}, {3125, 3134.5f}, {4000, 3146}};
+    static const BackendDocuments::BootStage stages[] = {
+        {"config", 41200}, {"display", 118400}, {"wifi", 902300}, {"settings fetched", 1650800}};
+    static const BackendDocuments::Execution history[] = {
+        {40, 1, "delivered", 1760000000u, 37, 2.5f, 2.49f}, {41, 2, "delivered", 1760005400u, 41, 0.5f, 0.5f}};
+    static const BackendDocuments::Stall stalls[] = {{7, 11, 5400210, "wifi", "sync", 2150, false}};
+
+    static BackendDocuments::SyncReport report = {};
+    report.pumpId = "pump-1";
+    report.stepsPerML = 3120.5f;
+    report.stepsPerSecond = 52;
+    report.currentSpeed = 2000;
+    report.actualSpeed = 1987.25f;
+    report.rssi = -61;
+    report.link = {87, true, -61.4f, 0.98f, 182.5f, 250200, 0};
+    report.flow = &flow;
+    report.calibration = calibration;
+    report.calibrationCount = 5;
+    report.lifetimeML = 123456.789;
+    report.sessionML = 321.5;
+    report.doseML = 2.5;
+    report.lifetimeSteps = 385000000ULL;
+    report.activeMs = 86400000ULL;
+    report.idleMs = 3600000ULL;
+    report.sleepMs = 7200000ULL;
+    report.resetReason = "power on";
+    report.bootStages = stages;
+    report.bootStageCount = 4;
+    report.programs = 2;
+    report.timeSynced = true;
+    report.driftPpm = 12.5f;
+    report.maxJitterMs = 104;
+    report.history = history;
+    report.historyCount = 2;
+    report.watchdogBoot = 12;
+    report.stalls = stalls;
+    report.stallCount = 1;
+    report.selfTestSafeMax = 4200;
+    report.maxSpeed = 4000;
+    report.firmwareVersion = "1.1.0";
+    report.otaState = "idle";
+    return report;
+  }
+
+  const char *SETTINGS_RESPONSE =
+      "{\"pumpId\":\"pump-1\",\"revision\":\"r-1842\",\"currentSpeed\":2000,"
+      "\"programs\":[{\"id\":1,\"ml\":2.5,\"at\":\"08:30\"},{\"id\":2,\"ml\":0.5,\"speed\":1500,\"everyMinutes\":90},"
+      "{\"id\":3,\"ml\":1.25,\"at\":\"20:15:30\",\"enabled\":false}],"
+      "\"firmware\":{\"version\":\"1.1.0\",\"path\":\"/firmware/pump-1.1.0.bin.gz\","
+      "\"sha256\":\"9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08\","
+      "\"hmac\":\"5d1c7ba0e2f35a4e8c0a7f1d9b63e21c4a8f07d2b9e56c13f0a4d78e2b19c6f5\"},"
+      "\"updatedAt\":\"2026-10-19T08:00:00Z\"}";
+
+  void addJsonBenchmarks()
+  {
+    bench::add("json/sync build+serialize", []() {
+      JsonDocument doc;
+      BackendDocuments::buildSync(doc, syncReport());
+      std::string out;
+      serializeJson(doc, out);
+      bench::setOutputBytes(out.size());
+      bench::keep(out);
+    });
+
+    bench::add("json/sync serialize", []() {
+      static JsonDocument doc;
+      if (doc.isNull())
+        BackendDocuments::buildSync(doc, syncReport());
+      static char out[2048];
+      size_t length = serializeJson(doc, out, sizeof(out));
+      bench::setOutputBytes(length);
+      bench::keep(out);
+    });
+
+    // fetchSettings(): parse the response, then read the settings out of it
+    bench::add("json/settings parse", []() {
+      JsonDocument doc;
+      if (deserializeJson(doc, SETTINGS_RESPONSE))
+        return;
+      BackendDocuments::Settings settings;
+      BackendDocuments::parseSettings(doc, settings);
+      bench::keep(settings);
+      bench::setOutputBytes(strlen(SETTINGS_RESPONSE));
+    });
+  }
+#endif
+
+#ifdef HAVE_GFX
+  // Renders into a canvas laid out like the SSD1306 framebuffer (128x64, 1 bpp)
+  void addDisplayBenchmarks()
+  {
+    static GFXcanvas1 canvas(128, 64);
+    canvas.setTextSize(1);
+    canvas.setTextColor(1);
+
+    bench::add("display/status frame", []() {
+      canvas.fillScreen(0);
+      DisplayScreens::drawStatus(canvas, true, 38.46f);
+      DisplayScreens::drawSignalStrength(canvas, 3);
+      bench::keep(canvas.getBuffer()[0]);
+      bench::setOutputBytes(128 * 64 / 8);
+    });
+
+    // What DisplayManager::updateStatus() redraws when only the rate moved
+    static float rate = 0;
+    bench::add("display/status rate field", []() {
+      char text[DisplayScreens::FIELD_TEXT_SIZE];
+      DisplayScreens::formatStatusRate(text, rate += 0.01f);
+      DisplayScreens::drawField(canvas, DisplayScreens::STATUS_RATE, text);
+      bench::keep(canvas.getBuffer()[0]);
+      bench::setOutputBytes(DisplayScreens::STATUS_RATE.w); // One page of the field's columns
+    });
+
+    static const char *menuItems[] = {"Calibrate Drop", "Settings Info", "Save Speed", "Calibrate Table"};
+    static int menuIndex = 0;
+    bench::add("display/menu frame", []() {
+      canvas.fillScreen(0);
+      DisplayScreens::drawMenu(canvas, menuIndex++ & 3, menuItems, 4);
+      DisplayScreens::drawSignalStrength(canvas, 3);
+      bench::keep(canvas.getBuffer()[0]);
+      bench::setOutputBytes(128 * 64 / 8);
+    });
+  }
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  addStepBenchmarks();
+  addButtonBenchmarks();
+#ifdef HAVE_ARDUINOJSON
+  addJsonBenchmarks();
+#else
+  printf("json/*: skipped, ArduinoJson is not on the include path\n");
+#endif
+#ifdef HAVE_GFX
+  addDisplayBenchmarks();
+#else
+  printf("display/*: skipped, Adafruit GFX is not on the include path\n");
+#endif
+  return bench::runAll(argc, argv);
+}
@@ -0,0 +1 @@
+// Adafruit_GFX.h pulls in BusIO; nothing from it is needed for a canvas
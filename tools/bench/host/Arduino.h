@@ -0,0 +1,44 @@
+// Just enough of the Arduino core to build Adafruit_GFX on the host, for the
+// display benchmarks. Not a general emulation.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#define pgm_read_word(addr) (*(const unsigned short *)(addr))
+#define pgm_read_dword(addr) (*(const unsigned long *)(addr))
+#define pgm_read_pointer(addr) ((void *)*(addr))
+
+class __FlashStringHelper;
+#define F(literal) (reinterpret_cast<const __FlashStringHelper *>(literal))
+
+class String
+{
+public:
+  String(const char *text = "") : value(text) {}
+  const char *c_str() const { return value.c_str(); }
+  unsigned int length() const { return value.length(); }
+
+private:
+  std::string value;
+};
+
+#include "Print.h"
+
+#endif
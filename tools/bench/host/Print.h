@@ -0,0 +1,67 @@
+#ifndef HOST_PRINT_H
+#define HOST_PRINT_H
+
+#include "Arduino.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define DEC 10
+#define HEX 16
+
+// Arduino's Print, formatting numbers the same way
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t n = 0;
+    while (size--)
+      n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char *text) { return text ? write((const uint8_t *)text, strlen(text)) : 0; }
+
+  size_t print(const __FlashStringHelper *text) { return write(reinterpret_cast<const char *>(text)); }
+  size_t print(const String &text) { return write(text.c_str()); }
+  size_t print(const char *text) { return write(text); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = DEC) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = DEC)
+  {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%ld", value);
+    return write(text);
+  }
+  size_t print(unsigned long value, int base = DEC)
+  {
+    char text[24];
+    snprintf(text, sizeof(text), base == HEX ? "%lx" : "%lu", value);
+    return write(text);
+  }
+  size_t print(double value, int digits = 2)
+  {
+    char text[40];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return write(text);
+  }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T &value)
+  {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T &value, int format)
+  {
+    size_t n = print(value, format);
+    return n + println();
+  }
+};
+
+#endif
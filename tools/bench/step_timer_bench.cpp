@@ -0,0 +1,149 @@
+// Host benchmark: fixed-point StepTimer vs the float AccelStepper runSpeed() path.
+//
+// Build from the repository root:
+//   g++ -std=gnu++17 -O2 -Ilib/StepTimer tools/bench/step_timer_bench.cpp -o step_timer_bench
+//
+// Reports the CPU cost per poll and per issued step, and how far each scheduler
+// drifts from the commanded step count over a simulated hour of loop() polling
+// with realistic jitter and occasional stalls. Host numbers understate the
+// float path's setpoint-change cost: the ESP32 has no double-precision FPU, so
+// AccelStepper's 1000000.0 / speed runs in software there.
+
+#include <StepTimer.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+
+namespace
+{
+  // Mirrors AccelStepper::setSpeed()/runSpeed() for a forward-only DRIVER stepper
+  struct FloatStepper
+  {
+    float speed = 0;
+    unsigned long stepInterval = 0;
+    unsigned long lastStepTime = 0;
+
+    void setSpeed(float s)
+    {
+      if (s == speed)
+        return;
+      stepInterval = s == 0 ? 0 : std::fabs(1000000.0 / s);
+      speed = s;
+    }
+
+    bool runSpeed(unsigned long time)
+    {
+      if (!stepInterval)
+        return false;
+      if (time - lastStepTime >= stepInterval)
+      {
+        lastStepTime = time;
+        return true;
+      }
+      return false;
+    }
+  };
+
+  // loop() timing: a busy base period with jitter, plus a 2 ms stall now and then
+  struct LoopModel
+  {
+    std::mt19937 rng{42};
+    uint32_t next()
+    {
+      uint32_t dt = 20 + rng() % 30;
+      if (rng() % 5000 == 0)
+        dt += 2000;
+      return dt;
+    }
+  };
+
+  double nsPer(std::chrono::steady_clock::duration d, uint64_t n)
+  {
+    return std::chrono::duration<double, std::nano>(d).count() / n;
+  }
+
+  void benchCost(float speed)
+  {
+    const uint64_t polls = 50000000;
+    volatile uint64_t sink = 0;
+
+    FloatStepper f;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t floatSteps = 0;
+    for (uint64_t i = 0; i < polls; i++)
+    {
+      f.setSpeed(speed);
+      floatSteps += f.runSpeed((unsigned long)(i * 7));
+    }
+    auto floatTime = std::chrono::steady_clock::now() - t0;
+    sink = sink + floatSteps;
+
+    StepTimer s;
+    s.setRate(StepTimer::toRate(speed), 0);
+    t0 = std::chrono::steady_clock::now();
+    uint64_t fixedSteps = 0;
+    for (uint64_t i = 0; i < polls; i++)
+      fixedSteps += s.due((uint32_t)(i * 7));
+    auto fixedTime = std::chrono::steady_clock::now() - t0;
+    sink = sink + fixedSteps;
+
+    // Setpoint changing on every poll, as during a ramp: the float path divides each time
+    t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < polls / 10; i++)
+    {
+      f.setSpeed(speed + (i & 1));
+      sink = sink + f.runSpeed((unsigned long)(i * 7));
+    }
+    auto floatChange = std::chrono::steady_clock::now() - t0;
+    t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < polls / 10; i++)
+    {
+      s.setRate(StepTimer::toRate(speed + (i & 1)), (uint32_t)(i * 7));
+      sink = sink + s.due((uint32_t)(i * 7));
+    }
+    auto fixedChange = std::chrono::steady_clock::now() - t0;
+
+    printf("cost @ %.2f steps/s\n", speed);
+    printf("  %-26s %8.2f ns/poll %8.2f ns/step\n", "float runSpeed()", nsPer(floatTime, polls), nsPer(floatTime, floatSteps));
+    printf("  %-26s %8.2f ns/poll %8.2f ns/step\n", "StepTimer::due()", nsPer(fixedTime, polls), nsPer(fixedTime, fixedSteps));
+    printf("  %-26s %8.2f ns/poll\n", "float, setpoint changing", nsPer(floatChange, polls / 10));
+    printf("  %-26s %8.2f ns/poll\n", "fixed, setpoint changing", nsPer(fixedChange, polls / 10));
+  }
+
+  void benchDrift(float speed, uint32_t seconds)
+  {
+    FloatStepper f;
+    f.setSpeed(speed);
+    StepTimer s;
+    s.setRate(StepTimer::toRate(speed), 0);
+
+    LoopModel loop;
+    uint64_t now = 0, floatSteps = 0, fixedSteps = 0;
+    const uint64_t end = (uint64_t)seconds * 1000000;
+    while (now < end)
+    {
+      now += loop.next();
+      floatSteps += f.runSpeed((unsigned long)now);
+      fixedSteps += s.due((uint32_t)now);
+    }
+
+    double expected = (double)speed * seconds;
+    printf("drift @ %.2f steps/s over %u s (expected %.0f steps)\n", speed, seconds, expected);
+    printf("  %-26s %12llu steps %+10.0f (%+8.1f ppm)\n", "float runSpeed()", (unsigned long long)floatSteps,
+           floatSteps - expected, (floatSteps - expected) / expected * 1e6);
+    printf("  %-26s %12llu steps %+10.0f (%+8.1f ppm), %u resyncs\n", "StepTimer::due()", (unsigned long long)fixedSteps,
+           fixedSteps - expected, (fixedSteps - expected) / expected * 1e6, s.resyncCount());
+  }
+}
+
+int main()
+{
+  benchCost(3333.33f);
+  benchDrift(3333.33f, 3600);
+  benchDrift(1234.5f, 3600);
+  benchDrift(150.0f, 3600);
+  return 0;
+}
@@ -0,0 +1,556 @@
+// Fleet simulator: many pumps syncing against one mock backend, in simulated
+// time, to judge how protocol changes load the server.
+//
+// Build from the repository root:
+//   g++ -std=gnu++17 -O2 -Itools/bench/host -Iinclude -Ilib/LinkQuality -Ilib/SyncPolicy
+//       -Ilib/TransportRouter -o fleet_sim lib/LinkQuality/LinkQuality.cpp
+//       lib/SyncPolicy/SyncPolicy.cpp tools/fleet_sim/fleet_sim.cpp
+//
+// Usage:
+//   ./fleet_sim                     100 pumps for 6 simulated hours
+//   ./fleet_sim --pumps 2000 --hours 24 --workers 8
+//   ./fleet_sim --rssi -78          a fleet on weak WiFi
+//   ./fleet_sim --fixed             base intervals, no link quality adaptation
+//   ./fleet_sim --help              all options
+//
+// Each pump runs the firmware's own policy code: SyncPolicy decides when
+// loop() revalidates the settings and syncs and how many executions a sync
+// carries, LinkHealth decides when TransportRouter marks the link unhealthy
+// and probes it, and the intervals come from Config.h. The sim only wakes a
+// pump when SyncPolicy says the next timer is due, as updatePowerMode() does.
+// A settings fetch runs when WiFi comes up. A failed sync is queued and
+// replayed while the link is healthy, as TransportRouter::replayQueued()
+// does. The request bodies match what syncData() and fetchSettings() send in
+// size and shape.
+//
+// The backend serves /api/pump-settings, /api/pump-settings/getById and
+// /api/health from a FIFO queue in front of --workers workers. Each request
+// costs --service-ms plus a per-KB cost. The settings document gets a new
+// revision every --change-every seconds. A pump applies it on its next
+// revalidation, and the report gives that delay as the propagation time.
+// Requests are lost with a probability that grows as the pump's RSSI
+// drops. A loss costs the pump HTTP_TIMEOUT and never reaches the server.
+// WiFi reconnects are not simulated, only backend traffic is. The pumps have
+// no Bluetooth link, so an unhealthy WiFi link leaves them offline.
+
+#include <Config.h>
+#include <LinkHealth.h>
+#include <LinkQuality.h>
+#include <SyncPolicy.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  // As main.cpp configures it
+  const SyncPolicy::Config SYNC_POLICY = {SYNC_INTERVAL, SETTINGS_REVALIDATE_INTERVAL, WIFI_RETRY_INTERVAL,
+                                          WIFI_RETRY_MAX_INTERVAL, SCHEDULE_HISTORY_REPORT};
+
+  // Bytes ArduinoHttpClient and a typical Node backend add around each body
+  const char *SERVER_HOST = "192.168.68.108";
+  const size_t RESPONSE_HEADERS = 230;
+  const size_t NOT_MODIFIED_HEADERS = 150;
+
+  const int64_t MS = 1000; // Simulated time is in us
+
+  struct Options
+  {
+    int pumps = 100;
+    double hours = 6;
+    int workers = 4;
+    double serviceMs = 5;
+    double serviceMsPerKB = 1;
+    double rssi = -62;
+    double rssiSpread = 8;
+    double rttMs = 15;
+    double changeEvery = 900; // s between settings revisions, 0 for never
+    double bootSpread = 60;   // s over which pumps power up
+    bool adaptive = true;
+    unsigned seed = 1;
+  };
+
+  enum Endpoint
+  {
+    SYNC,
+    FETCH,
+    HEALTH,
+    ENDPOINT_COUNT,
+  };
+  const char *endpointName[ENDPOINT_COUNT] = {"POST /api/pump-settings", "GET  /api/pump-settings/getById",
+                                              "GET  /api/health"};
+
+  enum EventKind
+  {
+    CONNECTED,
+    POLL, // A pass of loop() once something is due
+    SETTINGS_CHANGE,
+  };
+
+  struct Event
+  {
+    int64_t time;
+    EventKind kind;
+    int pump;
+    bool operator>(const Event &other) const { return time > other.time; }
+  };
+
+  struct Pump
+  {
+    Pump(int id, double baseRssi, int64_t bootTime) : id(id), baseRssi(baseRssi), bootTime(bootTime), policy(SYNC_POLICY) {}
+
+    // The pump's millis() at a simulated time
+    uint32_t millisAt(int64_t time) const { return (uint32_t)((time - bootTime) / MS); }
+
+    int id;
+    double baseRssi;
+    int64_t bootTime;
+    LinkQuality quality;
+    SyncPolicy policy;
+    LinkHealth health;
+    int revision = -1; // Settings revision applied, -1 for none
+    int64_t busyUntil = 0;
+    int64_t nextPoll = -1;   // Time of the pending POLL event, older ones are stale
+    uint32_t executions = 0; // Schedule executions not yet reported
+    bool syncQueued = false;
+  };
+
+  struct Stats
+  {
+    uint64_t requests[ENDPOINT_COUNT] = {};
+    uint64_t failures[ENDPOINT_COUNT] = {};
+    uint64_t bytesUp = 0, bytesDown = 0;
+    uint64_t notModified = 0;
+    std::vector<double> latencyMs[ENDPOINT_COUNT];
+    std::vector<uint32_t> perSecond;      // Requests reaching the server, per simulated second
+    std::vector<double> propagationS;     // Change to apply, per pump and revision
+    uint64_t unpropagated = 0;            // Pumps still on an old revision at the end
+    uint64_t replayed = 0;
+  };
+
+  class Backend
+  {
+  public:
+    Backend(int workers, double serviceMs, double serviceMsPerKB)
+        : free(workers, 0), serviceMs(serviceMs), serviceMsPerKB(serviceMsPerKB) {}
+
+    // Queues a request that arrives at the given time. Returns when it leaves
+    // the server.
+    int64_t serve(int64_t arrival, size_t bytes)
+    {
+      auto worker = std::min_element(free.begin(), free.end());
+      int64_t start = std::max(arrival, *worker);
+      *worker = start + (int64_t)((serviceMs + serviceMsPerKB * bytes / 1024.0) * MS);
+      return *worker;
+    }
+
+    int revision = 0;
+    int64_t revisionTime = 0;
+    float speed = 1200;
+
+    // Same shape as a real settings document with two dose programs
+    std::string settingsDocument(int pumpId) const
+    {
+      char text[512];
+      snprintf(text, sizeof(text),
+               "{\"pumpId\":\"pump-%d\",\"revision\":\"%d\",\"currentSpeed\":%.1f,\"stepsPerML\":3120.5,"
+               "\"programs\":[{\"id\":1,\"ml\":2.5,\"at\":\"08:00\",\"enabled\":true},"
+               "{\"id\":2,\"ml\":1.0,\"everyMinutes\":90,\"speed\":1500,\"enabled\":true}],"
+               "\"firmware\":{\"version\":\"1.4.0\",\"path\":\"/firmware/smartpump-1.4.0.bin.gz\","
+               "\"sha256\":\"9f2c4e1a7b3d5f60812a4c6e8b0d2f4a6c8e0b2d4f6a8c0e2b4d6f8a0c2e4b6d\","
+               "\"hmac\":\"3b0c1f5e7a9d2b4c6e8f0a1b3d5c7e9f1a2b4c6d8e0f1a3b5c7d9e1f2a4b6c8d\"}}",
+               pumpId, revision, speed);
+      return text;
+    }
+
+  private:
+    std::vector<int64_t> free; // When each worker is next idle
+    double serviceMs;
+    double serviceMsPerKB;
+  };
+
+  size_t requestHeaders(const char *method, const std::string &path, size_t bodyLength)
+  {
+    std::string headers = std::string(method) + " " + path + " HTTP/1.1\r\nHost: " + SERVER_HOST +
+                          "\r\nUser-Agent: Arduino/2.2.0\r\nConnection: close\r\n";
+    if (bodyLength > 0)
+      headers += "Content-Type: application/json\r\nContent-Length: " + std::to_string(bodyLength) + "\r\n";
+    return headers.size() + 2;
+  }
+
+  // Same fields as syncData(), with a typical boot-time-free document
+  std::string syncBody(const Pump &pump, unsigned long syncIntervalMs, size_t executions)
+  {
+    char text[2048];
+    int n = snprintf(text, sizeof(text),
+                     "{\"pumpId\":\"pump-%d\",\"stepsPerML\":3120.5,\"stepsPerSecond\":52,\"currentSpeed\":1200,"
+                     "\"actualSpeed\":1200,\"rssi\":%d,\"link\":{\"quality\":%u,\"rssi\":%.1f,\"successRate\":%.2f,"
+                     "\"latencyMs\":%.1f,\"syncIntervalMs\":%lu,\"reconnectFailures\":%u},"
+                     "\"calibrationTable\":[{\"speed\":500,\"stepsPerML\":3100},{\"speed\":1000,\"stepsPerML\":3111.5},"
+                     "{\"speed\":2000,\"stepsPerML\":3123},{\"speed\":3000,\"stepsPerML\":3134.5},"
+                     "{\"speed\":4000,\"stepsPerML\":3146}],"
+                     "\"volume\":{\"lifetimeML\":123456.789,\"sessionML\":321.5,\"doseML\":2.5,\"doseActive\":false,"
+                     "\"lifetimeSteps\":385000000},"
+                     "\"power\":{\"activeMs\":86400000,\"idleMs\":3600000,\"sleepMs\":7200000},"
+                     "\"schedule\":{\"programs\":2,\"timeSynced\":true,\"driftPpm\":12.5,\"maxJitterMs\":104,\"history\":[",
+                     pump.id, (int)pump.baseRssi, (unsigned)pump.quality.percent(), pump.quality.rssi(),
+                     pump.quality.successRate(), pump.quality.latencyMs(), syncIntervalMs,
+                     (unsigned)pump.quality.connectFailures());
+    std::string body(text, n);
+    for (size_t i = 0; i < executions; i++)
+    {
+      n = snprintf(text, sizeof(text),
+                   "%s{\"seq\":%u,\"program\":1,\"outcome\":\"delivered\",\"scheduled\":1760000000,\"jitterMs\":37,"
+                   "\"requestedML\":2.5,\"deliveredML\":2.49}",
+                   i > 0 ? "," : "", (unsigned)(40 + i));
+      body.append(text, n);
+    }
+    body += "]},\"watchdog\":{\"boot\":12,\"stalls\":[]},\"firmware\":{\"version\":\"1.3.2\",\"ota\":\"idle\",\"progress\":0}}";
+    return body;
+  }
+
+  double percentile(std::vector<double> &values, double p)
+  {
+    if (values.empty())
+      return 0;
+    size_t index = (size_t)std::ceil(p / 100 * values.size());
+    index = index == 0 ? 0 : index - 1;
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+  }
+
+  class Fleet
+  {
+  public:
+    explicit Fleet(const Options &options)
+        : options(options), rng(options.seed), backend(options.workers, options.serviceMs, options.serviceMsPerKB)
+    {
+      end = (int64_t)(options.hours * 3600 * 1000) * MS;
+      stats.perSecond.assign((size_t)(end / (1000 * MS)) + 1, 0);
+      std::normal_distribution<double> rssi(options.rssi, options.rssiSpread);
+      std::uniform_real_distribution<double> boot(0, options.bootSpread * 1000);
+      std::uniform_real_distribution<double> connect(2000, 6000); // WiFi association after boot
+      pumps.reserve(options.pumps);
+      for (int i = 0; i < options.pumps; i++)
+      {
+        double baseRssi = std::min(-30.0, rssi(rng));
+        int64_t bootTime = (int64_t)(boot(rng) * MS);
+        pumps.emplace_back(i + 1, baseRssi, bootTime);
+        schedule(bootTime + (int64_t)(connect(rng) * MS), CONNECTED, i);
+      }
+      if (options.changeEvery > 0)
+        schedule((int64_t)(options.changeEvery * 1000 * MS), SETTINGS_CHANGE, -1);
+    }
+
+    void run()
+    {
+      while (!events.empty() && events.top().time < end)
+      {
+        Event event = events.top();
+        events.pop();
+        if (event.kind == SETTINGS_CHANGE)
+        {
+          changeSettings(event.time);
+          continue;
+        }
+        Pump &pump = pumps[event.pump];
+        if (event.kind == POLL && event.time != pump.nextPoll)
+          continue;
+        // loop() was blocked in a request, the timer is seen afterwards
+        int64_t now = std::max(event.time, pump.busyUntil);
+        if (event.kind == CONNECTED)
+          fetchSettings(pump, now); // Doubles as the health check
+        poll(pump, now);
+      }
+
+      for (const Pump &pump : pumps)
+      {
+        if (pump.revision != backend.revision)
+          stats.unpropagated++;
+      }
+    }
+
+    void report()
+    {
+      double seconds = end / 1e6;
+      uint64_t total = 0, failed = 0;
+      for (int e = 0; e < ENDPOINT_COUNT; e++)
+      {
+        total += stats.requests[e];
+        failed += stats.failures[e];
+      }
+      uint32_t peak = *std::max_element(stats.perSecond.begin(), stats.perSecond.end());
+
+      printf("%d pumps, %.1f h simulated, %s sync pacing, %d workers at %.1f ms + %.1f ms/KB\n", options.pumps,
+             options.hours, options.adaptive ? "adaptive" : "fixed", options.workers, options.serviceMs,
+             options.serviceMsPerKB);
+      printf("requests: %llu (%.2f/s average, %u/s peak at the server), %llu failed (%.2f%%), %llu sync replays\n",
+             (unsigned long long)total, total / seconds, (unsigned)peak, (unsigned long long)failed,
+             total > 0 ? 100.0 * failed / total : 0.0, (unsigned long long)stats.replayed);
+      printf("bytes: %.1f KB/s up, %.1f KB/s down, %.1f KB per pump-hour\n", stats.bytesUp / seconds / 1024,
+             stats.bytesDown / seconds / 1024,
+             (stats.bytesUp + stats.bytesDown) / 1024.0 / (options.pumps * options.hours));
+      printf("settings fetches answered not-modified: %llu of %llu\n", (unsigned long long)stats.notModified,
+             (unsigned long long)stats.requests[FETCH]);
+
+      printf("\n%-32s %9s %8s %8s %8s %8s %8s\n", "latency ms", "requests", "failed", "p50", "p90", "p99", "max");
+      for (int e = 0; e < ENDPOINT_COUNT; e++)
+      {
+        std::vector<double> &values = stats.latencyMs[e];
+        double maxValue = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+        printf("%-32s %9llu %8llu %8.1f %8.1f %8.1f %8.1f\n", endpointName[e], (unsigned long long)stats.requests[e],
+               (unsigned long long)stats.failures[e], percentile(values, 50), percentile(values, 90),
+               percentile(values, 99), maxValue);
+      }
+
+      std::vector<double> &propagation = stats.propagationS;
+      double maxPropagation = propagation.empty() ? 0 : *std::max_element(propagation.begin(), propagation.end());
+      printf("\nsettings propagation s: %zu applied, p50 %.0f, p90 %.0f, p99 %.0f, max %.0f, %llu pumps behind at the end\n",
+             propagation.size(), percentile(propagation, 50), percentile(propagation, 90),
+             percentile(propagation, 99), maxPropagation, (unsigned long long)stats.unpropagated);
+    }
+
+  private:
+    void schedule(int64_t time, EventKind kind, int pump)
+    {
+      events.push({time, kind, pump});
+    }
+
+    // main.cpp's pacingLink(): --fixed runs every pump at the base rates
+    const LinkQuality *pacingLink(const Pump &pump) const
+    {
+      return options.adaptive ? &pump.quality : nullptr;
+    }
+
+    // One pass of loop() and TransportRouter::poll(), then sleeps until the
+    // next timer is due
+    void poll(Pump &pump, int64_t now)
+    {
+      uint32_t nowMs = pump.millisAt(now);
+      if (pump.health.healthy && pump.policy.revalidateDue(nowMs))
+        fetchSettings(pump, now);
+      if (pump.health.healthy && pump.policy.syncDue(nowMs, pacingLink(pump)))
+      {
+        sync(pump, std::max(now, pump.busyUntil));
+        pump.policy.synced(nowMs);
+      }
+
+      now = std::max(now, pump.busyUntil);
+      if (pump.health.probeDue(pump.millisAt(now), LINK_PROBE_INTERVAL))
+      {
+        pump.health.lastProbeTime = pump.millisAt(now);
+        request(pump, now, HEALTH, "GET", "/api/health", 0, 15);
+      }
+      if (pump.health.healthy && pump.syncQueued)
+      {
+        stats.replayed++;
+        sync(pump, pump.busyUntil);
+      }
+
+      int64_t wake = std::max(now, pump.busyUntil);
+      uint32_t sleepMs;
+      if (pump.health.healthy)
+      {
+        sleepMs = pump.policy.msUntilNext(pump.millisAt(wake), true, pacingLink(pump));
+      }
+      else
+      {
+        // Offline until a probe gets through, nothing else can run
+        uint32_t sinceProbe = pump.millisAt(wake) - (uint32_t)pump.health.lastProbeTime;
+        sleepMs = sinceProbe >= LINK_PROBE_INTERVAL ? 0 : LINK_PROBE_INTERVAL - sinceProbe;
+      }
+      pump.nextPoll = wake + (int64_t)std::max<uint32_t>(sleepMs, 1) * MS;
+      schedule(pump.nextPoll, POLL, pump.id - 1);
+    }
+
+    void changeSettings(int64_t now)
+    {
+      backend.revision++;
+      backend.revisionTime = now;
+      backend.speed = 800 + (backend.revision % 8) * 100;
+      schedule(now + (int64_t)(options.changeEvery * 1000 * MS), SETTINGS_CHANGE, -1);
+    }
+
+    // Mirrors fetchSettings(): conditional once a revision is cached, and
+    // revalidation runs from the time of the fetch
+    void fetchSettings(Pump &pump, int64_t now)
+    {
+      now = std::max(now, pump.busyUntil);
+      pump.policy.fetched(pump.millisAt(now));
+      std::string path = "/api/pump-settings/getById?pump-id=pump-" + std::to_string(pump.id);
+      if (pump.revision >= 0)
+        path += "&revision=" + std::to_string(pump.revision);
+      int64_t done;
+      if (request(pump, now, FETCH, "GET", path, 0, 0, &done) && pump.revision != backend.revision)
+      {
+        if (pump.revision >= 0 || backend.revision > 0)
+          stats.propagationS.push_back((done - backend.revisionTime) / 1e6);
+        pump.revision = backend.revision;
+      }
+    }
+
+    void sync(Pump &pump, int64_t now)
+    {
+      std::uniform_int_distribution<int> doses(0, 2);
+      pump.executions = std::min<uint32_t>(pump.executions + doses(rng), 16); // DoseScheduler keeps 16
+      size_t sent = std::min<size_t>(pump.executions, pump.policy.historyBatch(pacingLink(pump)));
+      std::string body = syncBody(pump, pump.policy.syncInterval(pacingLink(pump)), sent);
+      if (request(pump, now, SYNC, "POST", "/api/pump-settings", body.size(), 12))
+      {
+        pump.executions -= sent;
+        pump.syncQueued = false;
+      }
+      else
+      {
+        pump.syncQueued = true; // A newer sync supersedes the queued one
+      }
+    }
+
+    // One HTTP exchange as the pump sees it. Returns whether it succeeded and
+    // when the pump got the answer.
+    bool request(Pump &pump, int64_t now, Endpoint endpoint, const char *method, const std::string &path,
+                 size_t bodyLength, size_t responseLength, int64_t *doneOut = nullptr)
+    {
+      // Feeds the estimate like sampleLink() does
+      std::normal_distribution<double> noise(0, 2);
+      int rssi = (int)std::lround(pump.baseRssi + noise(rng));
+      pump.quality.addSignal(rssi);
+
+      size_t up = requestHeaders(method, path, bodyLength) + bodyLength;
+      double rtt = options.rttMs * MS;
+      std::uniform_real_distribution<double> unit(0, 1);
+      double lossProbability = std::min(0.9, std::max(0.0, (-75.0 - rssi) / 20.0));
+      stats.requests[endpoint]++;
+
+      int64_t done;
+      bool ok;
+      if (unit(rng) < lossProbability)
+      {
+        done = now + HTTP_TIMEOUT * MS;
+        ok = false;
+        stats.bytesUp += up;
+      }
+      else
+      {
+        int64_t arrival = now + (int64_t)(rtt / 2);
+        size_t second = (size_t)(arrival / (1000 * MS));
+        if (second < stats.perSecond.size())
+          stats.perSecond[second]++;
+        int64_t left = backend.serve(arrival, up);
+
+        size_t down;
+        if (endpoint == FETCH)
+        {
+          bool notModified = pump.revision == backend.revision;
+          if (notModified)
+            stats.notModified++;
+          down = notModified ? NOT_MODIFIED_HEADERS : RESPONSE_HEADERS + backend.settingsDocument(pump.id).size();
+        }
+        else
+        {
+          down = RESPONSE_HEADERS + responseLength;
+        }
+        stats.bytesUp += up;
+        stats.bytesDown += down;
+
+        done = left + (int64_t)(rtt / 2);
+        ok = done - now < (int64_t)HTTP_TIMEOUT * MS;
+        if (!ok)
+          done = now + HTTP_TIMEOUT * MS;
+      }
+
+      stats.latencyMs[endpoint].push_back((done - now) / (double)MS);
+      pump.quality.addRequest(ok, (done - now) / MS);
+      pump.busyUntil = done;
+      pump.health.recordResult(ok);
+      if (!ok)
+        stats.failures[endpoint]++;
+      if (doneOut != nullptr)
+        *doneOut = done;
+      return ok;
+    }
+
+    Options options;
+    std::mt19937 rng;
+    Backend backend;
+    std::vector<Pump> pumps;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    Stats stats;
+    int64_t end;
+  };
+
+  void usage(const char *name)
+  {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --pumps N            fleet size (100)\n"
+            "  --hours H            simulated time (6)\n"
+            "  --workers N          backend workers (4)\n"
+            "  --service-ms MS      backend cost per request (5)\n"
+            "  --service-ms-kb MS   backend cost per KB of request (1)\n"
+            "  --rssi DBM           mean RSSI across the fleet (-62)\n"
+            "  --rssi-spread DB     standard deviation of RSSI (8)\n"
+            "  --rtt MS             network round trip (15)\n"
+            "  --change-every S     settings revision interval, 0 for never (900)\n"
+            "  --boot-spread S      window over which pumps power up (60)\n"
+            "  --fixed              base sync interval and batch size for every pump\n"
+            "  --seed N             random seed (1)\n",
+            name);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--fixed") == 0)
+      options.adaptive = false;
+    else if (strcmp(arg, "--pumps") == 0 && hasValue)
+      options.pumps = atoi(argv[++i]);
+    else if (strcmp(arg, "--hours") == 0 && hasValue)
+      options.hours = atof(argv[++i]);
+    else if (strcmp(arg, "--workers") == 0 && hasValue)
+      options.workers = atoi(argv[++i]);
+    else if (strcmp(arg, "--service-ms") == 0 && hasValue)
+      options.serviceMs = atof(argv[++i]);
+    else if (strcmp(arg, "--service-ms-kb") == 0 && hasValue)
+      options.serviceMsPerKB = atof(argv[++i]);
+    else if (strcmp(arg, "--rssi") == 0 && hasValue)
+      options.rssi = atof(argv[++i]);
+    else if (strcmp(arg, "--rssi-spread") == 0 && hasValue)
+      options.rssiSpread = atof(argv[++i]);
+    else if (strcmp(arg, "--rtt") == 0 && hasValue)
+      options.rttMs = atof(argv[++i]);
+    else if (strcmp(arg, "--change-every") == 0 && hasValue)
+      options.changeEvery = atof(argv[++i]);
+    else if (strcmp(arg, "--boot-spread") == 0 && hasValue)
+      options.bootSpread = atof(argv[++i]);
+    else if (strcmp(arg, "--seed") == 0 && hasValue)
+      options.seed = (unsigned)atoi(argv[++i]);
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (options.pumps <= 0 || options.hours <= 0 || options.workers <= 0)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Fleet fleet(options);
+  fleet.run();
+  fleet.report();
+  return 0;
+}
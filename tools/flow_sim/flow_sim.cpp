@@ -0,0 +1,232 @@
+// Host simulation of closed-loop flow regulation, for tuning FlowRegulator
+// without a pump or a flow sensor.
+//
+// Build from the repository root:
+//   g++ -std=gnu++17 -O2 -Iinclude -Ilib/FlowRegulator -o flow_sim
+//       lib/FlowRegulator/FlowRegulator.cpp tools/flow_sim/flow_sim.cpp
+//
+// Usage:
+//   ./flow_sim                       default scenario, prints hourly rows, PASS/FAIL
+//   ./flow_sim --kp 0.5 --ki 0.1     try other gains
+//   ./flow_sim --wear 1 --hours 48   faster tubing wear over a longer run
+//   ./flow_sim --help                all options
+//
+// The model: the tubing's true steps/mL starts off the calibration by
+// --initial-error and grows by --wear percent per running hour. Flow follows
+// the step rate through a first-order lag (tubing compliance) with a ripple
+// at the roller frequency. The sensor turns volume into whole pulses at its
+// K-factor, which can itself be off by --k-error. loop() is modelled as a
+// call every 10 ms, as in main.cpp. Midway the sensor goes dead for at
+// least two minutes to check that the trim falls back to 1 instead of
+// winding up.
+//
+// PASS needs the flow within 2% of the setpoint on average after the first
+// hour, the calibration within 3% of the tubing at the end, and the
+// dead-sensor window flagged with the trim back at 1. A K-factor error moves
+// the flow by as much, since the loop can only hold what the sensor reads;
+// it is added to the flow bound and the calibration check is skipped.
+//
+// The regulator starts from the FLOW_* settings in Config.h, so the sim
+// checks the gains the firmware ships with.
+
+#include <Config.h>
+#include <FlowRegulator.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+  struct Options
+  {
+    double hours = 24;
+    double targetMlPerMin = 30;
+    double stepsPerML = 3120;    // Calibration at the start
+    double initialError = 4;     // % the tubing is already off the calibration
+    double wearPerHour = 0.25;   // % steps/mL growth per running hour
+    double kError = 0;           // % the sensor K-factor is off
+    double lagMs = 800;          // Flow time constant
+    double ripple = 10;          // % flow ripple at the roller frequency
+    double rollersPerRev = 3;
+    double stepsPerRev = 200 * 256;
+    uint32_t loopMs = 10;
+    FlowRegulator::Config regulator = {
+        FLOW_PULSES_PER_ML, FLOW_KP, FLOW_KI, FLOW_MAX_TRIM, FLOW_WINDOW_MS, FLOW_MIN_PULSES,
+        FLOW_RECALIBRATE_ERROR, FLOW_RECALIBRATE_ML, FLOW_MAX_RECALIBRATION,
+    };
+  };
+
+  struct Result
+  {
+    double meanError = 0; // % of setpoint, after the first hour
+    double finalCalibrationError = 0;
+    bool faultSeen = false;
+    bool trimResetOnFault = true;
+    uint32_t recalibrations = 0;
+  };
+
+  Result simulate(const Options &options, bool print)
+  {
+    FlowRegulator regulator;
+    regulator.configure(options.regulator);
+
+    const double dt = options.loopMs / 1000.0;
+    const double pulsesPerML = options.regulator.pulsesPerML * (1 + options.kError / 100);
+    const uint64_t endMs = (uint64_t)(options.hours * 3600 * 1000);
+    // Dead long enough for the fault to show even at slow flows
+    const double pulsesPerSecond = options.targetMlPerMin / 60 * pulsesPerML;
+    const double detectMs = 2000 * FlowRegulator::FAULT_FACTOR * options.regulator.minPulses / pulsesPerSecond;
+    const uint64_t deadStart = endMs / 2, deadEnd = deadStart + (uint64_t)std::max(120000.0, detectMs);
+
+    double calibration = options.stepsPerML;
+    double trueStepsPerML = options.stepsPerML * (1 + options.initialError / 100);
+    double flow = 0;          // mL/s
+    double stepAccumulator = 0, volumeAccumulator = 0, phase = 0;
+    uint32_t steps = 0, pulses = 0;
+    double errorSum = 0;
+    uint64_t errorSamples = 0;
+    Result result;
+
+    if (print)
+      printf("%5s %10s %11s %7s %10s %8s %6s\n", "hour", "tubing", "calibration", "trim", "flow", "error %", "recal");
+
+    for (uint64_t now = 0; now < endMs; now += options.loopMs)
+    {
+      float trim = regulator.update((uint32_t)now, (float)options.targetMlPerMin, (float)calibration, steps, pulses);
+      float factor;
+      if (regulator.takeRecalibration(factor))
+        calibration *= factor; // main.cpp saves it to EEPROM
+      trim = regulator.trim();
+
+      // Pump: the firmware's rate from the calibration, scaled by the trim
+      double stepRate = options.targetMlPerMin / 60 * calibration * trim;
+      stepAccumulator += stepRate * dt;
+      uint32_t wholeSteps = (uint32_t)stepAccumulator;
+      steps += wholeSteps;
+      stepAccumulator -= wholeSteps;
+
+      // Tubing: lagged flow with roller ripple
+      double ideal = stepRate / trueStepsPerML;
+      flow += (ideal - flow) * (1 - exp(-(double)options.loopMs / options.lagMs));
+      phase += stepRate / options.stepsPerRev * options.rollersPerRev * dt * 2 * M_PI;
+      double delivered = flow * (1 + options.ripple / 100 * sin(phase)) * dt;
+      trueStepsPerML *= 1 + options.wearPerHour / 100 * dt / 3600;
+
+      // Sensor
+      bool dead = now >= deadStart && now < deadEnd;
+      volumeAccumulator += delivered * pulsesPerML;
+      uint32_t wholePulses = (uint32_t)volumeAccumulator;
+      if (!dead)
+        pulses += wholePulses;
+      volumeAccumulator -= wholePulses;
+
+      if (dead && regulator.sensorFault())
+      {
+        result.faultSeen = true;
+        if (trim != 1)
+          result.trimResetOnFault = false;
+      }
+
+      // Error of the flow actually delivered, outside the start-up hour and the dead-sensor window
+      if (now >= 3600000 && (now < deadStart || now >= deadEnd + 600000))
+      {
+        errorSum += fabs(flow * 60 - options.targetMlPerMin) / options.targetMlPerMin * 100;
+        errorSamples++;
+      }
+
+      if (print && now % 3600000 == 0)
+        printf("%5llu %10.1f %11.1f %7.3f %10.2f %8.2f %6u\n", (unsigned long long)(now / 3600000), trueStepsPerML,
+               calibration, trim, flow * 60, (flow * 60 - options.targetMlPerMin) / options.targetMlPerMin * 100,
+               regulator.recalibrationCount());
+    }
+
+    result.meanError = errorSamples > 0 ? errorSum / errorSamples : 0;
+    result.finalCalibrationError = fabs(calibration - trueStepsPerML) / trueStepsPerML * 100;
+    result.recalibrations = regulator.recalibrationCount();
+    return result;
+  }
+
+  void usage(const char *name)
+  {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --hours H          simulated running time (24)\n"
+            "  --target ML        setpoint, mL/min (30)\n"
+            "  --initial-error P  tubing off the calibration at the start, %% (4)\n"
+            "  --wear P           steps/mL growth per running hour, %% (0.25)\n"
+            "  --k-error P        sensor K-factor error, %% (0)\n"
+            "  --lag MS           flow time constant (800)\n"
+            "  --ripple P         roller ripple, %% of flow (10)\n"
+            "  --kp X --ki X      PI gains (0.1, 0.01)\n"
+            "  --max-trim X       largest trim, fraction (0.2)\n"
+            "  --window MS        shortest measurement window (5000)\n"
+            "  --min-pulses N     fewest pulses per window (50)\n"
+            "  --pulses-per-ml X  sensor K-factor (5.88)\n",
+            name);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 2;
+    }
+    double value = atof(argv[++i]);
+    if (strcmp(arg, "--hours") == 0)
+      options.hours = value;
+    else if (strcmp(arg, "--target") == 0)
+      options.targetMlPerMin = value;
+    else if (strcmp(arg, "--initial-error") == 0)
+      options.initialError = value;
+    else if (strcmp(arg, "--wear") == 0)
+      options.wearPerHour = value;
+    else if (strcmp(arg, "--k-error") == 0)
+      options.kError = value;
+    else if (strcmp(arg, "--lag") == 0)
+      options.lagMs = value;
+    else if (strcmp(arg, "--ripple") == 0)
+      options.ripple = value;
+    else if (strcmp(arg, "--kp") == 0)
+      options.regulator.kp = value;
+    else if (strcmp(arg, "--ki") == 0)
+      options.regulator.ki = value;
+    else if (strcmp(arg, "--max-trim") == 0)
+      options.regulator.maxTrim = value;
+    else if (strcmp(arg, "--window") == 0)
+      options.regulator.windowMs = (uint32_t)value;
+    else if (strcmp(arg, "--min-pulses") == 0)
+      options.regulator.minPulses = (uint32_t)value;
+    else if (strcmp(arg, "--pulses-per-ml") == 0)
+      options.regulator.pulsesPerML = value;
+    else
+    {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!(options.hours > 1) || !(options.targetMlPerMin > 0) || !(options.regulator.pulsesPerML > 0))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Result result = simulate(options, true);
+  printf("\nmean flow error %.2f%%, calibration off the tubing by %.2f%%, %u recalibrations\n", result.meanError,
+         result.finalCalibrationError, (unsigned)result.recalibrations);
+  printf("dead sensor: %s, trim %s\n", result.faultSeen ? "detected" : "missed",
+         result.trimResetOnFault ? "back at 1" : "kept winding");
+
+  bool pass = result.meanError < 2 + fabs(options.kError) && result.faultSeen && result.trimResetOnFault &&
+              (options.kError != 0 || result.finalCalibrationError < 3);
+  printf("%s\n", pass ? "PASS" : "FAIL");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+// Host-side peer for the BluetoothManager frame protocol.
+//
+// Build from the repository root:
+//   g++ -std=gnu++17 -O2 -Ilib/FrameProtocol -o frame_peer
+//       lib/FrameProtocol/FrameProtocol.cpp tools/frame_peer/frame_peer.cpp
+//
+// Usage:
+//   ./frame_peer --loopback        run device and peer sessions back to back in memory
+//   ./frame_peer /dev/rfcomm0      answer requests from a paired pump and print telemetry
+//
+// The loopback mode delivers bytes in random chunks and answers requests out of
+// order, once over a clean link and once with bit errors injected. It exits
+// non-zero if a response is matched to the wrong request, if a clean run sees a
+// timeout, or if a request is left pending.
+
+#include <FrameProtocol.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace FrameProtocol;
+
+namespace
+{
+  const char *methodName(uint8_t method)
+  {
+    switch (method)
+    {
+    case REQ_GET:
+      return "GET";
+    case REQ_POST:
+      return "POST";
+    case REQ_PUT:
+      return "PUT";
+    case REQ_DELETE:
+      return "DELETE";
+    }
+    return "?";
+  }
+
+  // Mock backend used by both modes
+  std::string mockResponse(uint8_t method, const char *path, const char *body, uint16_t &status)
+  {
+    status = 200;
+    if (strcmp(path, "/api/health") == 0)
+      return "{\"status\":\"ok\"}";
+    if (strncmp(path, "/api/pump-settings/getById", 26) == 0)
+      return "{\"currentSpeed\":1200}";
+    if (method == REQ_POST || method == REQ_PUT)
+      return body;
+    status = 404;
+    return "{\"error\":\"not found\"}";
+  }
+
+  struct Pipe
+  {
+    std::deque<uint8_t> bytes;
+    void write(const uint8_t *data, size_t len) { bytes.insert(bytes.end(), data, data + len); }
+  };
+
+  int runLoopback(bool noisy)
+  {
+    std::mt19937 rng(1234);
+    Pipe toPeer, toDevice;
+    FrameSession device([&](const uint8_t *d, size_t n) { toPeer.write(d, n); });
+    FrameSession peer([&](const uint8_t *d, size_t n) { toDevice.write(d, n); });
+
+    // Peer holds requests and answers them in reverse order
+    struct Held
+    {
+      uint8_t id;
+      uint16_t status;
+      std::string body;
+    };
+    std::vector<Held> held;
+    peer.onRequest([&](uint8_t id, uint8_t method, const char *path, const char *, const char *body) {
+      uint16_t status;
+      std::string response = mockResponse(method, path, body, status);
+      held.push_back({id, status, response});
+    });
+
+    int notifications = 0;
+    peer.onNotification([&](const uint8_t *payload, size_t len) {
+      if (std::string((const char *)payload, len) == "{\"flow\":1.5}")
+        notifications++;
+    });
+
+    const int ROUNDS = 2000;
+    int completed = 0, mismatched = 0, timedOut = 0;
+    uint32_t now = 0;
+
+    // Moves a random-sized chunk from a pipe into a session, occasionally flipping a bit
+    auto pump = [&](Pipe &pipe, FrameSession &session, bool corrupt) {
+      size_t n = std::min(pipe.bytes.size(), (size_t)(rng() % 40 + 1));
+      std::vector<uint8_t> chunk(pipe.bytes.begin(), pipe.bytes.begin() + n);
+      pipe.bytes.erase(pipe.bytes.begin(), pipe.bytes.begin() + n);
+      if (corrupt && n > 0 && rng() % 200 == 0)
+        chunk[rng() % n] ^= 0x10;
+      session.feed(chunk.data(), chunk.size());
+    };
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+      // Keep several requests in flight
+      while (device.pendingCount() < FrameSession::MAX_PENDING - 2)
+      {
+        bool isPost = rng() % 2;
+        std::string expected = isPost ? "{\"speed\":" + std::to_string(round) + "}" : "{\"status\":\"ok\"}";
+        uint8_t id = device.request(isPost ? REQ_POST : REQ_GET, isPost ? "/api/pump-settings" : "/api/health",
+                                    isPost ? "application/json" : "", isPost ? expected.c_str() : "", now, 500,
+                                    [&, expected](bool ok, uint16_t status, const char *body, size_t len) {
+                                      if (!ok)
+                                        timedOut++;
+                                      else if (status != 200 || std::string(body, len) != expected)
+                                        mismatched++;
+                                      else
+                                        completed++;
+                                    });
+        if (id == 0)
+          break;
+      }
+      if (round % 10 == 0)
+        device.notify((const uint8_t *)"{\"flow\":1.5}", 12);
+
+      while (!toPeer.bytes.empty())
+        pump(toPeer, peer, noisy);
+      while (!held.empty())
+      {
+        Held h = held.back();
+        held.pop_back();
+        peer.respond(h.id, h.status, h.body.data(), h.body.size());
+      }
+      while (!toDevice.bytes.empty())
+        pump(toDevice, device, noisy);
+
+      now += 50;
+      device.expire(now);
+    }
+    now += 1000;
+    device.expire(now);
+
+    printf("%s link: completed=%d timed_out=%d mismatched=%d notifications=%d\n", noisy ? "noisy" : "clean",
+           completed, timedOut, mismatched, notifications);
+    printf("device: crc_errors=%u unmatched=%u  peer: crc_errors=%u\n", device.decoder().crcErrors(),
+           device.unmatchedResponses(), peer.decoder().crcErrors());
+
+    // Corrupted frames may only ever show up as timeouts
+    bool pass = mismatched == 0 && device.pendingCount() == 0 && completed > ROUNDS && (noisy || timedOut == 0);
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+  }
+
+  int runSerial(const char *device)
+  {
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+      perror(device);
+      return 1;
+    }
+    termios tty;
+    if (tcgetattr(fd, &tty) == 0)
+    {
+      cfmakeraw(&tty);
+      cfsetspeed(&tty, B115200);
+      tcsetattr(fd, TCSANOW, &tty);
+    }
+
+    FrameSession peer([&](const uint8_t *d, size_t n) {
+      if (::write(fd, d, n) < 0)
+        perror("write");
+    });
+    peer.onRequest([&](uint8_t id, uint8_t method, const char *path, const char *, const char *body) {
+      uint16_t status;
+      std::string response = mockResponse(method, path, body, status);
+      printf("<- #%u %s %s %s\n-> #%u %u %s\n", id, methodName(method), path, body, id, status, response.c_str());
+      peer.respond(id, status, response.data(), response.size());
+    });
+    peer.onNotification([](const uint8_t *payload, size_t len) {
+      printf("telemetry: %.*s\n", (int)len, (const char *)payload);
+    });
+
+    uint8_t buffer[256];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+      peer.feed(buffer, n);
+      fflush(stdout);
+    }
+    close(fd);
+    return 0;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 2 && strcmp(argv[1], "--loopback") == 0)
+    return runLoopback(false) | runLoopback(true);
+  if (argc == 2)
+    return runSerial(argv[1]);
+  fprintf(stderr, "usage: %s --loopback | <serial device>\n", argv[0]);
+  return 2;
+}
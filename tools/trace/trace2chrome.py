@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Converts a trace dump from the firmware into Chrome trace JSON.
+
+Build with the esp32dev-trace environment, capture the serial output while
+typing "trace", then:
+
+    pio device monitor | tee capture.log
+    python3 tools/trace/trace2chrome.py capture.log > trace.json
+
+Open trace.json in https://ui.perfetto.dev or chrome://tracing. Lines that
+are not part of the dump are ignored, so the capture may hold other output.
+If it holds several dumps, the last one is converted.
+"""
+
+import json
+import sys
+
+TYPE_BEGIN, TYPE_END, TYPE_INSTANT, TYPE_ASYNC_BEGIN, TYPE_ASYNC_END = range(5)
+
+
+def parse(lines):
+    dump = None
+    for line in lines:
+        line = line.strip()
+        if not line.startswith("TRACE "):
+            continue
+        fields = line.split()
+        kind = fields[1]
+        if kind == "BEGIN":
+            version = int(fields[2])
+            if version != 2:
+                raise ValueError(f"unsupported trace version {version}, convert it with the matching revision")
+            now, count, overwritten, cores = (int(f) for f in fields[3:7])
+            dump = {"now": now, "overwritten": overwritten, "cores": cores, "names": {}, "events": []}
+        elif dump is None:
+            continue
+        elif kind == "NAME":
+            dump["names"][int(fields[2])] = fields[3]
+        elif kind == "EV":
+            us, etype, eid, core, arg = (int(f, 16) for f in fields[2:7])
+            dump["events"].append((us, etype, eid, core, arg))
+        elif kind == "END":
+            dump["complete"] = True
+    if dump is None:
+        raise ValueError("no TRACE BEGIN line found")
+    if not dump.get("complete"):
+        print("warning: dump is truncated", file=sys.stderr)
+    return dump
+
+
+def signed32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def timestamps(dump):
+    """Microseconds since boot for each event.
+
+    Walks the events newest first from the full clock printed at dump time,
+    so the 32-bit microsecond counter is unwrapped one step at a time. Both
+    cores share the clock, so one walk covers them. Steps are signed to
+    tolerate events recorded slightly out of order, which limits a gap
+    between consecutive events to 2^31 us (~35 minutes); a longer one would
+    put events before boot, and the dump is refused.
+    """
+    result = [None] * len(dump["events"])
+    previous = dump["now"]
+    for i in range(len(dump["events"]) - 1, -1, -1):
+        us = dump["events"][i][0]
+        previous -= signed32((previous & 0xFFFFFFFF) - us)
+        if previous < 0:
+            raise ValueError("events too far apart to unwrap the 32-bit clock")
+        result[i] = previous
+    return result
+
+
+def convert(dump):
+    names = dump["names"]
+    events = []
+    open_async = {}
+    for ts, (_, etype, eid, core, arg) in zip(timestamps(dump), dump["events"]):
+        event = {"name": names.get(eid, f"id{eid}"), "pid": 1, "tid": core, "ts": round(ts, 3)}
+        if etype == TYPE_BEGIN:
+            event["ph"] = "B"
+            event["args"] = {"arg": arg}
+        elif etype == TYPE_END:
+            event["ph"] = "E"
+        elif etype == TYPE_INSTANT:
+            event["ph"] = "i"
+            event["s"] = "t"
+            event["args"] = {"arg": arg}
+        elif etype == TYPE_ASYNC_BEGIN:
+            event["ph"] = "b"
+            event["cat"] = "async"
+            event["id"] = eid
+            open_async[eid] = True
+        elif etype == TYPE_ASYNC_END:
+            if not open_async.pop(eid, False):
+                continue  # Began before the oldest event in the buffer
+            event["ph"] = "e"
+            event["cat"] = "async"
+            event["id"] = eid
+            event["args"] = {"arg": arg}
+        else:
+            continue
+        events.append(event)
+
+    metadata = [{"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "SmartPump"}}]
+    for core in range(dump["cores"]):
+        metadata.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": core, "args": {"name": f"core {core}"}})
+    return {
+        "traceEvents": metadata + events,
+        "displayTimeUnit": "ms",
+        "otherData": {"overwrittenEvents": dump["overwritten"]},
+    }
+
+
+def main():
+    if len(sys.argv) > 2:
+        print(f"usage: {sys.argv[0]} [capture.log]", file=sys.stderr)
+        return 2
+    with (open(sys.argv[1], errors="replace") if len(sys.argv) == 2 else sys.stdin) as source:
+        try:
+            dump = parse(source)
+        except ValueError as error:
+            print(f"error: {error}", file=sys.stderr)
+            return 1
+    json.dump(convert(dump), sys.stdout, indent=1)
+    sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())